@@ -8,18 +8,90 @@
 #include "db_config.h"
 #include <iostream>
 #include <bsoncxx/builder/basic/array.hpp>
+#include <bsoncxx/builder/basic/document.hpp>
 #include <bsoncxx/json.hpp>
+#include <bsoncxx/types.hpp>
+#include <mongocxx/exception/operation_exception.hpp>
 
 using namespace std;
+using bsoncxx::builder::basic::kvp;
+using bsoncxx::builder::basic::make_document;
+
+static const char* STATS_ID = "features";  // _id of the statistics document
 
 // Define MongoDB client and connection as **persistent** members
 // Create a database called "feature_db", a data collection called "features"
-DBManager::DBManager() : client(DBConfig::connect()), collection(client["feature_db"]["features"]) {
+// and a collection "feature_stats" holding one document with the running statistics
+DBManager::DBManager() : client(DBConfig::connect()), collection(client["feature_db"]["features"]),
+                         statsCollection(client["feature_db"]["feature_stats"]) {
     cout << "MongoDB Connection Initialized!" << endl;
 }
 
+// Label and features of a stored sample; false (with a message) for malformed documents
+static bool parseFeatureVector(const bsoncxx::document::view& doc, string& label, ObjectFeatures& featureVector) {
+    size_t featureCount = 0;
+
+    if (doc["type"] && doc["type"].type() == bsoncxx::type::k_string) {
+        label = string(doc["type"].get_string().value); // fix: boost string error
+    } else {
+        cerr << "Error: 'type' field missing or incorrect type!" << endl;
+        return false;
+    }
+
+    if (doc["features"] && doc["features"].type() == bsoncxx::type::k_array) {
+        auto bsonArray = doc["features"].get_array().value;
+        for (auto &&val : bsonArray) {
+            if (val.type() != bsoncxx::type::k_double) {
+                cerr << "Error: Non-float value found in feature vector!" << endl;
+            } else if (featureCount < FEATURE_DIMS) {
+                featureVector[featureCount++] = static_cast<float>(val.get_double().value);
+            } else {
+                featureCount++;  // Too long, reported below
+            }
+        }
+    } else {
+        cerr << "Error: 'features' field missing or incorrect type!" << endl;
+        return false;
+    }
+    if (featureCount != FEATURE_DIMS) {
+        cerr << "Error: skipping a '" << label << "' vector with " << featureCount << " features" << endl;
+        return false;
+    }
+    return true;
+}
+
+// FEATURE_DIMS doubles of a statistics array
+static bool parseDoubles(const bsoncxx::document::element& element, array<double, FEATURE_DIMS>& values) {
+    if (!element || element.type() != bsoncxx::type::k_array) {
+        return false;
+    }
+    size_t count = 0;
+    for (auto&& val : element.get_array().value) {
+        if (val.type() != bsoncxx::type::k_double || count == FEATURE_DIMS) {
+            return false;
+        }
+        values[count++] = val.get_double().value;
+    }
+    return count == FEATURE_DIMS;
+}
+
+// Order-independent checksum of the stored samples: the sum of an FNV-1a hash of every sample, so a sample
+// is added or taken out in O(dims) like the statistics
+static uint64_t sampleChecksum(const string& label, const ObjectFeatures& featureVector) {
+    uint64_t hash = 14695981039346656037ull;
+    auto mix = [&hash](const void* data, size_t size) {
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < size; i++) {
+            hash = (hash ^ bytes[i]) * 1099511628211ull;
+        }
+    };
+    mix(label.data(), label.size());
+    mix(featureVector.data(), FEATURE_DIMS * sizeof(float));
+    return hash;
+}
+
 // Store feature vector in MongoDB
-int DBManager::writeFeatureVector(const string &label, const vector<float> &featureVector) {
+int DBManager::writeFeatureVector(const string &label, const ObjectFeatures &featureVector) {
     try {
         bsoncxx::builder::basic::document document{};
         bsoncxx::builder::basic::array featureArray;
@@ -39,7 +111,15 @@ int DBManager::writeFeatureVector(const string &label, const vector<float> &feat
             cout << "Successfully created a new feature vector in MongoDB!" << endl;
             cout << "Feature vector stored for type: " << label << endl;
             cout << "Feature vector size : " << featureVector.size() << endl;
-            return 0;  // Success
+            // O(dims) Welford update; the sample is stored either way, so a failure must not cause a retry
+            if (updateFeatureStats([&](FeatureStats& stats, uint64_t& checksum) {
+                    stats.add(featureVector);
+                    checksum += sampleChecksum(label, featureVector);
+                }) != 0) {
+                cerr << "Warning: feature statistics not updated, repair them with VidDisplay --rebuild-stats" << endl;
+                return 1;
+            }
+            return 0;
         } else {
             cerr << "Error: Insertion failed for label: " << label << endl;
             return -1;  // Failure
@@ -52,41 +132,229 @@ int DBManager::writeFeatureVector(const string &label, const vector<float> &feat
 
 
 //  Load all feature vectors from MongoDB
-int DBManager::loadFeatureVectors(vector<pair<string, vector<float>>>& data) {
+int DBManager::loadFeatureVectors(TrainingSet& data) {
+    data.clear();
     mongocxx::cursor cursor = collection.find({});
+    vector<string> labels;
+    vector<ObjectFeatures> features;
 
     for (auto&& doc : cursor) {
         string label;
-        vector<float> featureVector;
-
-        if (doc["type"] && doc["type"].type() == bsoncxx::type::k_string) {
-            label = string(doc["type"].get_string().value); // fix: boost string error
-        } else {
-            cerr << "Error: 'type' field missing or incorrect type!" << endl;
+        ObjectFeatures featureVector;
+        if (!parseFeatureVector(doc, label, featureVector)) {
             continue;
         }
+        labels.push_back(label);
+        features.push_back(featureVector);
+    }
+
+    // The normalization of every index built from data uses the stored statistics as they are
+    FeatureStats stored;
+    if (loadFeatureStats(stored) == 0 && stored.count == static_cast<int64_t>(features.size())) {
+        data.assign(std::move(labels), std::move(features), stored);
+        return data.size();
+    }
+    cerr << "Warning: stored feature statistics cover " << stored.count << " of " << features.size()
+         << " samples, computing them while loading (VidDisplay --rebuild-stats stores them)" << endl;
+    data.reserve(features.size());
+    for (size_t i = 0; i < features.size(); i++) {
+        data.push_back(labels[i], features[i]);
+    }
+    return data.size();
+}
 
-        if (doc["features"] && doc["features"].type() == bsoncxx::type::k_array) {
-            auto bsonArray = doc["features"].get_array().value;
-            for (auto &&val : bsonArray) {
-                if (val.type() == bsoncxx::type::k_double) {
-                    featureVector.push_back(val.get_double().value);
-                } else {
-                    cerr << "Error: Non-float value found in feature vector!" << endl;
+int DBManager::rebuildFeatureStats() {
+    for (int attempt = 0; attempt < STATS_RETRIES; attempt++) {
+        FeatureStats stats;
+        uint64_t checksum = 0;
+        try {
+            for (auto&& doc : collection.find({})) {
+                string label;
+                ObjectFeatures featureVector;
+                if (parseFeatureVector(doc, label, featureVector)) {
+                    stats.add(featureVector);
+                    checksum += sampleChecksum(label, featureVector);
                 }
             }
-        } else {
-            cerr << "Error: 'features' field missing or incorrect type!" << endl;
-            continue;
+            FeatureStats stored;
+            uint64_t storedChecksum = 0;
+            int64_t version = 0;
+            if (readFeatureStats(stored, storedChecksum, version) != 0) {
+                statsCollection.delete_one(make_document(kvp("_id", STATS_ID)));  // Malformed: replaced below
+                version = 0;
+            } else if (stored.count == stats.count && storedChecksum == checksum) {
+                return 0;
+            }
+        } catch (const exception &e) {
+            cerr << "Exception while rebuilding feature statistics: " << e.what() << endl;
+            return -1;
+        }
+        // A writer that updated the statistics in between also changed the samples: count them again
+        int stored = storeFeatureStats(stats, checksum, version);
+        if (stored != 1) {
+            if (stored == 0) cout << "Rewrote the feature statistics of " << stats.count << " samples" << endl;
+            return stored == 0 ? 1 : -1;
         }
+    }
+    cerr << "Error: feature statistics kept changing, giving up after " << STATS_RETRIES << " attempts" << endl;
+    return -1;
+}
 
-        data.emplace_back(label, featureVector);
+int DBManager::loadFeatureStats(FeatureStats& stats) {
+    uint64_t checksum = 0;
+    int64_t version = 0;
+    return readFeatureStats(stats, checksum, version);
+}
+
+// Read the statistics document; a missing document means no samples
+int DBManager::readFeatureStats(FeatureStats& stats, uint64_t& checksum, int64_t& version) {
+    stats.clear();
+    checksum = 0;
+    version = 0;
+    try {
+        auto doc = statsCollection.find_one(make_document(kvp("_id", STATS_ID)));
+        if (!doc) {
+            return 0;
+        }
+        bsoncxx::document::view view = doc->view();
+        if (!view["version"] || view["version"].type() != bsoncxx::type::k_int64 ||
+            !view["count"] || view["count"].type() != bsoncxx::type::k_int64 ||
+            !view["checksum"] || view["checksum"].type() != bsoncxx::type::k_int64 ||
+            !parseDoubles(view["mean"], stats.mean) || !parseDoubles(view["m2"], stats.m2)) {
+            cerr << "Error: malformed feature statistics document!" << endl;
+            stats.clear();
+            return -1;
+        }
+        stats.count = view["count"].get_int64().value;
+        checksum = static_cast<uint64_t>(view["checksum"].get_int64().value);
+        version = view["version"].get_int64().value;
+        return 0;
+    } catch (const exception &e) {
+        cerr << "Exception while loading feature statistics: " << e.what() << endl;
+        stats.clear();
+        return -1;
     }
-    return data.size();
 }
+
+// Write the statistics as version + 1: inserted for version 0, otherwise replacing only that version
+int DBManager::storeFeatureStats(const FeatureStats& stats, uint64_t checksum, int64_t version) {
+    try {
+        bsoncxx::builder::basic::array mean, m2;
+        for (size_t d = 0; d < FEATURE_DIMS; d++) {
+            mean.append(stats.mean[d]);
+            m2.append(stats.m2[d]);
+        }
+        bsoncxx::builder::basic::document document{};
+        document.append(
+                kvp("_id", STATS_ID),
+                kvp("version", bsoncxx::types::b_int64{version + 1}),
+                kvp("count", bsoncxx::types::b_int64{stats.count}),
+                kvp("checksum", bsoncxx::types::b_int64{static_cast<int64_t>(checksum)}),
+                kvp("mean", mean),
+                kvp("m2", m2)
+        );
+        if (version == 0) {
+            statsCollection.insert_one(document.view());  // Duplicate _id if another writer created it first
+            return 0;
+        }
+        auto filter = make_document(kvp("_id", STATS_ID), kvp("version", bsoncxx::types::b_int64{version}));
+        auto result = statsCollection.replace_one(filter.view(), document.view());
+        return result && result->matched_count() == 1 ? 0 : 1;
+    } catch (const mongocxx::operation_exception &e) {
+        if (version == 0 && e.code().value() == 11000) {  // Duplicate key
+            return 1;
+        }
+        cerr << "Exception while storing feature statistics: " << e.what() << endl;
+        return -1;
+    } catch (const exception &e) {
+        cerr << "Exception while storing feature statistics: " << e.what() << endl;
+        return -1;
+    }
+}
+
+// Compare-and-set loop: a concurrent update between the read and the store makes this one start over
+int DBManager::updateFeatureStats(const function<void(FeatureStats&, uint64_t&)>& change) {
+    for (int attempt = 0; attempt < STATS_RETRIES; attempt++) {
+        FeatureStats stats;
+        uint64_t checksum = 0;
+        int64_t version = 0;
+        if (readFeatureStats(stats, checksum, version) != 0) {
+            return -1;
+        }
+        change(stats, checksum);
+        int stored = storeFeatureStats(stats, checksum, version);
+        if (stored != 1) {
+            return stored;
+        }
+    }
+    cerr << "Error: feature statistics kept changing, giving up after " << STATS_RETRIES << " attempts" << endl;
+    return -1;
+}
+
+// Delete the samples of one label, taking each of them out of the statistics
+int DBManager::deleteLabel(const string& label) {
+    try {
+        // Deleted by _id in batches of DELETE_BATCH, which keeps the $in filter far below the BSON document
+        // limit; only the documents read here are deleted, so the statistics lose exactly these samples
+        bsoncxx::builder::basic::array ids;
+        size_t idCount = 0;
+        vector<ObjectFeatures> removed;  // Malformed documents were never in the statistics
+        uint64_t removedChecksum = 0;
+        int64_t deleted = 0;
+        bool statsUpdated = true;
+        auto deleteBatch = [&]() {
+            auto result = collection.delete_many(make_document(kvp("_id", make_document(kvp("$in", ids)))));
+            if (!result) {
+                return false;
+            }
+            deleted += result->deleted_count();
+            // Deleted either way: a failure is reported but not returned, rebuildFeatureStats repairs the statistics
+            bool deletedAll = static_cast<size_t>(result->deleted_count()) == idCount;
+            if (!removed.empty() && (!deletedAll || updateFeatureStats([&](FeatureStats& stats, uint64_t& checksum) {
+                    for (const ObjectFeatures& featureVector : removed) stats.remove(featureVector);
+                    checksum -= removedChecksum;
+                }) != 0)) {
+                statsUpdated = false;
+            }
+            ids.clear();
+            idCount = 0;
+            removed.clear();
+            removedChecksum = 0;
+            return true;
+        };
+        for (auto&& doc : collection.find(make_document(kvp("type", label)))) {
+            string docLabel;
+            ObjectFeatures featureVector;
+            ids.append(doc["_id"].get_value());
+            idCount++;
+            if (parseFeatureVector(doc, docLabel, featureVector)) {
+                removed.push_back(featureVector);
+                removedChecksum += sampleChecksum(docLabel, featureVector);
+            }
+            if (idCount == DELETE_BATCH && !deleteBatch()) {
+                cerr << "Error: Deletion failed for label: " << label << endl;
+                return -1;
+            }
+        }
+        if (idCount > 0 && !deleteBatch()) {
+            cerr << "Error: Deletion failed for label: " << label << endl;
+            return -1;
+        }
+        if (!statsUpdated) {
+            cerr << "Warning: feature statistics not updated, repair them with VidDisplay --rebuild-stats" << endl;
+        }
+        cout << "Deleted " << deleted << " '" << label << "' documents." << endl;
+        return static_cast<int>(deleted);
+    } catch (const exception &e) {
+        cerr << "Exception while deleting label " << label << ": " << e.what() << endl;
+        return -1;
+    }
+}
+
 int DBManager::deleteAll() {
     try {
         auto result = collection.delete_many({});  // Delete all documents
+        statsCollection.delete_many({});
 
         if (result) {
             cout << "Deleted " << result->deleted_count() << " documents from the collection." << endl;
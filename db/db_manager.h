@@ -11,17 +11,48 @@
 #include <mongocxx/uri.hpp>
 #include <mongocxx/database.hpp>
 #include <mongocxx/collection.hpp>
+#include <functional>
 #include <vector>
 #include <string>
+#include "../include/feature_vector.h"
 
+// Feature vectors in the "features" collection; running feature statistics (Welford) in "feature_stats",
+// updated with every write and delete so normalization never needs a pass over all samples. The statistics
+// document carries a version: an update replaces it only if the version is still the one read, so
+// concurrent writers retry instead of overwriting each other. It also keeps a checksum of the stored samples,
+// which rebuildFeatureStats compares with the samples to find statistics that missed an update.
 class DBManager {
 public:
     DBManager();
-    int writeFeatureVector(const std::string &label, const std::vector<float>& featureVector);
-    int loadFeatureVectors(std::vector<std::pair<std::string, std::vector<float>>>& data);
+    // Stores a sample and adds it to the stored statistics: -1 not stored, 0 stored, 1 stored but the
+    // statistics were not updated (rebuildFeatureStats repairs them), so never retry on 1
+    int writeFeatureVector(const std::string &label, const ObjectFeatures& featureVector);
+    // Replaces data with every stored vector with FEATURE_DIMS features and takes the stored statistics
+    // without a pass over the samples; only when they are missing or count other samples are they
+    // computed while loading. Never writes to the database. Returns data.size()
+    int loadFeatureVectors(TrainingSet& data);
+    // Maintenance: recompute the statistics and checksum from all samples and store them if they differ
+    // (samples written before the statistics existed, a failed update); -1 failure, 0 correct, 1 rewritten
+    int rebuildFeatureStats();
+    // Stored statistics of all samples (empty if none were written); -1 failure, 0 success
+    int loadFeatureStats(FeatureStats& stats);
+    // Deletes every sample of a label and removes them from the statistics; returns the number deleted
+    int deleteLabel(const std::string& label);
     int deleteAll();
 private:
+    static constexpr int STATS_RETRIES = 16;  // Compare-and-set attempts of one update
+    static constexpr size_t DELETE_BATCH = 1000;  // Documents per delete of deleteLabel
+
+    // Statistics, sample checksum and version of the stored document (version 0: no document);
+    // -1 failure, 0 success
+    int readFeatureStats(FeatureStats& stats, uint64_t& checksum, int64_t& version);
+    // Store stats and checksum as the successor of version; -1 failure, 0 success, 1 another writer came first
+    int storeFeatureStats(const FeatureStats& stats, uint64_t checksum, int64_t version);
+    // Read, change and store the statistics until no other writer came in between; -1 failure, 0 success
+    int updateFeatureStats(const std::function<void(FeatureStats&, uint64_t&)>& change);
+
     mongocxx::client client;
     mongocxx::collection collection;
+    mongocxx::collection statsCollection;
 };
 #endif //PROJ3_DB_MANAGER_H
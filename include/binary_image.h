@@ -0,0 +1,106 @@
+/*
+ * Authors: Yuyang Tian and Arun Mekkad
+ * Date: 2025/2/21
+ * Purpose: Header file for bit-packed binary images (threshold, morphology, run labeling)
+ */
+#ifndef PROJ3_BINARY_IMAGE_H
+#define PROJ3_BINARY_IMAGE_H
+
+#include <opencv2/opencv.hpp>
+#include <cstdint>
+#include <vector>
+#include "image_process.h"
+
+using namespace cv;
+using namespace std;
+
+// Binary image packed 64 pixels per word. Pixel x of a row is bit (x % 64) of word x / 64,
+// bits past the last column are always 0.
+struct PackedBinaryImage {
+    int rows = 0;
+    int cols = 0;
+    int wordsPerRow = 0;
+    vector<uint64_t> words;
+
+    void create(int newRows, int newCols) {
+        rows = newRows;
+        cols = newCols;
+        wordsPerRow = (newCols + 63) / 64;
+        words.assign(static_cast<size_t>(rows) * wordsPerRow, 0);
+    }
+    bool empty() const { return words.empty(); }
+    uint64_t* row(int y) { return words.data() + static_cast<size_t>(y) * wordsPerRow; }
+    const uint64_t* row(int y) const { return words.data() + static_cast<size_t>(y) * wordsPerRow; }
+    // Valid bits of the last word in a row
+    uint64_t tailMask() const { return (cols % 64) ? ((uint64_t(1) << (cols % 64)) - 1) : ~uint64_t(0); }
+};
+
+// Scratch buffers of packed morphology, reused between frames so filtering does not allocate
+struct PackedMorphScratch {
+    vector<uint64_t> padded, backward, forward, shifted;  // One row each, horizontal pass
+    PackedBinaryImage result;    // Filtered image, swapped into the destination
+    PackedBinaryImage above;     // Upward half of the vertical pass
+    PackedBinaryImage current;   // Intermediate result of a sequence
+};
+
+struct RegionStats;
+
+// Horizontal run of foreground pixels [start, end) in one row
+struct PixelRun {
+    int row;
+    int start;
+    int end;
+    int label;
+};
+
+// Scratch buffers of run labeling, reused between frames so labeling does not allocate
+struct LabelScratch {
+    vector<PixelRun> runs;
+    vector<int> parent;
+    vector<int> regionSize;
+    vector<uchar> touchesBoundary;  // Flat bitmap indexed by root run
+    vector<int> relabel;
+};
+
+// Pack a 0 / non-zero CV_8UC1 image
+int packBinary(const Mat& src, PackedBinaryImage& dst);
+
+// Unpack into a 0/255 CV_8UC1 image (for display)
+int unpackBinary(const PackedBinaryImage& src, Mat& dst);
+
+// Threshold a CV_8UC1 image straight into packed form, returns the threshold used (-1 on failure)
+float thresholdPacked(const Mat& src, PackedBinaryImage& dst, float initialThreshold = 128.0f,
+                      ThresholdMethod method = ThresholdMethod::ISODATA);
+
+// Word-parallel rectangular erosion / dilation, pixels outside the image are ignored
+int erodePacked(const PackedBinaryImage& src, PackedBinaryImage& dst, Size kernel);
+int dilatePacked(const PackedBinaryImage& src, PackedBinaryImage& dst, Size kernel);
+int erodePacked(const PackedBinaryImage& src, PackedBinaryImage& dst, Size kernel, PackedMorphScratch& scratch);
+int dilatePacked(const PackedBinaryImage& src, PackedBinaryImage& dst, Size kernel, PackedMorphScratch& scratch);
+
+// Same steps as applyMorphologicalFiltering on a packed image
+void applyMorphologicalFilteringPacked(const PackedBinaryImage& src, PackedBinaryImage& dst,
+                                       const vector<MorphStep>& steps);
+
+// Same as above with caller-owned scratch buffers (no allocation once they are warm)
+void applyMorphologicalFilteringPacked(const PackedBinaryImage& src, PackedBinaryImage& dst,
+                                       const vector<MorphStep>& steps, PackedMorphScratch& scratch);
+
+// Collect the foreground runs of every row, in raster order
+void extractRuns(const PackedBinaryImage& binary, vector<PixelRun>& runs);
+
+// Label runs (raster order) into regions, drop small / boundary regions, write the region map.
+// Regions are numbered 1..N in raster order of their first pixel. When stats is given,
+// (*stats)[i] receives the statistics of region i + 1.
+// Working arrays come from scratch when given.
+int labelRuns(vector<PixelRun>& runs, Size size, Mat& regionMap, int minRegionSize,
+              bool eightConnectivity, bool removeBoundary, vector<RegionStats>* stats = nullptr,
+              LabelScratch* scratch = nullptr);
+
+// Run-based segmentation of a packed image, same region set as twoPassSegmentation4conn
+int segmentPacked4conn(const PackedBinaryImage& binary, Mat& regionMap, int minRegionSize = 50);
+
+// Run-based segmentation of a packed image, same region set as twoPassSegmentation8conn
+int segmentPacked8conn(const PackedBinaryImage& binary, Mat& regionMap, int minRegionSize = 50);
+
+#endif //PROJ3_BINARY_IMAGE_H
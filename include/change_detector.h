@@ -0,0 +1,46 @@
+/*
+ * Authors: Yuyang Tian and Arun Mekkad
+ * Date: 2025/2/24
+ * Purpose: Header file for the frame-change detector that gates the pipeline on static scenes
+ */
+#ifndef PROJ3_CHANGE_DETECTOR_H
+#define PROJ3_CHANGE_DETECTOR_H
+
+#include <opencv2/opencv.hpp>
+
+using namespace cv;
+using namespace std;
+
+// Compares a downsampled gray copy of each frame with the last frame that went through the pipeline.
+// A frame counts as changed when more than changedFraction of the downsampled pixels differ by more
+// than pixelThreshold gray levels. Static frames never replace the reference, so slow drift adds up.
+class ChangeDetector {
+public:
+    ChangeDetector(int downsample = 8, int pixelThreshold = 12, float changedFraction = 0.005f,
+                   int maxSkippedFrames = 300);
+
+    // true if the frame has to be processed; static frames are counted as skipped
+    bool hasChanged(const Mat& frame);
+
+    // Sensitivity: gray level difference of one pixel and the fraction of pixels that must differ
+    void setSensitivity(int newPixelThreshold, float newChangedFraction);
+
+    // Force the next frame through the pipeline (e.g. after a mode change)
+    void reset();
+
+    int framesSeen() const { return seen; }
+    int framesSkipped() const { return skipped; }
+
+private:
+    int downsample;
+    int pixelThreshold;
+    float changedFraction;
+    int maxSkippedFrames;  // Refresh after this many static frames in a row (0 = never)
+    int seen = 0;
+    int skipped = 0;
+    int skippedInRow = 0;
+    Mat reference;  // Downsampled gray copy of the last processed frame
+    Mat small, gray, diff;  // Scratch buffers reused between frames
+};
+
+#endif //PROJ3_CHANGE_DETECTOR_H
@@ -8,9 +8,12 @@
 #define PROJ3_CLASSIFIER_H
 #include <iostream>
 #include <vector>
+#include "feature_vector.h"
 using namespace std;
-vector<float> computeFeatureStdDevs(const vector<pair<string, vector<float>>>& dbFeatures);
+ObjectFeatures computeFeatureStdDevs(const TrainingSet& dbFeatures);
 // Nearest neighbor Classifiers
-string classifyByNN(const vector<pair<string, vector<float>>>& dbFeatures, const vector<float>& features);
-string classifyByDecisionTree(const vector<float>& features);
+string classifyByNN(const TrainingSet& dbFeatures, const ObjectFeatures& features);
+// Nearest neighbor for every object of a frame, the feature scaling is computed once per batch
+vector<string> classifyBatchByNN(const TrainingSet& dbFeatures, const vector<ObjectFeatures>& batch);
+string classifyByDecisionTree(const ObjectFeatures& features);
 #endif //PROJ3_CLASSIFIER_H
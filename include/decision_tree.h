@@ -0,0 +1,89 @@
+/*
+ * Authors: Yuyang Tian and Arun Mekkad
+ * Date: 2025/3/5
+ * Purpose: Header file for the CART decision tree trainer and flattened tree inference
+ */
+#ifndef PROJ3_DECISION_TREE_H
+#define PROJ3_DECISION_TREE_H
+
+#include <opencv2/core.hpp>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "feature_vector.h"
+
+using namespace cv;
+using namespace std;
+
+// Node of a flat tree array; DecisionTree and RandomForest walk it with node = next + (feature > threshold)
+struct TreeNode {
+    float threshold;  // Leaf: +infinity
+    int32_t feature;  // Leaf: 0
+    int32_t next;     // Left child (right child is next + 1); leaf: itself
+};
+
+// Settings for growing one CART tree
+struct TreeOptions {
+    int maxDepth = 3;
+    int minSamplesLeaf = 1;
+    int featuresPerSplit = 0;  // Features drawn at random for each split (random forest), 0 = all
+    uint32_t seed = 0;         // Seed of the feature draws
+};
+
+/**
+ * @brief Grow one CART tree into a flat node array (breadth first, children side by side, node 0 is the root).
+ * @param data labeled feature vectors
+ * @param sampleLabels label ID of each entry of data
+ * @param classes number of label IDs
+ * @param samples indices into data to train on, repeats allowed (e.g. a bootstrap sample)
+ * @param options depth, leaf size and feature sampling
+ * @param nodes output node array
+ * @param leafLabels output label ID per node, -1 for inner nodes
+ * @return depth of the tree
+ */
+int growTree(const TrainingSet& data, const vector<int>& sampleLabels, int classes,
+             vector<int> samples, const TreeOptions& options, vector<TreeNode>& nodes, vector<int32_t>& leafLabels);
+
+// Decision tree trained in-process with CART (Gini impurity, thresholds halfway between neighboring
+// values, "go left if feature <= threshold" like sklearn). The tree is stored as a flat node array in
+// breadth-first order with both children next to each other, and every leaf loops back to itself, so a
+// prediction is exactly depth() branch-free steps: node = next + (feature > threshold).
+class DecisionTree {
+public:
+    /**
+     * @brief Train on labeled feature vectors, replacing the current tree.
+     * @param maxDepth Maximum depth (the sklearn tree of src/decision_tree.py used 3).
+     * @param minSamplesLeaf Minimum training samples in each leaf.
+     * @return -1 on invalid data, 0 on success
+     */
+    int train(const TrainingSet& data, int maxDepth = 3, int minSamplesLeaf = 1);
+
+    bool empty() const { return nodes.empty(); }
+    int depth() const { return treeDepth; }
+    size_t nodeCount() const { return nodes.size(); }
+    static constexpr size_t dimensions() { return FEATURE_DIMS; }
+
+    // Label ID of the leaf reached by features, -1 if the tree is empty
+    int predict(const ObjectFeatures& features) const;
+
+    // Name of a label ID, "Unknown" for -1
+    const string& labelName(int id) const;
+
+    string classify(const ObjectFeatures& features) const;
+
+    // Label IDs of every row of features (CV_32FC1); rows are walked down the tree together
+    void predictBatch(const Mat& features, vector<int>& labelIds) const;
+    vector<string> classifyBatch(const vector<ObjectFeatures>& batch) const;
+
+    // Compact binary model ("P3DT"); -1 failure, 0 success
+    int save(const string& path) const;
+    int load(const string& path);
+
+private:
+    vector<TreeNode> nodes;
+    vector<int32_t> leafLabels;  // Label ID per node, -1 for inner nodes
+    vector<string> labels;       // Label ID -> name
+    int treeDepth = 0;
+};
+
+#endif //PROJ3_DECISION_TREE_H
@@ -9,6 +9,7 @@
 using namespace std;
 
 
-void evaluateConfusionMatrix(int classifierType);
+// NN votes among the k nearest training samples (k = 1: plain nearest neighbor)
+void evaluateConfusionMatrix(int classifierType, int k = 1);
 
 #endif //PROJ3_EVALUATE_H
@@ -0,0 +1,148 @@
+/*
+ * Authors: Yuyang Tian and Arun Mekkad
+ * Date: 2025/3/7
+ * Purpose: Header file for fixed-size feature vectors and the contiguous training set
+ */
+#ifndef PROJ3_FEATURE_VECTOR_H
+#define PROJ3_FEATURE_VECTOR_H
+
+#include <opencv2/core.hpp>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace cv;
+using namespace std;
+
+// Region features: 7 Hu moments, aspect ratio, perimeter / area, percent filled
+constexpr size_t FEATURE_DIMS = 10;
+
+// Feature vector with a compile-time size. It is stored inline (no heap allocation), loops over
+// size() unroll. It keeps the natural float alignment: padding a 10-feature vector to a cache line would
+// add 24 dead bytes to every sample of the training set and of every index copying it, while the
+// distance loops only need unaligned loads.
+template <size_t N>
+struct FeatureVector {
+    array<float, N> values{};
+
+    static constexpr size_t size() { return N; }
+    float& operator[](size_t i) { return values[i]; }
+    const float& operator[](size_t i) const { return values[i]; }
+    float* data() { return values.data(); }
+    const float* data() const { return values.data(); }
+    float* begin() { return values.data(); }
+    float* end() { return values.data() + N; }
+    const float* begin() const { return values.data(); }
+    const float* end() const { return values.data() + N; }
+    bool operator==(const FeatureVector& other) const { return values == other.values; }
+    bool operator!=(const FeatureVector& other) const { return values != other.values; }
+};
+
+using ObjectFeatures = FeatureVector<FEATURE_DIMS>;
+static_assert(sizeof(ObjectFeatures) == FEATURE_DIMS * sizeof(float), "feature vectors are stored without padding");
+
+/**
+ * @brief Rows of a batch as a CV_32FC1 matrix header over the vectors themselves (no copy);
+ *        the vectors are unpadded, so the matrix is continuous.
+ * @param batch feature vectors, must outlive the returned matrix
+ * @return batch.size() x N matrix, empty for an empty batch
+ */
+template <size_t N>
+inline Mat featureMatrix(const vector<FeatureVector<N>>& batch) {
+    if (batch.empty()) {
+        return Mat();
+    }
+    return Mat(static_cast<int>(batch.size()), static_cast<int>(N), CV_32FC1,
+               const_cast<float*>(batch[0].data()), sizeof(FeatureVector<N>));
+}
+
+// Running mean and variance of every feature (Welford), kept in double so large offsets do not cancel.
+// A sample is added or removed in O(N), independent of how many samples there are.
+template <size_t N>
+struct RunningStats {
+    int64_t count = 0;
+    array<double, N> mean{};
+    array<double, N> m2{};  // Sum of squared deviations from the mean
+
+    void clear() { *this = RunningStats(); }
+
+    void add(const FeatureVector<N>& sample) {
+        count++;
+        for (size_t d = 0; d < N; d++) {
+            double delta = sample[d] - mean[d];
+            mean[d] += delta / count;
+            m2[d] += delta * (sample[d] - mean[d]);
+        }
+    }
+
+    // Inverse of add; the sample must have been added before
+    void remove(const FeatureVector<N>& sample) {
+        if (count <= 1) {
+            clear();
+            return;
+        }
+        count--;
+        for (size_t d = 0; d < N; d++) {
+            double delta = sample[d] - mean[d];
+            mean[d] -= delta / count;
+            m2[d] = max(0.0, m2[d] - delta * (sample[d] - mean[d]));
+        }
+    }
+
+    // Population standard deviation of every feature, zero without samples
+    FeatureVector<N> stdDevs() const {
+        FeatureVector<N> result;
+        for (size_t d = 0; count > 0 && d < N; d++) {
+            result[d] = static_cast<float>(sqrt(m2[d] / count));
+        }
+        return result;
+    }
+};
+
+using FeatureStats = RunningStats<FEATURE_DIMS>;
+
+// Labeled training data: labels and features in parallel arrays, all features in one contiguous block.
+// Samples are only added through push_back, so stats always covers exactly the stored samples.
+template <size_t N>
+class FeatureSet {
+public:
+    const vector<string>& labels() const { return labelData; }
+    const vector<FeatureVector<N>>& features() const { return featureData; }
+    const RunningStats<N>& stats() const { return featureStats; }
+
+    size_t size() const { return featureData.size(); }
+    bool empty() const { return featureData.empty(); }
+    void clear() {
+        labelData.clear();
+        featureData.clear();
+        featureStats.clear();
+    }
+    void reserve(size_t n) {
+        labelData.reserve(n);
+        featureData.reserve(n);
+    }
+    void push_back(const string& label, const FeatureVector<N>& values) {
+        labelData.push_back(label);
+        featureData.push_back(values);
+        featureStats.add(values);
+    }
+    // Replace the contents with samples whose statistics are kept elsewhere (the database's running
+    // statistics), so they are not added up again; stored must count every sample
+    void assign(vector<string> labels, vector<FeatureVector<N>> features, const RunningStats<N>& stored) {
+        CV_Assert(labels.size() == features.size() && stored.count == static_cast<int64_t>(features.size()));
+        labelData = std::move(labels);
+        featureData = std::move(features);
+        featureStats = stored;
+    }
+
+private:
+    vector<string> labelData;
+    vector<FeatureVector<N>> featureData;
+    RunningStats<N> featureStats;
+};
+
+using TrainingSet = FeatureSet<FEATURE_DIMS>;
+
+#endif //PROJ3_FEATURE_VECTOR_H
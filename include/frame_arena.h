@@ -0,0 +1,52 @@
+/*
+ * Authors: Yuyang Tian and Arun Mekkad
+ * Date: 2025/2/26
+ * Purpose: Scratch memory of one processing pipeline, sized once and reused every frame
+ */
+#ifndef PROJ3_FRAME_ARENA_H
+#define PROJ3_FRAME_ARENA_H
+
+#include <opencv2/opencv.hpp>
+#include "image_process.h"
+#include "binary_image.h"
+#include "obb_feature_extraction.h"
+
+using namespace cv;
+using namespace std;
+
+// All scratch buffers of threshold -> morphology -> labeling -> features. Buffers only grow, so
+// after the first frames (warm-up) a steady stream of frames of the same size allocates nothing.
+struct FrameArena {
+    MorphScratch morph;
+    PackedMorphScratch packedMorph;
+    LabelScratch labels;
+    RegionGeometry geometry;
+
+    // Size the buffers for frames of frameSize up front
+    void reserve(Size frameSize) {
+        size_t rows = frameSize.height, cols = frameSize.width;
+        morph.horizontal.create(frameSize, CV_8UC1);
+        morph.ping.create(frameSize, CV_8UC1);
+        morph.pong.create(frameSize, CV_8UC1);
+        morph.rowBuffer.reserve(3 * 2 * cols);           // Kernels up to the frame width
+        morph.columnBuffer.reserve(2 * 2 * rows * cols); // Kernels up to the frame height
+        morph.identityRow.reserve(cols);
+        size_t packedRow = (cols + 63) / 64;
+        for (vector<uint64_t>* row : {&packedMorph.padded, &packedMorph.backward,
+                                      &packedMorph.forward, &packedMorph.shifted}) {
+            row->reserve(packedRow);
+        }
+        packedMorph.result.create(frameSize.height, frameSize.width);
+        packedMorph.above.create(frameSize.height, frameSize.width);
+        packedMorph.current.create(frameSize.height, frameSize.width);
+        size_t runs = rows * 16;  // Typical scene; grows during warm-up if needed
+        labels.runs.reserve(runs);
+        labels.parent.reserve(runs);
+        labels.regionSize.reserve(runs);
+        labels.touchesBoundary.reserve(runs);
+        labels.relabel.reserve(runs);
+        geometry.maskStorage.reserve(rows * cols);
+    }
+};
+
+#endif //PROJ3_FRAME_ARENA_H
@@ -0,0 +1,62 @@
+/*
+ * Authors: Yuyang Tian and Arun Mekkad
+ * Date: 2025/2/25
+ * Purpose: Lock-free single-producer / single-consumer hand-off of the latest frame between pipeline stages
+ */
+#ifndef PROJ3_FRAME_RING_H
+#define PROJ3_FRAME_RING_H
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+
+using namespace std;
+
+// Triple buffer: the producer owns one slot, the consumer owns one slot and the third is shared. Items are
+// swapped in and out instead of copied, so large buffers (cv::Mat) cycle through without reallocation.
+// Pushing never blocks: a newer item replaces an unread one (latest frame wins), and the slot the
+// consumer is reading is never written by the producer.
+template <typename T>
+class TripleBuffer {
+public:
+    /**
+     * @brief Producer side: publish item, item receives a free buffer back.
+     * @return false if an unread item was replaced (dropped)
+     */
+    bool push(T& item) {
+        swap(slots[back], item);
+        unsigned previous = shared.exchange(back | FRESH, memory_order_acq_rel);
+        back = previous & INDEX;
+        return !(previous & FRESH);
+    }
+
+    /**
+     * @brief Consumer side: take the newest item.
+     * @param item Receives the newest item, its previous contents go back into the buffer.
+     * @return false if nothing new was pushed since the last call
+     */
+    bool popLatest(T& item) {
+        if (!(shared.load(memory_order_acquire) & FRESH)) {
+            return false;
+        }
+        front = shared.exchange(front, memory_order_acq_rel) & INDEX;
+        swap(item, slots[front]);
+        return true;
+    }
+
+    // Number of unread items, 0 or 1 (approximate while the other side is running)
+    size_t size() const {
+        return (shared.load(memory_order_acquire) & FRESH) ? 1 : 0;
+    }
+
+private:
+    static constexpr unsigned INDEX = 3;  // Slot index bits of shared
+    static constexpr unsigned FRESH = 4;  // Set when the shared slot holds an unread item
+
+    T slots[3];
+    alignas(64) unsigned back = 0;         // Producer's slot
+    alignas(64) unsigned front = 1;        // Consumer's slot
+    alignas(64) atomic<unsigned> shared{2};  // Shared slot index and FRESH flag
+};
+
+#endif //PROJ3_FRAME_RING_H
@@ -0,0 +1,88 @@
+/*
+ * Authors: Yuyang Tian and Arun Mekkad
+ * Date: 2025/3/4
+ * Purpose: Header file for the approximate (HNSW) nearest neighbor index
+ */
+#ifndef PROJ3_HNSW_INDEX_H
+#define PROJ3_HNSW_INDEX_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "feature_vector.h"
+#include "normalized_index.h"
+
+using namespace std;
+
+// Approximate nearest neighbor search for very large training sets: a hierarchical navigable small
+// world graph (Malkov & Yashunin) over the scaled feature space (features / stdev, as in classifyByNN).
+// Queries walk down the sparse upper layers greedily and finish with a beam of width efSearch on the
+// dense bottom layer; a larger efSearch raises recall and latency. The graph is built once and can be
+// saved, so stations do not rebuild it at startup.
+class HNSWIndex : public NormalizedIndex<HNSWIndex> {
+public:
+    /**
+     * @brief Normalize the training set and build the graph (single threaded).
+     * @param M Links per node on the upper layers, 2 * M on the bottom layer.
+     * @param efConstruction Beam width while inserting, higher builds a better graph more slowly.
+     */
+    void build(const TrainingSet& dbFeatures, int M = 16, int efConstruction = 100);
+
+    // Beam width of queries (at least 1)
+    void setEfSearch(int ef);
+    int efSearch() const { return ef; }
+
+    bool empty() const { return count == 0; }
+    size_t size() const { return count; }
+    static constexpr size_t dimensions() { return FEATURE_DIMS; }
+
+    // Database position of the (approximately) nearest entry, -1 if empty; distance receives its distance
+    int nearestEntry(const ObjectFeatures& features, float* distance = nullptr) const;
+
+    // Label ID of the nearest entry within MAX_DISTANCE, -1 if none
+    int nearest(const ObjectFeatures& features, float* distance = nullptr) const;
+
+    // Hash of the entry count, labels and features, identifies the training set a graph was built from
+    static uint64_t fingerprint(const TrainingSet& dbFeatures);
+
+    // Binary file with the training set fingerprint, scaling, vectors, labels and graph; -1 failure, 0 success
+    int save(const string& path) const;
+
+    /**
+     * @brief Load a graph written by save(); the current index is kept if the file is invalid or was
+     *        built from other training data.
+     * @param expectedFingerprint fingerprint() of the training data the graph must belong to
+     */
+    int load(const string& path, uint64_t expectedFingerprint);
+
+private:
+    typedef pair<float, int> Candidate;  // Squared distance, node
+    static constexpr int MAX_M = 1024;      // Largest link count accepted from a file
+    static constexpr int MAX_LEVEL = 64;    // Highest layer accepted from a file
+
+    bool validGraph(size_t labelCount) const;
+
+    static float distance(const ObjectFeatures& a, const ObjectFeatures& b);
+    const ObjectFeatures& point(int node) const { return points[node]; }
+    int* links(int node, int level);
+    const int* links(int node, int level) const;
+    int maxLinks(int level) const { return level == 0 ? 2 * M : M; }
+    int greedyClosest(const ObjectFeatures& query, int entry, int level) const;
+    void searchLayer(const ObjectFeatures& query, int entry, int beam, int level, vector<Candidate>& result) const;
+    void selectNeighbors(vector<Candidate>& candidates, int limit) const;
+    void insert(int node, int level);
+
+    size_t count = 0;
+    int M = 16;
+    int efConstruction = 100;
+    int ef = 32;
+    int maxLevel = -1;
+    int entryPoint = -1;
+    uint64_t sourceFingerprint = 0;  // fingerprint() of the training set
+    vector<ObjectFeatures> points;  // Normalized features
+    vector<int> levels;           // Top layer of every node
+    vector<int> bottomLinks;      // count x (1 + 2M): link count, then links
+    vector<vector<int>> upperLinks;  // Per node: layers 1..level, each (1 + M)
+};
+
+#endif //PROJ3_HNSW_INDEX_H
@@ -14,18 +14,82 @@ using namespace std;
 // Convert BGR image to YCbCr
 void bgr_to_hsv(const Mat& src, Mat& dst);
 
-// threshold image to separate foreground and background
-void threshold(const Mat& src, Mat& dst);
+// Fused BGR -> HSV value channel (CV_8UC1), same values as channel 2 of bgr_to_hsv
+void bgr_to_value(const Mat& src, Mat& dst);
 
-// Clean up your thresholded image with morphological filtering
+// Threshold selection methods
+enum class ThresholdMethod {
+    ISODATA,
+    OTSU,
+};
+
+// Compute the 256-bin intensity histogram of a CV_8UC1 image
+void computeHistogram(const Mat& src, int hist[256]);
+
+// ISODATA (2-means) threshold on a histogram, starting from initialThreshold
+float isodataThreshold(const int hist[256], float initialThreshold = 128.0f);
+
+// Otsu threshold on a histogram
+float otsuThreshold(const int hist[256]);
+
+// threshold image to separate foreground and background, returns the threshold used (-1 on failure)
+float threshold(const Mat& src, Mat& dst, float initialThreshold = 128.0f,
+                ThresholdMethod method = ThresholdMethod::ISODATA);
+
+// Morphological operations available in a filtering sequence
+enum class MorphOp {
+    ERODE,
+    DILATE,
+    OPEN,   // erode then dilate
+    CLOSE,  // dilate then erode
+};
+
+// One step of a morphological filtering sequence with a rectangular kernel
+struct MorphStep {
+    MorphOp op;
+    Size kernel;
+};
+
+// Scratch buffers of the morphological filters, reused between frames so filtering does not allocate
+struct MorphScratch {
+    vector<uchar> rowBuffer;     // Padded row, prefix and suffix extrema of the horizontal pass
+    vector<uchar> columnBuffer;  // Prefix and suffix extrema rows of the vertical pass
+    vector<uchar> identityRow;
+    Mat horizontal;              // Result of the horizontal pass
+    Mat ping, pong;              // Intermediate results of a sequence
+};
+
+// Rectangular erosion / dilation (van Herk/Gil-Werman), cost per pixel does not depend on kernel size
+int erodeRect(const Mat& src, Mat& dst, Size kernel);
+int dilateRect(const Mat& src, Mat& dst, Size kernel);
+int erodeRect(const Mat& src, Mat& dst, Size kernel, MorphScratch& scratch);
+int dilateRect(const Mat& src, Mat& dst, Size kernel, MorphScratch& scratch);
+
+// Clean up your thresholded image with morphological filtering (3x3 erosion)
 void applyMorphologicalFiltering(const Mat& src, Mat& dst);
 
+// Clean up your thresholded image with a runtime-configured sequence of morphological steps
+void applyMorphologicalFiltering(const Mat& src, Mat& dst, const vector<MorphStep>& steps);
+
+// Same as above with caller-owned scratch buffers (no allocation once they are warm)
+void applyMorphologicalFiltering(const Mat& src, Mat& dst, const vector<MorphStep>& steps, MorphScratch& scratch);
+
+// Parse a sequence such as "open:7x7,close:15" into morphological steps
+int parseMorphSequence(const string& spec, vector<MorphStep>& steps);
+
 // Two-pass segmentation the image into regions ignoring area smaller than minRegionSize, with 4-connectivity
 int twoPassSegmentation4conn(const Mat& binaryImage, Mat& regionMap, int minRegionSize = 50);
 
 // Two-pass segmentation the image into regions ignoring area smaller than minRegionSize, with 8-connectivity
 int twoPassSegmentation8conn(const Mat& binaryImage, Mat& regionMap, int minRegionSize = 50);
 
+// Strip-parallel segmentation with 4-connectivity, same region set as twoPassSegmentation4conn.
+// numStrips <= 0 uses one strip per OpenCV thread.
+int parallelSegmentation4conn(const Mat& binaryImage, Mat& regionMap, int minRegionSize = 50, int numStrips = 0);
+
+// Strip-parallel segmentation with 8-connectivity, regions touching the image border are removed
+int parallelSegmentation8conn(const Mat& binaryImage, Mat& regionMap, int minRegionSize = 50, int numStrips = 0);
+
 // Helper function to visualize the segmentation result
 int colorizeRegions(const cv::Mat& labelMap, Mat& colorImage);
 
@@ -0,0 +1,55 @@
+/*
+ * Authors: Yuyang Tian and Arun Mekkad
+ * Date: 2025/3/3
+ * Purpose: Header file for the exact k-d tree nearest neighbor index
+ */
+#ifndef PROJ3_KD_TREE_H
+#define PROJ3_KD_TREE_H
+
+#include <string>
+#include <vector>
+#include "feature_vector.h"
+#include "normalized_index.h"
+
+using namespace std;
+
+// Exact nearest neighbor search over the scaled feature space (features / stdev, as in classifyByNN).
+// Nodes split at the median of their widest dimension and are stored in one array; leaves keep up to
+// LEAF_SIZE entries whose features are contiguous, so a query visits O(log n) nodes on well spread data.
+class KDTreeIndex : public NormalizedIndex<KDTreeIndex> {
+public:
+    static constexpr int LEAF_SIZE = 16;
+
+    // Normalize the training set (e.g. from DBManager::loadFeatureVectors) and build the tree
+    void build(const TrainingSet& dbFeatures);
+
+    bool empty() const { return count == 0; }
+    size_t size() const { return count; }
+    static constexpr size_t dimensions() { return FEATURE_DIMS; }
+    int depth() const { return treeDepth; }
+
+    // Label ID of the nearest entry within MAX_DISTANCE, -1 if none; distance receives its distance
+    int nearest(const ObjectFeatures& features, float* distance = nullptr) const;
+
+private:
+    struct Node {
+        int splitDim;    // -1 for a leaf
+        float splitValue;
+        int left, right; // Children (inner node) or [begin, end) entry range (leaf)
+    };
+    struct Match {
+        float distance;  // Squared
+        int entry;       // Original database position, breaks ties like a linear scan
+    };
+
+    int buildNode(int begin, int end, int level);
+    void search(int nodeIndex, const ObjectFeatures& query, Match& best) const;
+
+    size_t count = 0;
+    int treeDepth = 0;
+    vector<ObjectFeatures> points;  // Normalized features in tree order
+    vector<int> order;          // Tree position -> database position
+    vector<Node> nodes;
+};
+
+#endif //PROJ3_KD_TREE_H
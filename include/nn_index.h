@@ -0,0 +1,68 @@
+/*
+ * Authors: Yuyang Tian and Arun Mekkad
+ * Date: 2025/3/2
+ * Purpose: Header file for the normalized nearest neighbor index
+ */
+#ifndef PROJ3_NN_INDEX_H
+#define PROJ3_NN_INDEX_H
+
+#include <opencv2/core.hpp>
+#include <string>
+#include <vector>
+#include "feature_vector.h"
+#include "normalized_index.h"
+
+using namespace cv;
+using namespace std;
+
+// One neighbor of a k-NN query
+struct Neighbor {
+    int entry;       // Position in the training data
+    float distance;  // Scaled Euclidean distance
+};
+
+// k nearest neighbors of one query and their vote
+struct KNNResult {
+    vector<Neighbor> neighbors;  // Nearest first
+    int label = -1;              // Majority label ID, -1 for "Unknown"
+    float confidence = 0.0f;     // Share of the neighbor votes that went to label
+};
+
+// Training set for nearest neighbor search, built once and queried every frame.
+// Features are scaled by 1 / stdev at build time and stored feature-major (struct of arrays):
+// feature d of entry i is columns[d * stride + i], stride a multiple of the widest SIMD register,
+// padding entries far away from any query.
+class NNIndex : public NormalizedIndex<NNIndex> {
+public:
+    using NormalizedIndex<NNIndex>::classifyBatch;
+
+    // Normalize and store the training set, replacing the previous one
+    void build(const TrainingSet& dbFeatures);
+
+    bool empty() const { return count == 0; }
+    size_t size() const { return count; }
+    static constexpr size_t dimensions() { return FEATURE_DIMS; }
+
+    // Bytes held by the index: normalized columns, norms and labels
+    size_t memoryBytes() const;
+
+    // Label ID of the nearest entry within MAX_DISTANCE, -1 if none; distance receives its distance
+    int nearest(const ObjectFeatures& features, float* distance = nullptr) const;
+
+    // k nearest neighbors of every row of queries (CV_32FC1, one feature vector per row) and a majority
+    // vote; neighbors beyond MAX_DISTANCE vote "Unknown", ties go to the label with the nearer neighbor.
+    // Returns -1 on invalid input, 0 on success
+    int knnBatch(const Mat& queries, int k, vector<KNNResult>& results) const;
+    int knnBatch(const vector<ObjectFeatures>& queries, int k, vector<KNNResult>& results) const;
+
+    // Voted labels of knnBatch
+    vector<string> classifyBatch(const vector<ObjectFeatures>& batch, int k) const;
+
+private:
+    size_t count = 0;
+    size_t stride = 0;
+    vector<float> columns;     // dims x stride, normalized
+    vector<float> norms;       // Squared norm of every normalized entry (padding included)
+};
+
+#endif //PROJ3_NN_INDEX_H
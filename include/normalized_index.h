@@ -0,0 +1,94 @@
+/*
+ * Authors: Yuyang Tian and Arun Mekkad
+ * Date: 2025/3/9
+ * Purpose: Header file for the label table and feature scaling shared by the nearest neighbor indexes
+ */
+#ifndef PROJ3_NORMALIZED_INDEX_H
+#define PROJ3_NORMALIZED_INDEX_H
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "feature_vector.h"
+
+using namespace std;
+
+// Label names interned as integer IDs in order of first appearance
+class LabelTable {
+public:
+    static const string UNKNOWN;  // Name of label ID -1
+
+    void clear();
+
+    // ID of name, added if it is new
+    int intern(const string& name);
+
+    // Name of a label ID, UNKNOWN if out of range
+    const string& name(int id) const;
+
+    size_t size() const { return names.size(); }
+    const vector<string>& all() const { return names; }
+
+    // Approximate bytes held by the names and the lookup table
+    size_t memoryBytes() const;
+
+private:
+    vector<string> names;          // Label ID -> name
+    unordered_map<string, int> ids;  // Name -> label ID
+};
+
+// 1 / stdev of every feature: the scaling of classifyByNN (population stdev, + 1e-6)
+ObjectFeatures featureScale(const TrainingSet& dbFeatures);
+
+// Training set state shared by the nearest neighbor indexes (NNIndex, KDTreeIndex, HNSWIndex,
+// QuantizedIndex): the 1 / stdev scaling, the label ID of every entry and the "Unknown" cutoff.
+// Index derives from NormalizedIndex<Index> and provides
+// int nearest(const ObjectFeatures& features, float* distance) const, returning a label ID or -1.
+template <typename Index>
+class NormalizedIndex {
+public:
+    static constexpr float MAX_DISTANCE = 5.0f;  // Farther matches are "Unknown"
+
+    // Name of a label ID, "Unknown" for -1
+    const string& labelName(int id) const { return labels.name(id); }
+
+    // Nearest label, same result as classifyByNN on the training set (approximate for HNSWIndex)
+    string classify(const ObjectFeatures& features) const {
+        return labelName(static_cast<const Index*>(this)->nearest(features, nullptr));
+    }
+
+    vector<string> classifyBatch(const vector<ObjectFeatures>& batch) const {
+        vector<string> result;
+        result.reserve(batch.size());
+        for (const ObjectFeatures& features : batch) {
+            result.push_back(classify(features));
+        }
+        return result;
+    }
+
+protected:
+    // Scaling and label IDs of a new training set, replacing the previous ones
+    void normalize(const TrainingSet& dbFeatures) {
+        scale = featureScale(dbFeatures);
+        labels.clear();
+        entryLabels.resize(dbFeatures.size());
+        for (size_t i = 0; i < dbFeatures.size(); i++) {
+            entryLabels[i] = labels.intern(dbFeatures.labels()[i]);
+        }
+    }
+
+    // Features in the scaled space
+    ObjectFeatures scaled(const ObjectFeatures& features) const {
+        ObjectFeatures result;
+        for (size_t d = 0; d < FEATURE_DIMS; d++) {
+            result[d] = features[d] * scale[d];
+        }
+        return result;
+    }
+
+    ObjectFeatures scale;      // 1 / stdev per feature
+    vector<int> entryLabels;   // Label ID of every entry, in database order
+    LabelTable labels;
+};
+
+#endif //PROJ3_NORMALIZED_INDEX_H
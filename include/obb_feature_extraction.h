@@ -9,7 +9,67 @@
 #include <opencv2/opencv.hpp>
 #include <vector>
 #include <iostream>
+#include <string>
+#include "region_stats.h"
+#include "feature_vector.h"
+
+// Geometry of one region, extracted once and shared by every shape feature and the drawing
+struct RegionGeometry {
+    cv::Rect bbox;                               // Region bounding box in the image
+    cv::Mat mask;                                // Region mask around bbox (1 pixel margin), backed by maskStorage
+    std::vector<uchar> maskStorage;              // Grows to the largest mask seen, reused across frames
+    cv::Moments moments;                         // Region moments (central moments are offset free)
+    cv::Point2f centroid;                        // Image coordinates
+    double theta = 0;                            // Least central moment axis, radians
+    std::vector<std::vector<cv::Point>> contours; // Outer contours, image coordinates
+    int mainContour = 0;                         // Largest outer contour
+    double contourArea = 0;                      // Area of the main contour
+    double perimeter = 0;                        // Length of the main contour
+    std::vector<cv::Point> boundary;             // Points of all outer contours (hull input)
+    std::vector<cv::Point> hull;                 // Convex hull of the outer contours
+    cv::RotatedRect obb;                         // Minimum-area box of the hull
+};
+
+// One region of a frame in multi-object mode: geometry, features and the classified label
+struct RegionObject {
+    int regionID = 0;
+    RegionGeometry geometry;
+    ObjectFeatures features;
+    std::string label;
+};
+
+// Bounding box of all pixels of a region ID, found in a single scan of the region map
+int getRegionBoundingBox(const cv::Mat& regionMap, int regionID, cv::Rect& bbox);
+
+// Bounding boxes of regions 1..numRegions from a single scan; boxes[i] belongs to region i + 1
+int getRegionBoundingBoxes(const cv::Mat& regionMap, int numRegions, std::vector<cv::Rect>& boxes);
+
+// Extract the region geometry inside bbox; knownMoments (may be nullptr) skips the moment pass
+int extractRegionGeometry(const cv::Mat& regionMap, int regionID, const cv::Rect& bbox,
+                          const cv::Moments* knownMoments, RegionGeometry& geometry);
+
+// Feature vector from an extracted geometry: 7 Hu moments, aspect ratio, perimeter/area, percent filled
+int computeRegionFeatures(const RegionGeometry& geometry, ObjectFeatures& features);
+
+// Draw centroid, axis and OBB of a region
+void drawResults(cv::Mat& image, const RegionGeometry& geometry, const ObjectFeatures& features);
+
+// Geometry and features of every region 1..N, one parallel task per region. Uses the labeler's
+// statistics when given (stats[i] is region i + 1), otherwise scans the map once for the boxes.
+int computeAllRegionFeatures(const cv::Mat& regionMap, const std::vector<RegionStats>& stats,
+                             std::vector<RegionObject>& objects);
+
+// Draw the OBB, centroid and label of every object
+void drawObjects(cv::Mat& image, const std::vector<RegionObject>& objects);
 
 // Main function to compute OBB and draw OBB
-int computeRegionFeatures(cv::Mat& regionMap, int regionID, cv::Mat& image, cv::Mat& dst, std::vector<float>& features);
+int computeRegionFeatures(cv::Mat& regionMap, int regionID, cv::Mat& image, cv::Mat& dst, ObjectFeatures& features);
+
+// Same as above, geometry is a caller-owned scratch reused between frames (dst is reused as well)
+int computeRegionFeatures(cv::Mat& regionMap, int regionID, cv::Mat& image, cv::Mat& dst, ObjectFeatures& features,
+                          RegionGeometry& geometry);
+
+// Same as above for a region labeled by run-length segmentation: moments, centroid and
+// orientation come from its statistics instead of another pass over the pixels
+int computeRegionFeatures(cv::Mat& regionMap, const RegionStats& stats, cv::Mat& image, cv::Mat& dst, ObjectFeatures& features);
 #endif //PROJ3_OBB_FEATURE_EXTRACTION_H
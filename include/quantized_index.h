@@ -0,0 +1,75 @@
+/*
+ * Authors: Yuyang Tian and Arun Mekkad
+ * Date: 2025/3/8
+ * Purpose: Header file for the quantized (int8 / float16) nearest neighbor index
+ */
+#ifndef PROJ3_QUANTIZED_INDEX_H
+#define PROJ3_QUANTIZED_INDEX_H
+
+#include <opencv2/core.hpp>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "feature_vector.h"
+#include "normalized_index.h"
+
+using namespace cv;
+using namespace std;
+
+// Nearest neighbor search over a compressed copy of the scaled feature space (features / stdev, as in
+// classifyByNN). Every scaled feature is centered per dimension and stored feature-major like NNIndex,
+// either as int8 with a per-dimension step (10 bytes per entry) or as float16 (20 bytes per entry)
+// instead of 40 bytes of floats. Only these codes are scanned, so they are the working set that has to
+// fit in cache. The best few candidates are rescored after adding back the compression error, kept in a
+// separate cold store as a float16 residual per feature (20 bytes per entry, entry-major) next to the
+// label IDs: it is read only for the candidates of each query. The index does not refer to the training
+// set after build(), and the result only differs from an exact search when the true nearest entry does
+// not make it into the candidates.
+class QuantizedIndex : public NormalizedIndex<QuantizedIndex> {
+public:
+    static constexpr int DEFAULT_RESCORE = 16;
+
+    enum class Precision {
+        INT8,  // 1 byte per feature
+        FP16,  // 2 bytes per feature
+    };
+
+    // Normalize and compress the training set, replacing the previous one; dbFeatures may be freed afterwards
+    void build(const TrainingSet& dbFeatures, Precision precision = Precision::INT8);
+
+    // Candidates of the compressed scan that are rescored in float (at least 1)
+    void setRescore(int candidates);
+    int rescore() const { return rescoreCount; }
+
+    bool empty() const { return count == 0; }
+    size_t size() const { return count; }
+    static constexpr size_t dimensions() { return FEATURE_DIMS; }
+    Precision precision() const { return storage; }
+
+    // Bytes of the working set every query scans: codes and per-dimension parameters
+    size_t memoryBytes() const;
+    // Bytes of the cold store read only for the rescored candidates: residuals and labels
+    size_t coldBytes() const;
+
+    // Database position of the nearest entry after rescoring, -1 if empty; distance receives its distance
+    int nearestEntry(const ObjectFeatures& features, float* distance = nullptr) const;
+
+    // Label ID of the nearest entry within MAX_DISTANCE, -1 if none
+    int nearest(const ObjectFeatures& features, float* distance = nullptr) const;
+
+private:
+    // Nearest entry after rescoring and its squared distance, -1 if empty
+    int search(const ObjectFeatures& features, float& squaredDistance) const;
+
+    Precision storage = Precision::INT8;
+    int rescoreCount = DEFAULT_RESCORE;
+    size_t count = 0;
+    size_t stride = 0;
+    ObjectFeatures center;           // Subtracted from the scaled features before compression
+    ObjectFeatures step;             // Scaled value of one code step (1 for FP16)
+    vector<int8_t> codes;            // INT8: dims x stride
+    vector<cv::float16_t> halves;    // FP16: dims x stride
+    vector<cv::float16_t> residuals; // Cold: centered value minus its decoded code, count x dims (entry-major)
+};
+
+#endif //PROJ3_QUANTIZED_INDEX_H
@@ -0,0 +1,69 @@
+/*
+ * Authors: Yuyang Tian and Arun Mekkad
+ * Date: 2025/3/6
+ * Purpose: Header file for the random forest classifier (bagged CART trees in one node array)
+ */
+#ifndef PROJ3_RANDOM_FOREST_H
+#define PROJ3_RANDOM_FOREST_H
+
+#include <opencv2/core.hpp>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "decision_tree.h"
+
+using namespace cv;
+using namespace std;
+
+// Random forest: every tree is a CART tree (growTree) grown on a bootstrap sample of the training data,
+// looking at sqrt(dimensions) random features per split. Trees are grown in parallel and then copied
+// back to back into one node array; leaves loop back to themselves like in DecisionTree, so each tree
+// is depth(t) branch-free steps. The forest predicts the label with the most tree votes (lowest label
+// ID on ties).
+class RandomForest {
+public:
+    /**
+     * @brief Train on labeled feature vectors, replacing the current forest. Trees are grown on all cores.
+     * @param trees Number of trees.
+     * @param maxDepth Maximum depth of each tree.
+     * @param minSamplesLeaf Minimum training samples in each leaf.
+     * @param seed Seed of the bootstrap samples and feature draws; the same seed gives the same forest.
+     * @return -1 on invalid data, 0 on success
+     */
+    int train(const TrainingSet& data, int trees = 32, int maxDepth = 8,
+              int minSamplesLeaf = 1, uint32_t seed = 5330);
+
+    bool empty() const { return roots.empty(); }
+    size_t treeCount() const { return roots.size(); }
+    size_t nodeCount() const { return nodes.size(); }
+    static constexpr size_t dimensions() { return FEATURE_DIMS; }
+
+    /**
+     * @brief Majority vote of the trees.
+     * @param confidence Optional output: share of trees voting for the result.
+     * @return Label ID, -1 if the forest is empty.
+     */
+    int predict(const ObjectFeatures& features, float* confidence = nullptr) const;
+
+    // Name of a label ID, "Unknown" for -1
+    const string& labelName(int id) const;
+
+    string classify(const ObjectFeatures& features) const;
+
+    // Label IDs (and optionally vote shares) of every row of features (CV_32FC1), evaluated tree by tree
+    void predictBatch(const Mat& features, vector<int>& labelIds, vector<float>* confidences = nullptr) const;
+    vector<string> classifyBatch(const vector<ObjectFeatures>& batch) const;
+
+    // Compact binary model ("P3RF"); -1 failure, 0 success
+    int save(const string& path) const;
+    int load(const string& path);
+
+private:
+    vector<TreeNode> nodes;      // All trees back to back; next is an index into the whole array
+    vector<int32_t> leafLabels;  // Label ID per node, -1 for inner nodes
+    vector<int32_t> roots;       // Root node of each tree
+    vector<int32_t> depths;      // Steps from the root to the leaves of each tree
+    vector<string> labels;       // Label ID -> name
+};
+
+#endif //PROJ3_RANDOM_FOREST_H
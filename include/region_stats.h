@@ -0,0 +1,81 @@
+/*
+ * Authors: Yuyang Tian and Arun Mekkad
+ * Date: 2025/2/23
+ * Purpose: Header file for run-length labeling with per-region statistics
+ */
+#ifndef PROJ3_REGION_STATS_H
+#define PROJ3_REGION_STATS_H
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+#include "binary_image.h"
+
+using namespace cv;
+using namespace std;
+
+// Statistics of one region, accumulated run by run while labeling
+struct RegionStats {
+    int label = 0;
+    int area = 0;
+    Rect bbox;
+    bool touchesBoundary = false;
+    // Raw spatial moments m_pq (p + q <= 3), same definition as cv::moments(mask, true)
+    double m00 = 0, m10 = 0, m01 = 0;
+    double m20 = 0, m11 = 0, m02 = 0;
+    double m30 = 0, m21 = 0, m12 = 0, m03 = 0;
+
+    // Full moment set (central and normalized moments derived from the raw ones)
+    Moments moments() const {
+        return Moments(m00, m10, m01, m20, m11, m02, m30, m21, m12, m03);
+    }
+    Point2f centroid() const {
+        return Point2f(static_cast<float>(m10 / m00), static_cast<float>(m01 / m00));
+    }
+    // Orientation of the least central moment axis in radians
+    double orientation() const {
+        Moments m = moments();
+        return 0.5 * atan2(2 * m.mu11, m.mu20 - m.mu02);
+    }
+};
+
+// Add the pixels of one run to the statistics of its region
+void accumulateRun(RegionStats& stats, const PixelRun& run);
+
+// Collect the foreground runs of every row of a 0 / non-zero CV_8UC1 image, in raster order
+void extractRuns(const Mat& binaryImage, vector<PixelRun>& runs);
+
+// Run-length segmentation with 4-connectivity; stats[i] describes region i + 1
+int runLengthSegmentation4conn(const Mat& binaryImage, Mat& regionMap, vector<RegionStats>& stats,
+                               int minRegionSize = 50);
+
+// Run-length segmentation with 8-connectivity, border regions removed; stats[i] describes region i + 1
+int runLengthSegmentation8conn(const Mat& binaryImage, Mat& regionMap, vector<RegionStats>& stats,
+                               int minRegionSize = 50);
+
+// Same as above, reading runs straight from a packed binary image
+int runLengthSegmentation8conn(const PackedBinaryImage& binary, Mat& regionMap, vector<RegionStats>& stats,
+                               int minRegionSize = 50);
+
+// 8-connectivity segmentations with caller-owned scratch buffers (no allocation once they are warm)
+int runLengthSegmentation8conn(const Mat& binaryImage, Mat& regionMap, vector<RegionStats>& stats,
+                               LabelScratch& scratch, int minRegionSize = 50);
+int runLengthSegmentation8conn(const PackedBinaryImage& binary, Mat& regionMap, vector<RegionStats>& stats,
+                               LabelScratch& scratch, int minRegionSize = 50);
+
+// Segment only windows of a BGR frame: each box is padded by margin, overlapping windows are merged,
+// and every window goes through value, fixed threshold, morphology and run extraction on its own.
+// The runs are labeled together in frame coordinates (8-connectivity, frame border regions removed),
+// so regions and stats are numbered exactly like a full-frame runLengthSegmentation8conn.
+// clippedRegions counts regions that reach a window edge inside the frame, i.e. may continue outside.
+int segmentWindows8conn(const Mat& frame, const vector<Rect>& boxes, int margin, float thresholdValue,
+                        const vector<MorphStep>& morphSteps, Mat& regionMap, vector<RegionStats>& stats,
+                        int& clippedRegions, int minRegionSize = 50);
+
+// Coarse-to-fine segmentation: threshold, filter and label a 2^levels downscaled copy of the frame to
+// find candidate boxes, then segment only those windows at full resolution with segmentWindows8conn.
+// thresholdValue is the starting threshold and receives the one chosen on the coarse level.
+int pyramidSegmentation8conn(const Mat& frame, int levels, int margin, float& thresholdValue,
+                             ThresholdMethod method, const vector<MorphStep>& morphSteps, Mat& regionMap,
+                             vector<RegionStats>& stats, int& clippedRegions, int minRegionSize = 50);
+
+#endif //PROJ3_REGION_STATS_H
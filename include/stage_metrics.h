@@ -0,0 +1,96 @@
+/*
+ * Authors: Yuyang Tian and Arun Mekkad
+ * Date: 2025/3/1
+ * Purpose: Header file for lock-free per-stage latency histograms and metrics export
+ */
+#ifndef PROJ3_STAGE_METRICS_H
+#define PROJ3_STAGE_METRICS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Log-linear (HDR style) latency histogram in nanoseconds. Every power of two is split into 16
+// linear sub-buckets, so any value is kept within ~6% while the range covers 1 ns to centuries.
+// record() is a relaxed atomic increment: any thread may record while another reads.
+class LatencyHistogram {
+public:
+    static constexpr int SUB_BUCKET_BITS = 4;
+    static constexpr int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+    static constexpr int NUM_BUCKETS = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+    LatencyHistogram() { reset(); }
+
+    void record(int64_t ns);
+
+    // Upper edge of the bucket holding the p-th quantile (0 < p <= 1), 0 if empty
+    int64_t percentile(double p) const;
+
+    uint64_t count() const { return total.load(memory_order_relaxed); }
+    int64_t max() const { return maxValue.load(memory_order_relaxed); }
+
+    // Clear the counts; records racing with a reset may be lost
+    void reset();
+
+    static int bucketIndex(uint64_t value);
+    static uint64_t bucketLowerBound(int index);
+
+private:
+    atomic<uint64_t> counts[NUM_BUCKETS];
+    atomic<uint64_t> total;
+    atomic<int64_t> maxValue;
+};
+
+// Stages of one frame
+enum class Stage {
+    HSV,
+    THRESHOLD,
+    MORPHOLOGY,
+    LABELING,
+    FEATURES,
+    CLASSIFICATION,
+    DISPLAY,
+    COUNT,
+};
+
+// One histogram per stage
+class StageMetrics {
+public:
+    static const char* stageName(Stage stage);
+
+    void record(Stage stage, int64_t ns) { histograms[static_cast<int>(stage)].record(ns); }
+    const LatencyHistogram& histogram(Stage stage) const { return histograms[static_cast<int>(stage)]; }
+
+    // One line per stage with samples: "<stage> p50 <ms> p99 <ms>"
+    void summaryLines(vector<string>& lines) const;
+
+    // Text exposition format (count, max, p50, p90, p99 per stage), written atomically via rename
+    int writeTextFile(const string& path) const;
+
+    void reset();
+
+private:
+    LatencyHistogram histograms[static_cast<int>(Stage::COUNT)];
+};
+
+// Records the time between construction and destruction of the scope into one stage
+class ScopedStageTimer {
+public:
+    ScopedStageTimer(StageMetrics& metrics, Stage stage)
+            : metrics(metrics), stage(stage), start(chrono::steady_clock::now()) {}
+    ~ScopedStageTimer() {
+        metrics.record(stage, chrono::duration_cast<chrono::nanoseconds>(
+                chrono::steady_clock::now() - start).count());
+    }
+
+private:
+    StageMetrics& metrics;
+    Stage stage;
+    chrono::steady_clock::time_point start;
+};
+
+#endif //PROJ3_STAGE_METRICS_H
@@ -0,0 +1,325 @@
+/*
+ * Authors: Yuyang Tian and Arun Mekkad
+ * Date: 2025/2/27
+ * Purpose: Headless batch processing of image directories and video files on all cores
+ */
+
+#include <opencv2/opencv.hpp>
+#include <opencv2/core/utils/filesystem.hpp>
+#include <iostream>
+#include <fstream>
+#include <cstdint>
+#include "../include/image_process.h"
+#include "../include/region_stats.h"
+#include "../include/obb_feature_extraction.h"
+#include "../include/frame_arena.h"
+#include "../include/classifier.h"
+#include "../include/nn_index.h"
+#include "../include/decision_tree.h"
+#include "../include/random_forest.h"
+#include "../db/db_manager.h"
+
+using namespace cv;
+using namespace std;
+
+// Settings shared by every worker
+struct BatchOptions {
+    string input;
+    string csvPath;
+    string binaryPath;
+    vector<MorphStep> morphSequence = {{MorphOp::ERODE, Size(3, 3)}};
+    bool decisionTree = false;
+    string decisionTreePath;  // Trained model to load instead of training from the database
+    bool randomForest = false;
+    string randomForestPath;  // Trained forest to load instead of training from the database
+    int height = 320;  // Same processing height as VidDisplay (256 / 0.8), 0 keeps the input size
+    int batchSize = 0;  // Frames decoded before they are processed in parallel, 0 = 8 per thread
+};
+
+// One input frame and everything found in it
+struct BatchFrame {
+    string source;
+    int index = 0;
+    Mat image;
+    vector<RegionObject> objects;
+};
+
+/**
+ * @brief Run threshold -> morphology -> segmentation -> features -> classification on one frame.
+ * @param frame The frame, objects are written back into it.
+ * @param options Batch settings.
+ * @param nnIndex Training data for the nearest neighbor classifier.
+ * @param tree Decision tree, used when options.decisionTree is set.
+ * @param forest Random forest, used when options.randomForest is set.
+ * @param arena Scratch buffers of the calling worker.
+ * @param resized, value, binary, filtered, regionMap, stats Per-worker images, reused between frames.
+ */
+static void processBatchFrame(BatchFrame& frame, const BatchOptions& options,
+                              const NNIndex& nnIndex, const DecisionTree& tree, const RandomForest& forest,
+                              FrameArena& arena, Mat& resized, Mat& value, Mat& binary, Mat& filtered,
+                              Mat& regionMap, vector<RegionStats>& stats) {
+    frame.objects.clear();
+    if (frame.image.empty()) {
+        return;
+    }
+    const Mat* input = &frame.image;
+    if (options.height > 0 && frame.image.rows != options.height) {
+        double scale = static_cast<double>(options.height) / frame.image.rows;
+        resize(frame.image, resized, Size(cvRound(frame.image.cols * scale), options.height));
+        input = &resized;
+    }
+
+    bgr_to_value(*input, value);
+    threshold(value, binary);
+    applyMorphologicalFiltering(binary, filtered, options.morphSequence, arena.morph);
+    runLengthSegmentation8conn(filtered, regionMap, stats, arena.labels);
+    computeAllRegionFeatures(regionMap, stats, frame.objects);
+
+    vector<ObjectFeatures> batch;
+    batch.reserve(frame.objects.size());
+    for (const RegionObject& object : frame.objects) {
+        batch.push_back(object.features);
+    }
+    vector<string> labels = options.randomForest ? forest.classifyBatch(batch)
+                            : options.decisionTree ? tree.classifyBatch(batch) : nnIndex.classifyBatch(batch);
+    for (size_t i = 0; i < labels.size(); i++) {
+        frame.objects[i].label = labels[i];
+    }
+}
+
+/**
+ * @brief CSV field as in RFC 4180: wrapped in double quotes, with inner quotes doubled, when it contains
+ *        a comma, a quote or a line break (file names and labels may contain any of them).
+ */
+static string csvField(const string& text) {
+    if (text.find_first_of(",\"\r\n") == string::npos) {
+        return text;
+    }
+    string quoted = "\"";
+    for (char c : text) {
+        if (c == '"') quoted += '"';
+        quoted += c;
+    }
+    quoted += '"';
+    return quoted;
+}
+
+// Writes results in input order as CSV and / or a binary record stream
+class BatchWriter {
+public:
+    int open(const BatchOptions& options) {
+        if (!options.csvPath.empty()) {
+            csv.open(options.csvPath);
+            if (!csv) {
+                cerr << "Error: cannot open " << options.csvPath << endl;
+                return -1;
+            }
+            csv << "source,frame,region,label,cx,cy,theta";
+            for (int i = 0; i < 10; i++) csv << ",f" << i;
+            csv << "\n";
+        }
+        if (!options.binaryPath.empty()) {
+            binary.open(options.binaryPath, ios::binary);
+            if (!binary) {
+                cerr << "Error: cannot open " << options.binaryPath << endl;
+                return -1;
+            }
+            binary.write("P3BF", 4);  // Magic; records follow
+        }
+        return 0;
+    }
+
+    /**
+     * @brief Binary record: uint32 source length, source path bytes, int32 frame, int32 region,
+     *        uint32 label length, label bytes, uint32 feature count, float32 features
+     *        (little endian, host layout).
+     */
+    void write(const BatchFrame& frame) {
+        for (const RegionObject& object : frame.objects) {
+            if (csv.is_open()) {
+                csv << csvField(frame.source) << "," << frame.index << "," << object.regionID << ","
+                    << csvField(object.label)
+                    << "," << object.geometry.centroid.x << "," << object.geometry.centroid.y
+                    << "," << object.geometry.theta;
+                for (float feature : object.features) csv << "," << feature;
+                csv << "\n";
+            }
+            if (binary.is_open()) {
+                uint32_t sourceLength = static_cast<uint32_t>(frame.source.size());
+                int32_t header[2] = {frame.index, object.regionID};
+                uint32_t labelLength = static_cast<uint32_t>(object.label.size());
+                uint32_t featureCount = static_cast<uint32_t>(object.features.size());
+                binary.write(reinterpret_cast<const char*>(&sourceLength), sizeof(sourceLength));
+                binary.write(frame.source.data(), sourceLength);
+                binary.write(reinterpret_cast<const char*>(header), sizeof(header));
+                binary.write(reinterpret_cast<const char*>(&labelLength), sizeof(labelLength));
+                binary.write(object.label.data(), labelLength);
+                binary.write(reinterpret_cast<const char*>(&featureCount), sizeof(featureCount));
+                binary.write(reinterpret_cast<const char*>(object.features.data()), featureCount * sizeof(float));
+            }
+        }
+    }
+
+private:
+    ofstream csv;
+    ofstream binary;
+};
+
+/**
+ * @brief Process one batch of decoded frames, one frame per task on all OpenCV threads.
+ *        Each task range keeps its own arena and images, so workers share nothing but the inputs.
+ */
+static void processBatch(vector<BatchFrame>& frames, int count, const BatchOptions& options,
+                         const NNIndex& nnIndex, const DecisionTree& tree, const RandomForest& forest) {
+    parallel_for_(Range(0, count), [&](const Range& range) {
+        FrameArena arena;
+        Mat resized, value, binary, filtered, regionMap;
+        vector<RegionStats> stats;
+        for (int i = range.start; i < range.end; i++) {
+            processBatchFrame(frames[i], options, nnIndex, tree, forest, arena, resized, value, binary, filtered,
+                              regionMap, stats);
+        }
+    });
+}
+
+// Usage message
+static void printUsage() {
+    cout << "Usage: BatchProcess <image directory | video file> [--csv out.csv] [--binary out.bin]\n"
+         << "       [--morph open:7x7,close:15] [--classifier nn|dt|rf] [--dt-model model.bin]\n"
+         << "       [--rf-model forest.bin]\n"
+         << "       [--height 320 (0 = input size)] [--threads N] [--batch N]\n";
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        printUsage();
+        return -1;
+    }
+    BatchOptions options;
+    options.input = argv[1];
+    for (int i = 2; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--csv" && i + 1 < argc) {
+            options.csvPath = argv[++i];
+        } else if (arg == "--binary" && i + 1 < argc) {
+            options.binaryPath = argv[++i];
+        } else if (arg == "--morph" && i + 1 < argc) {
+            if (parseMorphSequence(argv[++i], options.morphSequence) != 0) {
+                return -1;
+            }
+        } else if (arg == "--classifier" && i + 1 < argc) {
+            string classifier = argv[++i];
+            if (classifier != "nn" && classifier != "dt" && classifier != "rf") {
+                printUsage();
+                return -1;
+            }
+            options.decisionTree = classifier == "dt";
+            options.randomForest = classifier == "rf";
+        } else if (arg == "--dt-model" && i + 1 < argc) {
+            options.decisionTreePath = argv[++i];
+        } else if (arg == "--rf-model" && i + 1 < argc) {
+            options.randomForestPath = argv[++i];
+        } else if (arg == "--height" && i + 1 < argc) {
+            options.height = stoi(argv[++i]);
+        } else if (arg == "--threads" && i + 1 < argc) {
+            setNumThreads(stoi(argv[++i]));
+        } else if (arg == "--batch" && i + 1 < argc) {
+            options.batchSize = stoi(argv[++i]);
+        } else {
+            printUsage();
+            return -1;
+        }
+    }
+    if (options.csvPath.empty() && options.binaryPath.empty()) {
+        options.csvPath = "batch_results.csv";
+    }
+
+    try {
+        BatchWriter writer;
+        if (writer.open(options) != 0) {
+            return -1;
+        }
+        // Built once, shared read-only by all workers
+        NNIndex nnIndex;
+        DecisionTree tree;
+        RandomForest forest;
+        bool savedTree = options.decisionTree && !options.decisionTreePath.empty();
+        if (savedTree && tree.load(options.decisionTreePath) != 0) {
+            return -1;
+        }
+        bool savedForest = options.randomForest && !options.randomForestPath.empty();
+        if (savedForest && forest.load(options.randomForestPath) != 0) {
+            return -1;
+        }
+        if (!savedTree && !savedForest) {
+            DBManager db;
+            TrainingSet dbFeatures;
+            db.loadFeatureVectors(dbFeatures);
+            if (options.randomForest) {
+                if (forest.train(dbFeatures) != 0) {
+                    return -1;
+                }
+            } else if (options.decisionTree) {
+                if (tree.train(dbFeatures) != 0) {
+                    return -1;
+                }
+            } else {
+                nnIndex.build(dbFeatures);
+            }
+        }
+
+        // A directory is a list of images, anything else is opened as a video
+        vector<String> files;
+        VideoCapture video;
+        if (utils::fs::isDirectory(options.input)) {
+            glob(options.input, files, false);
+        } else if (!video.open(options.input)) {
+            cerr << "Error: cannot open " << options.input << endl;
+            return -1;
+        }
+
+        int batchSize = options.batchSize > 0 ? options.batchSize : 8 * max(1, getNumThreads());
+        vector<BatchFrame> frames(batchSize);
+        size_t nextFile = 0;
+        int frameIndex = 0, processed = 0;
+        int64 start = getTickCount();
+        while (true) {
+            // Decode a batch (sequential for video, image files are decoded by the workers)
+            int count = 0;
+            for (; count < batchSize; count++) {
+                BatchFrame& frame = frames[count];
+                frame.index = frameIndex;
+                if (!files.empty()) {
+                    if (nextFile == files.size()) break;
+                    frame.source = files[nextFile++];
+                } else {
+                    if (!video.read(frame.image)) break;
+                    frame.source = options.input;
+                }
+                frameIndex++;
+            }
+            if (count == 0) break;
+
+            if (!files.empty()) {
+                parallel_for_(Range(0, count), [&](const Range& range) {
+                    for (int i = range.start; i < range.end; i++) {
+                        frames[i].image = imread(frames[i].source);
+                    }
+                });
+            }
+            processBatch(frames, count, options, nnIndex, tree, forest);
+            for (int i = 0; i < count; i++) {
+                writer.write(frames[i]);
+            }
+            processed += count;
+        }
+
+        double seconds = (getTickCount() - start) / getTickFrequency();
+        cerr << "Processed " << processed << " frames in " << seconds << " s ("
+             << (seconds > 0 ? processed / seconds : 0.0) << " frames/s, " << getNumThreads() << " threads)" << endl;
+        return 0;
+    } catch (const exception& e) {
+        cerr << "Error: " << e.what() << endl;
+        return -1;
+    }
+}
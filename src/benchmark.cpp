@@ -0,0 +1,344 @@
+/*
+ * Authors: Yuyang Tian and Arun Mekkad
+ * Date: 2025/2/28
+ * Purpose: Per-stage benchmarks of the detection pipeline with JSON output
+ */
+
+#include <opencv2/opencv.hpp>
+#include <opencv2/core/hal/intrin.hpp>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <random>
+#include <algorithm>
+#include "../include/image_process.h"
+#include "../include/region_stats.h"
+#include "../include/obb_feature_extraction.h"
+#include "../include/classifier.h"
+#include "../include/nn_index.h"
+#include "../include/kd_tree.h"
+#include "../include/hnsw_index.h"
+#include "../include/quantized_index.h"
+#include "../include/decision_tree.h"
+#include "../include/random_forest.h"
+
+using namespace cv;
+using namespace std;
+
+// One measured stage at one size
+struct BenchmarkResult {
+    string stage;
+    string size;       // Resolution name or DB size
+    double units;      // Pixels or queries per call
+    string unitName;   // "pixel" or "query"
+    int calls;
+    double medianNs;   // Median wall time of one call
+    double minNs;
+    double recall = -1;  // Approximate searches: share of queries that found the exact nearest entry
+    double bytesPerEntry = -1;  // Compressed indexes: scanned bytes per training sample
+    double coldBytesPerEntry = -1;  // Compressed indexes: bytes per sample only read for rescoring
+    double compression = -1;  // Compressed indexes: bytes of the float NNIndex / scanned bytes
+};
+
+// Resolutions the image stages run at, upscaled from the test images
+static const vector<pair<string, Size>> RESOLUTIONS = {
+    {"vga", Size(640, 480)},
+    {"hd", Size(1280, 720)},
+    {"fhd", Size(1920, 1080)},
+    {"4k", Size(3840, 2160)},
+};
+
+/**
+ * @brief Time a function: one warm-up call, then calls until minSeconds have passed (at least
+ *        minCalls, at most maxCalls). The median is reported because it is stable under
+ *        scheduler noise, the minimum as a best case.
+ */
+template <class F>
+static BenchmarkResult measure(const string& stage, const string& size, double units, const string& unitName,
+                               F&& function, double minSeconds, int minCalls = 5, int maxCalls = 1000) {
+    function();  // Warm-up: caches, lazy tables, buffer allocation
+    vector<double> times;
+    double total = 0;
+    double frequency = getTickFrequency();
+    while ((static_cast<int>(times.size()) < minCalls || total < minSeconds)
+           && static_cast<int>(times.size()) < maxCalls) {
+        int64 start = getTickCount();
+        function();
+        double ns = (getTickCount() - start) * 1e9 / frequency;
+        times.push_back(ns);
+        total += ns * 1e-9;
+    }
+    sort(times.begin(), times.end());
+    return {stage, size, units, unitName, static_cast<int>(times.size()), times[times.size() / 2], times.front()};
+}
+
+// Benchmark the image stages at one resolution
+static void benchmarkImageStages(const Mat& source, const string& name, Size size, double minSeconds,
+                                 vector<BenchmarkResult>& results) {
+    Mat image, hsv, value, binary, filtered, regionMap, dst;
+    resize(source, image, size, 0, 0, INTER_LINEAR);
+    double pixels = static_cast<double>(size.area());
+    ObjectFeatures features;
+
+    results.push_back(measure("bgr_to_hsv", name, pixels, "pixel", [&] { bgr_to_hsv(image, hsv); }, minSeconds));
+    results.push_back(measure("bgr_to_value", name, pixels, "pixel", [&] { bgr_to_value(image, value); }, minSeconds));
+    results.push_back(measure("threshold", name, pixels, "pixel", [&] { threshold(value, binary); }, minSeconds));
+    results.push_back(measure("applyMorphologicalFiltering", name, pixels, "pixel",
+                              [&] { applyMorphologicalFiltering(binary, filtered); }, minSeconds));
+    results.push_back(measure("twoPassSegmentation4conn", name, pixels, "pixel",
+                              [&] { twoPassSegmentation4conn(filtered, regionMap); }, minSeconds));
+    results.push_back(measure("twoPassSegmentation8conn", name, pixels, "pixel",
+                              [&] { twoPassSegmentation8conn(filtered, regionMap); }, minSeconds));
+
+    // Features of the largest region, as the camera app would see it
+    vector<RegionStats> stats;
+    runLengthSegmentation8conn(filtered, regionMap, stats);
+    int regionID = 0;
+    int largest = 0;
+    for (const RegionStats& region : stats) {
+        if (region.area > largest) {
+            largest = region.area;
+            regionID = region.label;
+        }
+    }
+    results.push_back(measure("computeRegionFeatures", name, pixels, "pixel",
+                              [&] { computeRegionFeatures(regionMap, regionID, image, dst, features); }, minSeconds));
+}
+
+// Synthetic training set: 5 labels, each a Gaussian cluster in the 10-dimensional feature space
+static void makeDatabase(int size, mt19937& rng, TrainingSet& db) {
+    static const vector<string> labels = {"spatula", "hair tie", "glass", "tea bag", "socks"};
+    normal_distribution<float> noise(0.0f, 0.3f);
+    db.clear();
+    db.reserve(size);
+    for (int i = 0; i < size; i++) {
+        int label = i % static_cast<int>(labels.size());
+        ObjectFeatures features;
+        for (size_t k = 0; k < FEATURE_DIMS; k++) {
+            features[k] = static_cast<float>(label + k % 3) + noise(rng);
+        }
+        db.push_back(labels[label], features);
+    }
+}
+
+// Benchmark the classifiers for one database size
+static void benchmarkClassifiers(int dbSize, double minSeconds, vector<BenchmarkResult>& results) {
+    mt19937 rng(5330);  // Fixed seed: same data for every run and build
+    TrainingSet db;
+    makeDatabase(dbSize, rng, db);
+    TrainingSet queries;
+    makeDatabase(64, rng, queries);
+
+    string size = to_string(dbSize);
+    size_t next = 0;
+    string label;
+    results.push_back(measure("classifyByNN", size, 1, "query", [&] {
+        label = classifyByNN(db, queries.features()[next++ % queries.size()]);
+    }, minSeconds));
+    NNIndex index;
+    index.build(db);
+    results.push_back(measure("NNIndex::classify", size, 1, "query", [&] {
+        label = index.classify(queries.features()[next++ % queries.size()]);
+    }, minSeconds, 5, 100000));
+    KDTreeIndex tree;
+    tree.build(db);
+    results.push_back(measure("KDTreeIndex::classify", size, 1, "query", [&] {
+        label = tree.classify(queries.features()[next++ % queries.size()]);
+    }, minSeconds, 5, 100000));
+    // Measured last, after the training set is released: the quantized indexes keep all they need
+    QuantizedIndex quantized[2];
+    quantized[0].build(db, QuantizedIndex::Precision::INT8);
+    quantized[1].build(db, QuantizedIndex::Precision::FP16);
+    DecisionTree decisionTree;
+    results.push_back(measure("DecisionTree::train", size, dbSize, "sample", [&] { decisionTree.train(db); },
+                              minSeconds, 3, 100));
+    results.push_back(measure("DecisionTree::classify", size, 1, "query", [&] {
+        label = decisionTree.classify(queries.features()[next++ % queries.size()]);
+    }, minSeconds, 5, 100000));
+    results.push_back(measure("classifyByDecisionTree", size, 1, "query", [&] {
+        label = classifyByDecisionTree(queries.features()[next++ % queries.size()]);
+    }, minSeconds, 5, 100000));
+    RandomForest forest;
+    results.push_back(measure("RandomForest::train", size, dbSize, "sample", [&] { forest.train(db); },
+                              minSeconds, 3, 100));
+    results.push_back(measure("RandomForest::classify", size, 1, "query", [&] {
+        label = forest.classify(queries.features()[next++ % queries.size()]);
+    }, minSeconds, 5, 100000));
+    const vector<ObjectFeatures>& batch = queries.features();
+    vector<string> labels;
+    results.push_back(measure("RandomForest::classifyBatch", size, static_cast<double>(batch.size()), "query",
+                              [&] { labels = forest.classifyBatch(batch); }, minSeconds, 5, 10000));
+
+    vector<KNNResult> truth;
+    index.knnBatch(queries.features(), 1, truth);
+    db = TrainingSet();
+    for (const QuantizedIndex& compressed : quantized) {
+        int found = 0;
+        for (size_t q = 0; q < queries.size(); q++) {
+            found += !truth[q].neighbors.empty()
+                     && compressed.nearestEntry(queries.features()[q]) == truth[q].neighbors[0].entry;
+        }
+        string name = compressed.precision() == QuantizedIndex::Precision::INT8 ? "int8" : "fp16";
+        BenchmarkResult result = measure("QuantizedIndex::classify " + name, size, 1, "query", [&] {
+            label = compressed.classify(queries.features()[next++ % queries.size()]);
+        }, minSeconds, 5, 100000);
+        result.recall = static_cast<double>(found) / queries.size();
+        result.bytesPerEntry = static_cast<double>(compressed.memoryBytes()) / max(1, dbSize);
+        result.coldBytesPerEntry = static_cast<double>(compressed.coldBytes()) / max(1, dbSize);
+        result.compression = static_cast<double>(index.memoryBytes()) / compressed.memoryBytes();
+        results.push_back(result);
+    }
+}
+
+/**
+ * @brief Recall report of the HNSW index against exact search: for each beam width, the share of
+ *        queries whose nearest entry matches the exact nearest entry, and the query latency.
+ *        The graph is loaded from indexPath when it matches the database, otherwise built and saved.
+ */
+static void benchmarkHNSW(int dbSize, const string& indexPath, double minSeconds, vector<BenchmarkResult>& results) {
+    mt19937 rng(5330);
+    TrainingSet db;
+    makeDatabase(dbSize, rng, db);
+    TrainingSet queries;
+    makeDatabase(1000, rng, queries);
+    const vector<ObjectFeatures>& batch = queries.features();
+
+    HNSWIndex index;
+    if (indexPath.empty() || index.load(indexPath, HNSWIndex::fingerprint(db)) != 0) {
+        int64 start = getTickCount();
+        index.build(db);
+        cerr << "Built HNSW over " << dbSize << " samples in " << (getTickCount() - start) / getTickFrequency()
+             << " s" << endl;
+        if (!indexPath.empty()) index.save(indexPath);
+    }
+    NNIndex exact;
+    exact.build(db);
+    vector<KNNResult> truth;
+    exact.knnBatch(batch, 1, truth);
+
+    string size = to_string(dbSize);
+    for (int ef : {8, 16, 32, 64, 128}) {
+        index.setEfSearch(ef);
+        int found = 0;
+        for (size_t q = 0; q < batch.size(); q++) {
+            found += index.nearestEntry(batch[q]) == truth[q].neighbors[0].entry;
+        }
+        size_t next = 0;
+        int entry = 0;
+        BenchmarkResult result = measure("HNSWIndex::nearestEntry ef=" + to_string(ef), size, 1, "query", [&] {
+            entry = index.nearestEntry(batch[next++ % batch.size()]);
+        }, minSeconds, 5, 100000);
+        result.recall = static_cast<double>(found) / batch.size();
+        results.push_back(result);
+    }
+}
+
+// Stable JSON: fixed key order, one result per line, in the order the stages ran
+static void writeJson(ostream& out, const vector<BenchmarkResult>& results) {
+    out << fixed << setprecision(3);
+    out << "{\n";
+    out << "  \"opencv\": \"" << CV_VERSION << "\",\n";
+    out << "  \"threads\": " << getNumThreads() << ",\n";
+    out << "  \"simd_width\": " << CV_SIMD_WIDTH << ",\n";
+    out << "  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchmarkResult& r = results[i];
+        out << "    {\"stage\": \"" << r.stage << "\", \"size\": \"" << r.size << "\", \"calls\": " << r.calls
+            << ", \"median_ns\": " << r.medianNs << ", \"min_ns\": " << r.minNs
+            << ", \"ns_per_" << r.unitName << "\": " << r.medianNs / r.units;
+        if (r.recall >= 0) out << ", \"recall\": " << r.recall;
+        if (r.bytesPerEntry >= 0) out << ", \"bytes_per_entry\": " << r.bytesPerEntry;
+        if (r.coldBytesPerEntry >= 0) out << ", \"cold_bytes_per_entry\": " << r.coldBytesPerEntry;
+        if (r.compression >= 0) out << ", \"compression\": " << r.compression;
+        out << "}"
+            << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n";
+    out << "}\n";
+}
+
+// Comma separated list
+static vector<string> splitList(const string& list) {
+    vector<string> items;
+    stringstream stream(list);
+    string item;
+    while (getline(stream, item, ',')) {
+        if (!item.empty()) items.push_back(item);
+    }
+    return items;
+}
+
+int main(int argc, char* argv[]) {
+    string imagePath = "../test-imgs/img4P3.png";
+    string jsonPath;
+    vector<string> resolutions = {"vga", "hd", "fhd", "4k"};
+    vector<int> dbSizes = {100, 1000, 10000};
+    double minSeconds = 0.25;
+    int hnswSize = 0;
+    string hnswPath;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--image" && i + 1 < argc) {
+            imagePath = argv[++i];
+        } else if (arg == "--json" && i + 1 < argc) {
+            jsonPath = argv[++i];
+        } else if (arg == "--resolutions" && i + 1 < argc) {
+            resolutions = splitList(argv[++i]);
+        } else if (arg == "--db-sizes" && i + 1 < argc) {
+            dbSizes.clear();
+            for (const string& size : splitList(argv[++i])) dbSizes.push_back(stoi(size));
+        } else if (arg == "--min-time" && i + 1 < argc) {
+            minSeconds = stod(argv[++i]);
+        } else if (arg == "--hnsw-size" && i + 1 < argc) {
+            hnswSize = stoi(argv[++i]);
+        } else if (arg == "--hnsw-index" && i + 1 < argc) {
+            hnswPath = argv[++i];
+        } else if (arg == "--threads" && i + 1 < argc) {
+            setNumThreads(stoi(argv[++i]));
+        } else {
+            cout << "Usage: Benchmark [--image ../test-imgs/img4P3.png] [--resolutions vga,hd,fhd,4k]\n"
+                 << "       [--db-sizes 100,1000,10000] [--min-time seconds] [--threads N] [--json out.json]\n"
+                 << "       [--hnsw-size N [--hnsw-index file]]\n";
+            return -1;
+        }
+    }
+
+    Mat source = imread(imagePath);
+    if (source.empty()) {
+        cerr << "Error: cannot load " << imagePath << endl;
+        return -1;
+    }
+
+    vector<BenchmarkResult> results;
+    for (const string& name : resolutions) {
+        auto it = find_if(RESOLUTIONS.begin(), RESOLUTIONS.end(),
+                          [&](const pair<string, Size>& r) { return r.first == name; });
+        if (it == RESOLUTIONS.end()) {
+            cerr << "Error: unknown resolution " << name << " (vga, hd, fhd, 4k)" << endl;
+            return -1;
+        }
+        cerr << "Benchmarking image stages at " << name << "..." << endl;
+        benchmarkImageStages(source, it->first, it->second, minSeconds, results);
+    }
+    for (int dbSize : dbSizes) {
+        cerr << "Benchmarking classifiers with " << dbSize << " samples..." << endl;
+        benchmarkClassifiers(dbSize, minSeconds, results);
+    }
+    if (hnswSize > 0) {
+        cerr << "Benchmarking HNSW recall with " << hnswSize << " samples..." << endl;
+        benchmarkHNSW(hnswSize, hnswPath, minSeconds, results);
+    }
+
+    if (jsonPath.empty()) {
+        writeJson(cout, results);
+    } else {
+        ofstream out(jsonPath);
+        if (!out) {
+            cerr << "Error: cannot open " << jsonPath << endl;
+            return -1;
+        }
+        writeJson(out, results);
+    }
+    return 0;
+}
@@ -0,0 +1,469 @@
+/*
+ * Authors: Yuyang Tian and Arun Mekkad
+ * Date: 2025/2/21
+ * Purpose: Bit-packed binary images: threshold, word-parallel morphology and run labeling
+ */
+
+#include "../include/binary_image.h"
+#include "../include/region_stats.h"
+#include <iostream>
+#include <algorithm>
+#include <numeric>
+#include <cmath>
+#include <opencv2/core/hal/intrin.hpp>
+
+// Pack a 0 / non-zero CV_8UC1 image
+int packBinary(const Mat& src, PackedBinaryImage& dst) {
+    if (src.empty() || src.type() != CV_8UC1) {
+        cerr << "ERROR: packBinary - not a CV_8UC1 image" << endl;
+        return -1;
+    }
+    dst.create(src.rows, src.cols);
+    for (int y = 0; y < src.rows; y++) {
+        const uchar* srcRow = src.ptr<uchar>(y);
+        uint64_t* dstRow = dst.row(y);
+        for (int x = 0; x < src.cols; x++) {
+            if (srcRow[x]) {
+                dstRow[x / 64] |= uint64_t(1) << (x % 64);
+            }
+        }
+    }
+    return 0;
+}
+
+// Unpack into a 0/255 CV_8UC1 image (for display)
+int unpackBinary(const PackedBinaryImage& src, Mat& dst) {
+    if (src.empty()) {
+        cerr << "ERROR: unpackBinary - empty image" << endl;
+        return -1;
+    }
+    dst.create(src.rows, src.cols, CV_8UC1);
+    for (int y = 0; y < src.rows; y++) {
+        const uint64_t* srcRow = src.row(y);
+        uchar* dstRow = dst.ptr<uchar>(y);
+        for (int x = 0; x < src.cols; x++) {
+            dstRow[x] = ((srcRow[x / 64] >> (x % 64)) & 1) ? 255 : 0;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Threshold a CV_8UC1 image straight into packed form (bit set where src > threshold).
+ *        The threshold is selected on the histogram exactly like threshold().
+ * @return the threshold used, -1 on failure
+ */
+float thresholdPacked(const Mat& src, PackedBinaryImage& dst, float initialThreshold, ThresholdMethod method) {
+    if (src.empty() || src.type() != CV_8UC1) {
+        cerr << "Error: Invalid input image in thresholdPacked" << endl;
+        return -1;
+    }
+
+    int hist[256];
+    computeHistogram(src, hist);
+    float thresholdValue = (method == ThresholdMethod::OTSU)
+                           ? otsuThreshold(hist)
+                           : isodataThreshold(hist, initialThreshold);
+
+    // Pixels are integers, so src > t is the same as src > floor(t)
+    int cutoff = static_cast<int>(floor(thresholdValue));
+    dst.create(src.rows, src.cols);
+    if (cutoff >= 255) {
+        return thresholdValue;  // Nothing is above the threshold
+    }
+    cutoff = max(cutoff, -1);
+
+    int fullWords = src.cols / 64;
+    for (int y = 0; y < src.rows; y++) {
+        const uchar* srcRow = src.ptr<uchar>(y);
+        uint64_t* dstRow = dst.row(y);
+
+        for (int w = 0; w < fullWords; w++) {
+            const uchar* p = srcRow + w * 64;
+            uint64_t bits = 0;
+            int x = 0;
+#if CV_SIMD && CV_SIMD_WIDTH <= 32
+            if (cutoff >= 0) {
+                const int lanes = v_uint8::nlanes;
+                v_uint8 limit = vx_setall_u8(static_cast<uchar>(cutoff));
+                for (; x < 64; x += lanes) {
+                    uint32_t mask = static_cast<uint32_t>(v_signmask(vx_load(p + x) > limit));
+                    bits |= static_cast<uint64_t>(mask) << x;
+                }
+            }
+#endif
+            for (; x < 64; x++) {
+                bits |= static_cast<uint64_t>(p[x] > cutoff) << x;
+            }
+            dstRow[w] = bits;
+        }
+
+        // Partial last word
+        uint64_t bits = 0;
+        for (int x = fullWords * 64; x < src.cols; x++) {
+            bits |= static_cast<uint64_t>(srcRow[x] > cutoff) << (x % 64);
+        }
+        if (src.cols % 64) {
+            dstRow[fullWords] = bits;
+        }
+    }
+    return thresholdValue;
+}
+
+// Erosion on bits: AND, out-of-image pixels are 1 so they never clear a pixel
+struct ErodeBits {
+    static constexpr uint64_t fill = ~uint64_t(0);
+    static inline uint64_t apply(uint64_t a, uint64_t b) { return a & b; }
+};
+
+// Dilation on bits: OR, out-of-image pixels are 0 so they never set a pixel
+struct DilateBits {
+    static constexpr uint64_t fill = 0;
+    static inline uint64_t apply(uint64_t a, uint64_t b) { return a | b; }
+};
+
+/**
+ * @brief Shift a packed row by whole pixels. shift > 0 gives out[x] = in[x + shift],
+ *        shift < 0 gives out[x] = in[x - |shift|]; pixels shifted in from outside are Op::fill.
+ */
+template <class Op>
+static void shiftRow(const uint64_t* in, uint64_t* out, int words, int shift) {
+    auto word = [&](int i) { return (i >= 0 && i < words) ? in[i] : Op::fill; };
+    int distance = abs(shift);
+    int wordShift = distance / 64, bitShift = distance % 64;
+
+    for (int w = 0; w < words; w++) {
+        if (shift > 0) {
+            uint64_t low = word(w + wordShift), high = word(w + wordShift + 1);
+            out[w] = bitShift ? (low >> bitShift) | (high << (64 - bitShift)) : low;
+        } else {
+            uint64_t high = word(w - wordShift), low = word(w - wordShift - 1);
+            out[w] = bitShift ? (high << bitShift) | (low >> (64 - bitShift)) : high;
+        }
+    }
+}
+
+/**
+ * @brief Combine a window of `length` pixels along a row, starting at x and going in
+ *        `direction` (+1 right, -1 left). Window doubling: log2(length) shift+op passes.
+ */
+template <class Op>
+static void windowRow(const uint64_t* in, uint64_t* out, uint64_t* shifted, int words, int length, int direction) {
+    copy(in, in + words, out);
+    int covered = 1;
+    while (covered < length) {
+        int step = min(covered, length - covered);  // Overlapping windows are fine, Op is idempotent
+        shiftRow<Op>(out, shifted, words, direction * step);
+        for (int w = 0; w < words; w++) {
+            out[w] = Op::apply(out[w], shifted[w]);
+        }
+        covered += step;
+    }
+}
+
+/**
+ * @brief Combine a window of `length` rows starting at y and going in `direction`, in place.
+ *        Rows outside the image are Op::fill, which leaves the other operand unchanged.
+ */
+template <class Op>
+static void windowColumns(PackedBinaryImage& image, int length, int direction) {
+    int covered = 1;
+    while (covered < length) {
+        int step = min(covered, length - covered);
+        // Walk toward the rows being read so every source row is still unmodified
+        for (int i = 0; i < image.rows; i++) {
+            int y = (direction > 0) ? i : image.rows - 1 - i;
+            int source = y + direction * step;
+            if (source < 0 || source >= image.rows) continue;
+            uint64_t* dstRow = image.row(y);
+            const uint64_t* srcRow = image.row(source);
+            for (int w = 0; w < image.wordsPerRow; w++) {
+                dstRow[w] = Op::apply(dstRow[w], srcRow[w]);
+            }
+        }
+        covered += step;
+    }
+}
+
+/**
+ * @brief Rectangular filter anchored at the kernel center. Each axis is split into the part
+ *        left/above the anchor and the part right/below it, both computed by window doubling.
+ *        src and dst may be the same image: the result is built in scratch and swapped in.
+ */
+template <class Op>
+static void filterPacked(const PackedBinaryImage& src, PackedBinaryImage& dst, Size kernel,
+                         PackedMorphScratch& scratch) {
+    int words = src.wordsPerRow;
+    uint64_t tail = src.tailMask();
+    PackedBinaryImage& result = scratch.result;
+    result.create(src.rows, src.cols);
+
+    // Horizontal: [x - anchor, x] combined with [x, x + width - 1 - anchor]
+    int anchorX = kernel.width / 2;
+    vector<uint64_t>& padded = scratch.padded;
+    vector<uint64_t>& backward = scratch.backward;
+    vector<uint64_t>& forward = scratch.forward;
+    vector<uint64_t>& shifted = scratch.shifted;
+    padded.resize(words);
+    backward.resize(words);
+    forward.resize(words);
+    shifted.resize(words);
+    for (int y = 0; y < src.rows; y++) {
+        copy(src.row(y), src.row(y) + words, padded.begin());
+        padded[words - 1] |= Op::fill & ~tail;  // Columns past the image behave as outside pixels
+        windowRow<Op>(padded.data(), backward.data(), shifted.data(), words, anchorX + 1, -1);
+        windowRow<Op>(padded.data(), forward.data(), shifted.data(), words, kernel.width - anchorX, +1);
+
+        uint64_t* dstRow = result.row(y);
+        for (int w = 0; w < words; w++) {
+            dstRow[w] = Op::apply(backward[w], forward[w]);
+        }
+        dstRow[words - 1] &= tail;
+    }
+
+    // Vertical: same split over rows
+    int anchorY = kernel.height / 2;
+    if (kernel.height > 1) {
+        PackedBinaryImage& above = scratch.above;
+        above = result;  // Reuses the buffer of the previous frame
+        windowColumns<Op>(above, anchorY + 1, -1);
+        windowColumns<Op>(result, kernel.height - anchorY, +1);
+        for (size_t i = 0; i < result.words.size(); i++) {
+            result.words[i] = Op::apply(result.words[i], above.words[i]);
+        }
+    }
+
+    swap(dst, result);  // Both buffers stay allocated for the next filter
+}
+
+// Word-parallel rectangular erosion, pixels outside the image are ignored
+int erodePacked(const PackedBinaryImage& src, PackedBinaryImage& dst, Size kernel) {
+    PackedMorphScratch scratch;
+    return erodePacked(src, dst, kernel, scratch);
+}
+
+int erodePacked(const PackedBinaryImage& src, PackedBinaryImage& dst, Size kernel, PackedMorphScratch& scratch) {
+    if (src.empty() || kernel.width < 1 || kernel.height < 1) {
+        cerr << "Error: Invalid input in erodePacked" << endl;
+        return -1;
+    }
+    filterPacked<ErodeBits>(src, dst, kernel, scratch);
+    return 0;
+}
+
+// Word-parallel rectangular dilation, pixels outside the image are ignored
+int dilatePacked(const PackedBinaryImage& src, PackedBinaryImage& dst, Size kernel) {
+    PackedMorphScratch scratch;
+    return dilatePacked(src, dst, kernel, scratch);
+}
+
+int dilatePacked(const PackedBinaryImage& src, PackedBinaryImage& dst, Size kernel, PackedMorphScratch& scratch) {
+    if (src.empty() || kernel.width < 1 || kernel.height < 1) {
+        cerr << "Error: Invalid input in dilatePacked" << endl;
+        return -1;
+    }
+    filterPacked<DilateBits>(src, dst, kernel, scratch);
+    return 0;
+}
+
+// Same steps as applyMorphologicalFiltering on a packed image
+void applyMorphologicalFilteringPacked(const PackedBinaryImage& src, PackedBinaryImage& dst,
+                                       const vector<MorphStep>& steps) {
+    PackedMorphScratch scratch;
+    applyMorphologicalFilteringPacked(src, dst, steps, scratch);
+}
+
+// Same as above with caller-owned scratch buffers: the steps run in place on scratch.current
+void applyMorphologicalFilteringPacked(const PackedBinaryImage& src, PackedBinaryImage& dst,
+                                       const vector<MorphStep>& steps, PackedMorphScratch& scratch) {
+    PackedBinaryImage& current = scratch.current;
+    current = src;  // Reuses the buffer of the previous frame
+    for (const MorphStep& step : steps) {
+        switch (step.op) {
+            case MorphOp::ERODE:
+                erodePacked(current, current, step.kernel, scratch);
+                break;
+            case MorphOp::DILATE:
+                dilatePacked(current, current, step.kernel, scratch);
+                break;
+            case MorphOp::OPEN:
+                erodePacked(current, current, step.kernel, scratch);
+                dilatePacked(current, current, step.kernel, scratch);
+                break;
+            case MorphOp::CLOSE:
+                dilatePacked(current, current, step.kernel, scratch);
+                erodePacked(current, current, step.kernel, scratch);
+                break;
+        }
+    }
+    swap(dst, current);
+}
+
+// Collect the foreground runs of every row, in raster order. Runs are found a word at a time
+// with count-trailing-zeros, so empty background costs one compare per 64 pixels.
+void extractRuns(const PackedBinaryImage& binary, vector<PixelRun>& runs) {
+    runs.clear();
+    for (int y = 0; y < binary.rows; y++) {
+        const uint64_t* row = binary.row(y);
+        int runStart = -1;  // Start of a run still open at the end of the previous word
+
+        for (int w = 0; w < binary.wordsPerRow; w++) {
+            uint64_t bits = row[w];
+            int base = w * 64;
+            int bit = 0;
+            while (bit < 64) {
+                if (runStart < 0) {
+                    uint64_t ones = bits >> bit;
+                    if (!ones) break;  // No more foreground in this word
+                    bit += __builtin_ctzll(ones);
+                    runStart = base + bit;
+                }
+                uint64_t zeros = ~bits >> bit;
+                if (!zeros) break;  // Run continues into the next word
+                bit += __builtin_ctzll(zeros);
+                runs.push_back({y, runStart, base + bit, 0});
+                runStart = -1;
+            }
+        }
+        if (runStart >= 0) {
+            runs.push_back({y, runStart, binary.cols, 0});
+        }
+    }
+}
+
+// Find with path halving
+static int findRun(vector<int>& parent, int x) {
+    while (parent[x] != x) {
+        parent[x] = parent[parent[x]];
+        x = parent[x];
+    }
+    return x;
+}
+
+// Union that keeps the smallest run index as root, i.e. the first run in raster order
+static void uniteRuns(vector<int>& parent, int a, int b) {
+    a = findRun(parent, a);
+    b = findRun(parent, b);
+    if (a == b) return;
+    if (a < b) parent[b] = a;
+    else parent[a] = b;
+}
+
+/**
+ * @brief Label runs into connected regions.
+ *        Runs of consecutive rows are merged when they overlap (4-connectivity) or touch
+ *        diagonally (8-connectivity). Regions smaller than minRegionSize, and regions touching
+ *        the image border when removeBoundary is set, are dropped.
+ * @param runs Runs in raster order, their label is set (0 for dropped regions).
+ * @param size Image size.
+ * @param regionMap Labeled region map (CV_32S), regions numbered 1..N in raster order.
+ * @param stats Optional per-region statistics, accumulated while writing the map.
+ * @return number of regions
+ */
+int labelRuns(vector<PixelRun>& runs, Size size, Mat& regionMap, int minRegionSize,
+              bool eightConnectivity, bool removeBoundary, vector<RegionStats>* stats,
+              LabelScratch* scratch) {
+    int numRuns = static_cast<int>(runs.size());
+    LabelScratch local;
+    LabelScratch& work = scratch ? *scratch : local;
+    vector<int>& parent = work.parent;
+    parent.resize(numRuns);
+    iota(parent.begin(), parent.end(), 0);
+
+    // ** Merge overlapping runs of consecutive rows **
+    int reach = eightConnectivity ? 1 : 0;  // Extra columns a run reaches into the previous row
+    int prevBegin = 0, prevEnd = 0;
+    for (int i = 0; i < numRuns;) {
+        int row = runs[i].row;
+        int rowEnd = i;
+        while (rowEnd < numRuns && runs[rowEnd].row == row) rowEnd++;
+
+        if (prevEnd == prevBegin || runs[prevBegin].row != row - 1) {
+            prevBegin = prevEnd = i;  // Previous row has no runs
+        }
+        int p = prevBegin;
+        for (int c = i; c < rowEnd; c++) {
+            while (p < prevEnd && runs[p].end + reach <= runs[c].start) p++;
+            for (int q = p; q < prevEnd && runs[q].start < runs[c].end + reach; q++) {
+                uniteRuns(parent, q, c);
+            }
+        }
+        prevBegin = i;
+        prevEnd = rowEnd;
+        i = rowEnd;
+    }
+
+    // ** Region size and boundary contact, accumulated on the roots **
+    vector<int>& regionSize = work.regionSize;
+    vector<uchar>& touchesBoundary = work.touchesBoundary;
+    regionSize.assign(numRuns, 0);
+    touchesBoundary.assign(numRuns, 0);
+    for (int i = 0; i < numRuns; i++) {
+        const PixelRun& run = runs[i];
+        int root = findRun(parent, i);
+        regionSize[root] += run.end - run.start;
+        if (run.row == 0 || run.row == size.height - 1 || run.start == 0 || run.end == size.width) {
+            touchesBoundary[root] = 1;
+        }
+    }
+
+    // ** Sequential labels; roots are the first run of their region, so this is raster order **
+    vector<int>& relabel = work.relabel;
+    relabel.assign(numRuns, 0);
+    int newLabel = 1;
+    for (int i = 0; i < numRuns; i++) {
+        if (parent[i] == i && regionSize[i] >= minRegionSize && !(removeBoundary && touchesBoundary[i])) {
+            relabel[i] = newLabel++;
+        }
+    }
+
+    if (stats) {
+        stats->assign(newLabel - 1, RegionStats());
+        for (int i = 0; i < numRuns; i++) {
+            if (relabel[i]) {
+                RegionStats& region = (*stats)[relabel[i] - 1];
+                region.label = relabel[i];
+                region.touchesBoundary = touchesBoundary[i];
+            }
+        }
+    }
+
+    // ** Write the region map (and statistics) **
+    regionMap.create(size, CV_32S);
+    regionMap.setTo(0);
+    for (int i = 0; i < numRuns; i++) {
+        PixelRun& run = runs[i];
+        run.label = relabel[findRun(parent, i)];
+        if (run.label) {
+            int* regionRow = regionMap.ptr<int>(run.row);
+            fill(regionRow + run.start, regionRow + run.end, run.label);
+            if (stats) {
+                accumulateRun((*stats)[run.label - 1], run);
+            }
+        }
+    }
+
+    return newLabel - 1;  // Return number of valid regions
+}
+
+// Run-based segmentation of a packed image with 4-connectivity
+int segmentPacked4conn(const PackedBinaryImage& binary, Mat& regionMap, int minRegionSize) {
+    if (binary.empty()) {
+        cerr << "ERROR: segmentPacked4conn - empty image" << endl;
+        return -1;
+    }
+    vector<PixelRun> runs;
+    extractRuns(binary, runs);
+    return labelRuns(runs, Size(binary.cols, binary.rows), regionMap, minRegionSize, false, false);
+}
+
+// Run-based segmentation of a packed image with 8-connectivity, boundary regions removed
+int segmentPacked8conn(const PackedBinaryImage& binary, Mat& regionMap, int minRegionSize) {
+    if (binary.empty()) {
+        cerr << "ERROR: segmentPacked8conn - empty image" << endl;
+        return -1;
+    }
+    vector<PixelRun> runs;
+    extractRuns(binary, runs);
+    return labelRuns(runs, Size(binary.cols, binary.rows), regionMap, minRegionSize, true, true);
+}
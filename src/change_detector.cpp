@@ -0,0 +1,63 @@
+/*
+ * Authors: Yuyang Tian and Arun Mekkad
+ * Date: 2025/2/24
+ * Purpose: Cheap frame-change detection on downsampled frames
+ */
+
+#include "../include/change_detector.h"
+#include <iostream>
+
+ChangeDetector::ChangeDetector(int downsample, int pixelThreshold, float changedFraction, int maxSkippedFrames)
+        : downsample(max(1, downsample)), pixelThreshold(pixelThreshold), changedFraction(changedFraction),
+          maxSkippedFrames(maxSkippedFrames) {}
+
+void ChangeDetector::setSensitivity(int newPixelThreshold, float newChangedFraction) {
+    pixelThreshold = newPixelThreshold;
+    changedFraction = newChangedFraction;
+    reset();
+}
+
+void ChangeDetector::reset() {
+    reference.release();
+}
+
+/**
+ * @brief Decide whether a frame differs from the last processed one. Every step (area
+ *        downsampling, gray conversion, absolute difference, comparison) is a single vectorized
+ *        OpenCV pass over at most 1/downsample^2 of the pixels, and area averaging also
+ *        suppresses sensor noise.
+ * @param frame The captured BGR (or gray) frame.
+ * @return true if the frame has to go through the pipeline
+ */
+bool ChangeDetector::hasChanged(const Mat& frame) {
+    seen++;
+    if (frame.empty()) {
+        cerr << "Error: empty frame in ChangeDetector" << endl;
+        return true;
+    }
+    Size smallSize(max(1, frame.cols / downsample), max(1, frame.rows / downsample));
+    resize(frame, small, smallSize, 0, 0, INTER_AREA);
+    if (small.channels() == 3) {
+        cvtColor(small, gray, COLOR_BGR2GRAY);
+    } else {
+        small.copyTo(gray);
+    }
+
+    bool changed = reference.empty() || reference.size() != gray.size()
+                   || (maxSkippedFrames > 0 && skippedInRow >= maxSkippedFrames);
+    if (!changed) {
+        absdiff(gray, reference, diff);
+        int limit = static_cast<int>(changedFraction * diff.total());
+        threshold(diff, diff, pixelThreshold, 255, THRESH_BINARY);
+        changed = countNonZero(diff) > limit;
+    }
+
+    if (changed) {
+        swap(reference, gray);  // New reference, the old buffer is reused next frame
+        skippedInRow = 0;
+    } else {
+        skipped++;
+        skippedInRow++;
+    }
+    return changed;
+}
@@ -5,6 +5,7 @@
  */
 
 #include "../include/classifier.h"
+#include "../include/nn_index.h"
 #include <vector>
 #include <iostream>
 #include <cmath>
@@ -16,7 +17,7 @@ using namespace std;
  * @param the current object features vector
  * @return the closest label
  */
-string classifyByDecisionTree(const vector<float>& features) {
+string classifyByDecisionTree(const ObjectFeatures& features) {
     if (features[0] <= 0.403538){
         if (features[1] <= 1.408385) {
             if (features[4] <= 4.194975) {
@@ -43,56 +44,59 @@ string classifyByDecisionTree(const vector<float>& features) {
         }
     }
 }
-// Compute standard deviation for each feature
-vector<float> computeFeatureStdDevs(const vector<pair<string, vector<float>>>& dbFeatures) {
-    if (dbFeatures.empty()) return {};
-
-    size_t featureSize = dbFeatures[0].second.size();
-    vector<float> stdevs(featureSize, 0.0f);
-
-    for (size_t i = 0; i < featureSize; ++i) {
-        float sum = 0.0f, sum_sq = 0.0f;
-        for (const auto& entry : dbFeatures) {
-            sum += entry.second[i];
-            sum_sq += entry.second[i] * entry.second[i];
-        }
-        float mean = sum / dbFeatures.size();
-        float variance = (sum_sq / dbFeatures.size()) - (mean * mean);
-        stdevs[i] = sqrt(variance);
-    }
-    return stdevs;
+// Standard deviation of each feature, from the running statistics the training set keeps: O(dims)
+ObjectFeatures computeFeatureStdDevs(const TrainingSet& dbFeatures) {
+    return dbFeatures.stats().stdDevs();
 }
 
-// Compute scaled Euclidean distance
-float calculateScaledEuclideanDistance(const vector<float>& v1, const vector<float>& v2, const vector<float>& stdevs) {
+// Compute scaled Euclidean distance; the loop has a constant trip count and unrolls
+float calculateScaledEuclideanDistance(const ObjectFeatures& v1, const ObjectFeatures& v2, const ObjectFeatures& stdevs) {
     float distance = 0.0f;
-    for (size_t i = 0; i < v1.size(); ++i) {
+    for (size_t i = 0; i < FEATURE_DIMS; ++i) {
         float scaled_diff = (v1[i] - v2[i]) / (stdevs[i] + 1e-6); // Avoid division by zero
         distance += scaled_diff * scaled_diff;
     }
     return sqrt(distance);
 }
 
-/**
-* Decided by Nearest neighbor
-* @param dbFeatures all training data
-* @param features the current object features vector
-* @return the closest label
-*/
-string classifyByNN(const vector<pair<string, vector<float>>>& dbFeatures, const vector<float>& features) {
-    if (dbFeatures.empty()) return "Unknown";
-    vector<float> stdevs = computeFeatureStdDevs(dbFeatures);
-
+// Nearest neighbor with precomputed feature standard deviations
+static string nearestLabel(const TrainingSet& dbFeatures, const ObjectFeatures& features,
+                           const ObjectFeatures& stdevs) {
     string closestLabel = "Unknown";
     float minDistance = numeric_limits<float>::max();
 
-    for (const auto& entry : dbFeatures) {
-        float distance = calculateScaledEuclideanDistance(features, entry.second, stdevs);
+    for (size_t i = 0; i < dbFeatures.size(); i++) {
+        float distance = calculateScaledEuclideanDistance(features, dbFeatures.features()[i], stdevs);
         if (distance < minDistance) {
             minDistance = distance;
-            closestLabel = entry.first;
+            closestLabel = dbFeatures.labels()[i];
         }
     }
 
     return (minDistance > 5.0f) ? "Unknown" : closestLabel;
 }
+
+/**
+* Decided by Nearest neighbor
+* @param dbFeatures all training data
+* @param features the current object features vector
+* @return the closest label
+*/
+string classifyByNN(const TrainingSet& dbFeatures, const ObjectFeatures& features) {
+    if (dbFeatures.empty()) return "Unknown";
+    return nearestLabel(dbFeatures, features, computeFeatureStdDevs(dbFeatures));
+}
+
+/**
+* Nearest neighbor for a batch of objects, through a temporary NNIndex
+* (keep an NNIndex around instead when the training data does not change between batches)
+* @param dbFeatures all training data
+* @param batch the feature vectors of every object in the frame
+* @return the closest label of each object
+*/
+vector<string> classifyBatchByNN(const TrainingSet& dbFeatures, const vector<ObjectFeatures>& batch) {
+    if (dbFeatures.empty()) return vector<string>(batch.size(), "Unknown");
+    NNIndex index;
+    index.build(dbFeatures);
+    return index.classifyBatch(batch);
+}
@@ -0,0 +1,295 @@
+/*
+ * Authors: Yuyang Tian and Arun Mekkad
+ * Date: 2025/3/5
+ * Purpose: CART decision tree trainer and flattened tree inference
+ */
+
+#include "../include/decision_tree.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <numeric>
+#include <random>
+#include <unordered_map>
+
+static const string UNKNOWN = "Unknown";
+static const char MAGIC[4] = {'P', '3', 'D', 'T'};
+static const uint32_t VERSION = 1;
+
+// Node waiting to be split: its position in the node array and its samples
+struct PendingNode {
+    int node;
+    int begin, end;  // Range of the sample order
+    int depth;
+};
+
+/**
+ * @brief CART: nodes are split breadth first; each split is the feature and threshold with the
+ *        lowest weighted Gini impurity of the two halves, over every position between two distinct
+ *        sorted values. Leaves take the majority label (lowest label ID on ties). With
+ *        options.featuresPerSplit set, each split only looks at that many randomly drawn features,
+ *        and draws more only if none of them separates the samples.
+ */
+int growTree(const TrainingSet& data, const vector<int>& sampleLabels, int classes,
+             vector<int> samples, const TreeOptions& options, vector<TreeNode>& nodes, vector<int32_t>& leafLabels) {
+    const size_t dims = FEATURE_DIMS;
+    int minSamplesLeaf = max(1, options.minSamplesLeaf);
+    size_t featureDraws = (options.featuresPerSplit > 0) ? min(dims, static_cast<size_t>(options.featuresPerSplit)) : dims;
+    mt19937 rng(options.seed);
+    vector<int> features(dims);
+    iota(features.begin(), features.end(), 0);
+
+    nodes.assign(1, TreeNode());
+    leafLabels.assign(1, -1);
+    int treeDepth = 0;
+    vector<int> sorted;
+    vector<int> total(classes), left(classes);
+    vector<PendingNode> queue = {{0, 0, static_cast<int>(samples.size()), 0}};
+
+    for (size_t q = 0; q < queue.size(); q++) {
+        PendingNode pending = queue[q];
+        int n = pending.end - pending.begin;
+        fill(total.begin(), total.end(), 0);
+        for (int i = pending.begin; i < pending.end; i++) total[sampleLabels[samples[i]]]++;
+        int majority = static_cast<int>(max_element(total.begin(), total.end()) - total.begin());
+        bool pure = total[majority] == n;
+
+        int bestFeature = -1;
+        float bestThreshold = 0;
+        double bestScore = -1;  // sum over halves of sum(count^2) / size, higher is purer
+        if (!pure && pending.depth < options.maxDepth && n >= 2 * minSamplesLeaf) {
+            sorted.assign(samples.begin() + pending.begin, samples.begin() + pending.end);
+            for (size_t draw = 0; draw < dims && (draw < featureDraws || bestFeature < 0); draw++) {
+                if (featureDraws < dims) {
+                    // Partial Fisher-Yates shuffle: features[0, draw] is a random subset
+                    swap(features[draw], features[draw + rng() % (dims - draw)]);
+                }
+                int f = features[draw];
+                sort(sorted.begin(), sorted.end(), [&](int a, int b) { return data.features()[a][f] < data.features()[b][f]; });
+                fill(left.begin(), left.end(), 0);
+                double leftSquares = 0, rightSquares = 0;
+                for (int c = 0; c < classes; c++) rightSquares += static_cast<double>(total[c]) * total[c];
+                for (int i = 1; i < n; i++) {
+                    // Move sample i - 1 to the left half, updating sum(count^2) incrementally
+                    int label = sampleLabels[sorted[i - 1]];
+                    leftSquares += 2.0 * left[label] + 1;
+                    rightSquares -= 2.0 * (total[label] - left[label]) - 1;
+                    left[label]++;
+                    float low = data.features()[sorted[i - 1]][f], high = data.features()[sorted[i]][f];
+                    if (!(low < high) || i < minSamplesLeaf || n - i < minSamplesLeaf) continue;
+                    double score = leftSquares / i + rightSquares / (n - i);
+                    if (score > bestScore) {
+                        bestScore = score;
+                        bestFeature = f;
+                        bestThreshold = low + (high - low) / 2;
+                        if (bestThreshold >= high) bestThreshold = low;  // Rounding must keep low on the left
+                    }
+                }
+            }
+        }
+
+        if (bestFeature < 0) {
+            // Leaf: loops back to itself, so every prediction takes the same number of steps
+            nodes[pending.node] = {numeric_limits<float>::infinity(), 0, pending.node};
+            leafLabels[pending.node] = majority;
+            continue;
+        }
+        int children = static_cast<int>(nodes.size());
+        nodes[pending.node] = {bestThreshold, bestFeature, children};
+        nodes.resize(children + 2);
+        leafLabels.resize(children + 2, -1);
+        int middle = static_cast<int>(partition(samples.begin() + pending.begin, samples.begin() + pending.end, [&](int s) {
+            return data.features()[s][bestFeature] <= bestThreshold;
+        }) - samples.begin());
+        queue.push_back({children, pending.begin, middle, pending.depth + 1});
+        queue.push_back({children + 1, middle, pending.end, pending.depth + 1});
+        treeDepth = max(treeDepth, pending.depth + 1);
+    }
+    return treeDepth;
+}
+
+/**
+ * @brief Train one CART tree on all samples (see growTree).
+ * @param data labeled feature vectors (e.g. from DBManager::loadFeatureVectors)
+ * @param maxDepth maximum depth of the tree
+ * @param minSamplesLeaf minimum samples in each leaf
+ * @return -1 on invalid data, 0 on success
+ */
+int DecisionTree::train(const TrainingSet& data, int maxDepth, int minSamplesLeaf) {
+    if (data.empty()) {
+        cerr << "Error: no training data for the decision tree" << endl;
+        return -1;
+    }
+    labels.clear();
+    unordered_map<string, int> labelIds;
+    vector<int> sampleLabels(data.size());
+    for (size_t i = 0; i < data.size(); i++) {
+        auto inserted = labelIds.emplace(data.labels()[i], static_cast<int>(labels.size()));
+        if (inserted.second) labels.push_back(data.labels()[i]);
+        sampleLabels[i] = inserted.first->second;
+    }
+
+    TreeOptions options;
+    options.maxDepth = maxDepth;
+    options.minSamplesLeaf = minSamplesLeaf;
+    vector<int> samples(data.size());
+    iota(samples.begin(), samples.end(), 0);
+    treeDepth = growTree(data, sampleLabels, static_cast<int>(labels.size()), std::move(samples), options, nodes,
+                         leafLabels);
+    return 0;
+}
+
+int DecisionTree::predict(const ObjectFeatures& features) const {
+    if (nodes.empty()) {
+        return -1;
+    }
+    int node = 0;
+    for (int step = 0; step < treeDepth; step++) {
+        const TreeNode& current = nodes[node];
+        node = current.next + (features[current.feature] > current.threshold);
+    }
+    return leafLabels[node];
+}
+
+const string& DecisionTree::labelName(int id) const {
+    return (id >= 0 && id < static_cast<int>(labels.size())) ? labels[id] : UNKNOWN;
+}
+
+string DecisionTree::classify(const ObjectFeatures& features) const {
+    return labelName(predict(features));
+}
+
+/**
+ * @brief Batched inference: blocks of rows advance one level at a time, so the independent
+ *        node loads of different rows overlap instead of waiting on each other.
+ * @param features one feature vector per row, CV_32FC1
+ * @param labelIds output label ID per row, -1 if the tree is empty or the row size is wrong
+ */
+void DecisionTree::predictBatch(const Mat& features, vector<int>& labelIds) const {
+    labelIds.assign(features.rows, -1);
+    if (nodes.empty() || features.type() != CV_32FC1 || static_cast<size_t>(features.cols) != FEATURE_DIMS) {
+        return;
+    }
+    const int BLOCK = 16;
+    int current[BLOCK];
+    const float* rows[BLOCK];
+    for (int first = 0; first < features.rows; first += BLOCK) {
+        int count = min(BLOCK, features.rows - first);
+        for (int r = 0; r < count; r++) {
+            current[r] = 0;
+            rows[r] = features.ptr<float>(first + r);
+        }
+        for (int step = 0; step < treeDepth; step++) {
+            for (int r = 0; r < count; r++) {
+                const TreeNode& node = nodes[current[r]];
+                current[r] = node.next + (rows[r][node.feature] > node.threshold);
+            }
+        }
+        for (int r = 0; r < count; r++) {
+            labelIds[first + r] = leafLabels[current[r]];
+        }
+    }
+}
+
+vector<string> DecisionTree::classifyBatch(const vector<ObjectFeatures>& batch) const {
+    vector<string> result(batch.size(), UNKNOWN);
+    vector<int> labelIds;
+    predictBatch(featureMatrix(batch), labelIds);
+    for (size_t i = 0; i < batch.size(); i++) {
+        result[i] = labelName(labelIds[i]);
+    }
+    return result;
+}
+
+/**
+ * @brief Save the model: "P3DT", version, feature count, depth, nodes (threshold, feature, next,
+ *        leaf label) and label names, host byte order.
+ * @param path model file
+ * @return -1 failure, 0 success
+ */
+int DecisionTree::save(const string& path) const {
+    ofstream out(path, ios::binary);
+    if (!out) {
+        cerr << "Error: cannot write decision tree " << path << endl;
+        return -1;
+    }
+    uint32_t header[4] = {VERSION, static_cast<uint32_t>(FEATURE_DIMS), static_cast<uint32_t>(treeDepth),
+                          static_cast<uint32_t>(nodes.size())};
+    out.write(MAGIC, sizeof(MAGIC));
+    out.write(reinterpret_cast<const char*>(header), sizeof(header));
+    for (size_t i = 0; i < nodes.size(); i++) {
+        out.write(reinterpret_cast<const char*>(&nodes[i].threshold), sizeof(float));
+        out.write(reinterpret_cast<const char*>(&nodes[i].feature), sizeof(int32_t));
+        out.write(reinterpret_cast<const char*>(&nodes[i].next), sizeof(int32_t));
+        out.write(reinterpret_cast<const char*>(&leafLabels[i]), sizeof(int32_t));
+    }
+    uint32_t labelCount = static_cast<uint32_t>(labels.size());
+    out.write(reinterpret_cast<const char*>(&labelCount), sizeof(labelCount));
+    for (const string& label : labels) {
+        uint32_t length = static_cast<uint32_t>(label.size());
+        out.write(reinterpret_cast<const char*>(&length), sizeof(length));
+        out.write(label.data(), length);
+    }
+    if (!out) {
+        cerr << "Error: failed writing decision tree " << path << endl;
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Load a model written by save(); the current tree is kept if the file is invalid.
+ * @param path model file
+ * @return -1 failure, 0 success
+ */
+int DecisionTree::load(const string& path) {
+    ifstream in(path, ios::binary);
+    if (!in) {
+        cerr << "Error: cannot open decision tree " << path << endl;
+        return -1;
+    }
+    char magic[4];
+    uint32_t header[4] = {};
+    bool ok = in.read(magic, sizeof(magic)) && memcmp(magic, MAGIC, sizeof(MAGIC)) == 0
+              && in.read(reinterpret_cast<char*>(header), sizeof(header)) && header[0] == VERSION
+              && header[1] == FEATURE_DIMS && header[3] > 0 && header[3] < (1u << 24);
+    vector<TreeNode> loadedNodes(ok ? header[3] : 0);
+    vector<int32_t> loadedLeaves(loadedNodes.size());
+    for (size_t i = 0; ok && i < loadedNodes.size(); i++) {
+        ok = in.read(reinterpret_cast<char*>(&loadedNodes[i].threshold), sizeof(float))
+             && in.read(reinterpret_cast<char*>(&loadedNodes[i].feature), sizeof(int32_t))
+             && in.read(reinterpret_cast<char*>(&loadedNodes[i].next), sizeof(int32_t))
+             && in.read(reinterpret_cast<char*>(&loadedLeaves[i]), sizeof(int32_t));
+    }
+    uint32_t labelCount = 0;
+    ok = ok && in.read(reinterpret_cast<char*>(&labelCount), sizeof(labelCount)) && labelCount < 65536;
+    vector<string> loadedLabels;
+    for (uint32_t i = 0; ok && i < labelCount; i++) {
+        uint32_t length = 0;
+        ok = in.read(reinterpret_cast<char*>(&length), sizeof(length)) && length < 4096;
+        string label(ok ? length : 0, '\0');
+        ok = ok && in.read(&label[0], length);
+        loadedLabels.push_back(label);
+    }
+    // Every step must stay inside the array: a leaf loops back to itself whatever the feature value
+    // (threshold +infinity) and names a label, a split has both children in the array
+    for (size_t i = 0; ok && i < loadedNodes.size(); i++) {
+        const TreeNode& node = loadedNodes[i];
+        bool leaf = loadedLeaves[i] >= 0;
+        ok = node.feature >= 0 && static_cast<uint32_t>(node.feature) < header[1] && node.next >= 0
+             && (leaf ? static_cast<size_t>(node.next) == i && node.threshold == numeric_limits<float>::infinity()
+                            && loadedLeaves[i] < static_cast<int32_t>(labelCount)
+                      : static_cast<size_t>(node.next) + 1 < loadedNodes.size());
+    }
+    if (!ok) {
+        cerr << "Error: invalid decision tree " << path << endl;
+        return -1;
+    }
+    nodes.swap(loadedNodes);
+    leafLabels.swap(loadedLeaves);
+    labels.swap(loadedLabels);
+    treeDepth = static_cast<int>(header[2]);
+    return 0;
+}
@@ -3,8 +3,8 @@
  * Authors: Yuyang Tian and Arun Mekkad
  * Date: 2025/2/16
  * Purpose: Train a Decision tree using sklearn decision tree
- * MANDATORY: run it to generate a new decision tree and
- *            replace the `classifyByDecisionTree` function in `classifiers.cpp` when the training data changes
+ * NOTE: the camera app now trains the same tree in C++ (src/decision_tree.cpp) from the database;
+ *       this script only regenerates the built-in fallback `classifyByDecisionTree` in `classifier.cpp`
  *
  */
 """
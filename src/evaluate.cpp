@@ -10,16 +10,20 @@
 #include <random>
 #include "../include/evaluate.h"
 #include "../include/classifier.h"  // Contains classifyByNN, and classifyByDecisionTree
+#include "../include/nn_index.h"
+#include "../include/decision_tree.h"
+#include "../include/random_forest.h"
 
 using namespace std;
 using namespace cv;
 
     // Evaluate confusion matrix: group data by label, select 3 random samples per label for test,
-    // classify each test sample using the specified classifier (0 = NN, 1 = Decision Tree),
-    // and print the confusion matrix.
-    void evaluateConfusionMatrix(int classifierType) {
+    // classify each test sample using the specified classifier (0 = NN, 1 = Decision Tree, 2 = Random Forest),
+    // and print the confusion matrix. NN test samples are classified as one k-NN batch; the decision tree
+    // and random forest are trained on the training split only.
+    void evaluateConfusionMatrix(int classifierType, int k) {
         DBManager db;
-        vector<pair<string, vector<float>>> dbFeatures;
+        TrainingSet dbFeatures;
         db.loadFeatureVectors(dbFeatures);
         if (dbFeatures.empty()) {
             cerr << "No feature data loaded from the database." << endl;
@@ -33,13 +37,13 @@ using namespace cv;
             {"tea bag", 3},
             {"socks", 4}
         };
-        // Group samples by label
-        unordered_map<string, vector<pair<string, vector<float>>>> groupedData;
-        for (const auto &sample : dbFeatures) {
-            groupedData[sample.first].push_back(sample);
+        // Group sample positions by label
+        unordered_map<string, vector<size_t>> groupedData;
+        for (size_t i = 0; i < dbFeatures.size(); i++) {
+            groupedData[dbFeatures.labels()[i]].push_back(i);
         }
-        vector<pair<string, vector<float>>> trainData;
-        vector<pair<string, vector<float>>> testData;
+        TrainingSet trainData;
+        TrainingSet testData;
         random_device rd;
         default_random_engine g(rd());
         // For each label, randomly select 3 samples for testing; the remaining are used for training
@@ -49,9 +53,8 @@ using namespace cv;
                 continue;
             shuffle(vec.begin(), vec.end(), g);
             size_t testCount = (vec.size() >= 3) ? 3 : vec.size();
-            testData.insert(testData.end(), vec.begin(), vec.begin() + testCount);
-            if (vec.size() > testCount) {
-                trainData.insert(trainData.end(), vec.begin() + testCount, vec.end());
+            for (size_t i = 0; i < vec.size(); i++) {
+                (i < testCount ? testData : trainData).push_back(dbFeatures.labels()[vec[i]], dbFeatures.features()[vec[i]]);
             }
         }
         if (trainData.empty()) {
@@ -60,14 +63,31 @@ using namespace cv;
         }
         // Set up a 5x5 confusion matrix (rows: true labels, cols: predicted labels)
         vector<vector<int>> confusionMatrix(5, vector<int>(5, 0));
+        vector<string> nnLabels;
+        if (classifierType == 0) {
+            NNIndex index;
+            index.build(trainData);
+            nnLabels = index.classifyBatch(testData.features(), k);  // The test block is the batch
+        }
+        DecisionTree tree;
+        if (classifierType == 1) {
+            tree.train(trainData);
+        }
+        RandomForest forest;
+        if (classifierType == 2) {
+            forest.train(trainData);
+        }
         // For each test sample, classify and update the corresponding cell in the matrix
-        for (const auto &sample : testData) {
-            string trueLabel = sample.first;
+        for (size_t i = 0; i < testData.size(); i++) {
+            const ObjectFeatures &sample = testData.features()[i];
+            string trueLabel = testData.labels()[i];
             string predicted;
             if (classifierType == 0) {
-                predicted = classifyByNN(trainData, sample.second);
+                predicted = nnLabels[i];
             } else if (classifierType == 1) {
-                predicted = classifyByDecisionTree(sample.second);
+                predicted = tree.empty() ? classifyByDecisionTree(sample) : tree.classify(sample);
+            } else if (classifierType == 2) {
+                predicted = forest.classify(sample);
             } else {
                 predicted = "Unknown";
             }
@@ -79,7 +99,8 @@ using namespace cv;
         }
         // Print the confusion matrix
         cout << "Confusion Matrix (True vs. Predicted) using "
-             << ((classifierType == 0) ? "NN" : "Decision Tree") << " classifier:\n";
+             << ((classifierType == 0) ? (k > 1 ? to_string(k) + "-NN" : "NN")
+                 : (classifierType == 2) ? "Random Forest" : "Decision Tree") << " classifier:\n";
         for (int i = 0; i < 5; i++) {
             for (int j = 0; j < 5; j++) {
                 cout << confusionMatrix[i][j] << "\t";
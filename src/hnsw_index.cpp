@@ -0,0 +1,484 @@
+/*
+ * Authors: Yuyang Tian and Arun Mekkad
+ * Date: 2025/3/4
+ * Purpose: Approximate nearest neighbor search with a hierarchical navigable small world graph
+ */
+
+#include "../include/hnsw_index.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+static const char MAGIC[4] = {'P', '3', 'H', 'N'};
+static const uint32_t VERSION = 2;  // 2: training set fingerprint in the header
+
+// Search state of the calling thread, reused between queries: visited marks (a new epoch clears
+// them in O(1)) and the storage of both heaps
+struct SearchScratch {
+    vector<uint32_t> marks;
+    uint32_t epoch = 0;
+    vector<pair<float, int>> candidates;  // Min-heap
+    vector<pair<float, int>> best;        // Max-heap
+
+    void reset(size_t size) {
+        if (marks.size() < size) {
+            marks.assign(size, 0);
+            epoch = 0;
+        }
+        if (++epoch == 0) {
+            fill(marks.begin(), marks.end(), 0);
+            epoch = 1;
+        }
+    }
+    bool visit(int node) {
+        if (marks[node] == epoch) return false;
+        marks[node] = epoch;
+        return true;
+    }
+};
+static thread_local SearchScratch scratch;
+
+// Squared distance; the loop has a constant trip count and unrolls
+float HNSWIndex::distance(const ObjectFeatures& a, const ObjectFeatures& b) {
+    float sum = 0.0f;
+    for (size_t d = 0; d < FEATURE_DIMS; d++) {
+        float diff = a[d] - b[d];
+        sum += diff * diff;
+    }
+    return sum;
+}
+
+int* HNSWIndex::links(int node, int level) {
+    return level == 0 ? &bottomLinks[static_cast<size_t>(node) * (1 + 2 * M)]
+                      : &upperLinks[node][static_cast<size_t>(level - 1) * (1 + M)];
+}
+
+const int* HNSWIndex::links(int node, int level) const {
+    return const_cast<HNSWIndex*>(this)->links(node, level);
+}
+
+// Move to the closest linked node until no link is closer
+int HNSWIndex::greedyClosest(const ObjectFeatures& query, int entry, int level) const {
+    int current = entry;
+    float currentDistance = distance(query, point(current));
+    bool improved = true;
+    while (improved) {
+        improved = false;
+        const int* list = links(current, level);
+        for (int i = 1; i <= list[0]; i++) {
+            float d = distance(query, point(list[i]));
+            if (d < currentDistance) {
+                currentDistance = d;
+                current = list[i];
+                improved = true;
+            }
+        }
+    }
+    return current;
+}
+
+/**
+ * @brief Beam search on one layer: expand the closest unexpanded candidate until it is farther
+ *        than the worst of the beam best nodes found so far.
+ * @param result The best nodes, nearest first.
+ */
+void HNSWIndex::searchLayer(const ObjectFeatures& query, int entry, int beam, int level, vector<Candidate>& result) const {
+    scratch.reset(count);
+    vector<Candidate>& candidates = scratch.candidates;
+    vector<Candidate>& best = scratch.best;
+    candidates.clear();
+    best.clear();
+    float entryDistance = distance(query, point(entry));
+    candidates.emplace_back(entryDistance, entry);
+    best.emplace_back(entryDistance, entry);
+    scratch.visit(entry);
+
+    while (!candidates.empty()) {
+        Candidate current = candidates.front();
+        if (current.first > best.front().first && static_cast<int>(best.size()) >= beam) {
+            break;
+        }
+        pop_heap(candidates.begin(), candidates.end(), greater<Candidate>());
+        candidates.pop_back();
+        const int* list = links(current.second, level);
+        for (int i = 1; i <= list[0]; i++) {
+            int neighbor = list[i];
+            if (!scratch.visit(neighbor)) continue;
+            float d = distance(query, point(neighbor));
+            if (static_cast<int>(best.size()) < beam || d < best.front().first) {
+                candidates.emplace_back(d, neighbor);
+                push_heap(candidates.begin(), candidates.end(), greater<Candidate>());
+                best.emplace_back(d, neighbor);
+                push_heap(best.begin(), best.end());
+                if (static_cast<int>(best.size()) > beam) {
+                    pop_heap(best.begin(), best.end());
+                    best.pop_back();
+                }
+            }
+        }
+    }
+    sort_heap(best.begin(), best.end());  // Nearest first
+    result.assign(best.begin(), best.end());
+}
+
+// Keep a candidate only if it is closer to the node than to every kept one, so links spread out
+void HNSWIndex::selectNeighbors(vector<Candidate>& candidates, int limit) const {
+    if (static_cast<int>(candidates.size()) <= limit) return;
+    sort(candidates.begin(), candidates.end());
+    vector<Candidate> kept;
+    for (const Candidate& candidate : candidates) {
+        if (static_cast<int>(kept.size()) == limit) break;
+        bool diverse = true;
+        for (const Candidate& other : kept) {
+            if (distance(point(candidate.second), point(other.second)) < candidate.first) {
+                diverse = false;
+                break;
+            }
+        }
+        if (diverse) kept.push_back(candidate);
+    }
+    candidates.swap(kept);
+}
+
+void HNSWIndex::insert(int node, int level) {
+    levels[node] = level;
+    upperLinks[node].assign(static_cast<size_t>(level) * (1 + M), 0);
+    if (entryPoint < 0) {
+        entryPoint = node;
+        maxLevel = level;
+        return;
+    }
+    const ObjectFeatures& query = point(node);
+    int current = entryPoint;
+    for (int l = maxLevel; l > level; l--) {
+        current = greedyClosest(query, current, l);
+    }
+    vector<Candidate> found, neighborLinks;
+    for (int l = min(level, maxLevel); l >= 0; l--) {
+        searchLayer(query, current, efConstruction, l, found);
+        current = found[0].second;
+        vector<Candidate> selected = found;
+        selectNeighbors(selected, M);
+        int* list = links(node, l);
+        list[0] = static_cast<int>(selected.size());
+        for (size_t i = 0; i < selected.size(); i++) {
+            list[1 + i] = selected[i].second;
+        }
+        // Link back; a full neighbor re-selects its links among the old ones and the new node
+        for (const Candidate& neighbor : selected) {
+            int* back = links(neighbor.second, l);
+            if (back[0] < maxLinks(l)) {
+                back[1 + back[0]++] = node;
+                continue;
+            }
+            const ObjectFeatures& neighborPoint = point(neighbor.second);
+            neighborLinks.clear();
+            neighborLinks.emplace_back(neighbor.first, node);
+            for (int i = 1; i <= back[0]; i++) {
+                neighborLinks.emplace_back(distance(neighborPoint, point(back[i])), back[i]);
+            }
+            selectNeighbors(neighborLinks, maxLinks(l));
+            back[0] = static_cast<int>(neighborLinks.size());
+            for (size_t i = 0; i < neighborLinks.size(); i++) {
+                back[1 + i] = neighborLinks[i].second;
+            }
+        }
+    }
+    if (level > maxLevel) {
+        entryPoint = node;
+        maxLevel = level;
+    }
+}
+
+/**
+ * @brief Normalize the training set with the scaling of classifyByNN and insert every entry.
+ *        Layers are drawn from a fixed-seed generator, so a build is reproducible.
+ * @param dbFeatures all training data
+ * @param M links per node on the upper layers
+ * @param efConstruction beam width while inserting
+ */
+void HNSWIndex::build(const TrainingSet& dbFeatures, int M, int efConstruction) {
+    this->M = max(2, M);
+    this->efConstruction = max(this->M, efConstruction);
+    count = dbFeatures.size();
+    maxLevel = -1;
+    entryPoint = -1;
+    points.assign(count, ObjectFeatures());
+    levels.assign(count, 0);
+    bottomLinks.assign(count * (1 + 2 * this->M), 0);
+    upperLinks.assign(count, vector<int>());
+    normalize(dbFeatures);
+    sourceFingerprint = fingerprint(dbFeatures);
+    if (count == 0) return;
+
+    for (size_t i = 0; i < count; i++) {
+        points[i] = scaled(dbFeatures.features()[i]);
+    }
+
+    // Layer of a node: floor(-ln(U) / ln(M)), so each layer holds ~1/M of the one below
+    unsigned randomState = 5330;
+    double levelScale = 1.0 / log(static_cast<double>(this->M));
+    for (size_t i = 0; i < count; i++) {
+        randomState = randomState * 1664525u + 1013904223u;
+        double uniform = ((randomState >> 8) + 1.0) / 16777217.0;
+        int level = static_cast<int>(-log(uniform) * levelScale);
+        insert(static_cast<int>(i), level);
+    }
+}
+
+void HNSWIndex::setEfSearch(int ef) {
+    this->ef = max(1, ef);
+}
+
+int HNSWIndex::nearestEntry(const ObjectFeatures& features, float* distance) const {
+    if (count == 0) {
+        return -1;
+    }
+    ObjectFeatures q = scaled(features);
+    int current = entryPoint;
+    for (int l = maxLevel; l > 0; l--) {
+        current = greedyClosest(q, current, l);
+    }
+    vector<Candidate> found;
+    searchLayer(q, current, ef, 0, found);
+    if (distance) {
+        *distance = sqrt(found[0].first);
+    }
+    return found[0].second;
+}
+
+/**
+ * @brief Approximate nearest neighbor label with the "Unknown" cutoff of classifyByNN.
+ * @param features the current object features vector
+ * @param distance optional output, distance of the match
+ * @return label ID, -1 if the index is empty or the match is farther than MAX_DISTANCE
+ */
+int HNSWIndex::nearest(const ObjectFeatures& features, float* distance) const {
+    float matchDistance = 0.0f;
+    int entry = nearestEntry(features, &matchDistance);
+    if (entry < 0 || matchDistance > MAX_DISTANCE) {
+        return -1;
+    }
+    if (distance) {
+        *distance = matchDistance;
+    }
+    return entryLabels[entry];
+}
+
+// 64-bit FNV-1a over raw bytes
+static uint64_t hashBytes(uint64_t hash, const void* data, size_t size) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ bytes[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+uint64_t HNSWIndex::fingerprint(const TrainingSet& dbFeatures) {
+    uint64_t hash = 14695981039346656037ull;
+    uint64_t size = dbFeatures.size();
+    hash = hashBytes(hash, &size, sizeof(size));
+    for (size_t i = 0; i < dbFeatures.size(); i++) {
+        const string& label = dbFeatures.labels()[i];
+        uint32_t length = static_cast<uint32_t>(label.size());  // Keeps "ab" + "c" apart from "a" + "bc"
+        hash = hashBytes(hash, &length, sizeof(length));
+        hash = hashBytes(hash, label.data(), label.size());
+        hash = hashBytes(hash, dbFeatures.features()[i].data(), FEATURE_DIMS * sizeof(float));
+    }
+    return hash;
+}
+
+// Raw little helpers for the index file
+template <class T>
+static void writeValue(ofstream& out, const T& value) {
+    out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+template <class T>
+static void writeArray(ofstream& out, const vector<T>& values) {
+    writeValue(out, static_cast<uint64_t>(values.size()));
+    out.write(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+}
+template <class T>
+static bool readValue(ifstream& in, T& value) {
+    return static_cast<bool>(in.read(reinterpret_cast<char*>(&value), sizeof(T)));
+}
+// The stored size must be the one implied by the header, so a corrupt size never reaches resize()
+template <class T>
+static bool readArray(ifstream& in, vector<T>& values, uint64_t expectedSize) {
+    uint64_t size = 0;
+    if (!readValue(in, size) || size != expectedSize) return false;
+    values.resize(size);
+    return static_cast<bool>(in.read(reinterpret_cast<char*>(values.data()), size * sizeof(T)));
+}
+// Feature vectors are stored as a packed float array (without the alignment padding)
+static void writeFeatures(ofstream& out, const ObjectFeatures* vectors, size_t count) {
+    writeValue(out, static_cast<uint64_t>(count * FEATURE_DIMS));
+    for (size_t i = 0; i < count; i++) {
+        out.write(reinterpret_cast<const char*>(vectors[i].data()), FEATURE_DIMS * sizeof(float));
+    }
+}
+// Bytes between the read position and the end of the file
+static uint64_t remainingBytes(ifstream& in) {
+    streampos position = in.tellg();
+    in.seekg(0, ios::end);
+    streampos end = in.tellg();
+    in.seekg(position);
+    return position >= 0 && end >= position ? static_cast<uint64_t>(end - position) : 0;
+}
+static bool readFeatures(ifstream& in, ObjectFeatures* vectors, size_t count) {
+    uint64_t size = 0;
+    if (!readValue(in, size) || size != count * FEATURE_DIMS) return false;
+    for (size_t i = 0; i < count; i++) {
+        if (!in.read(reinterpret_cast<char*>(vectors[i].data()), FEATURE_DIMS * sizeof(float))) return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Save the index: "P3HN", version, training set fingerprint, sizes and parameters, then the
+ *        arrays (host byte order).
+ * @param path index file
+ * @return -1 failure, 0 success
+ */
+int HNSWIndex::save(const string& path) const {
+    ofstream out(path, ios::binary);
+    if (!out) {
+        cerr << "Error: cannot write HNSW index " << path << endl;
+        return -1;
+    }
+    out.write(MAGIC, sizeof(MAGIC));
+    writeValue(out, VERSION);
+    writeValue(out, sourceFingerprint);
+    writeValue(out, static_cast<uint64_t>(count));
+    writeValue(out, static_cast<uint64_t>(FEATURE_DIMS));
+    writeValue(out, static_cast<int32_t>(M));
+    writeValue(out, static_cast<int32_t>(efConstruction));
+    writeValue(out, static_cast<int32_t>(maxLevel));
+    writeValue(out, static_cast<int32_t>(entryPoint));
+    writeFeatures(out, &scale, 1);
+    writeFeatures(out, points.data(), points.size());
+    writeArray(out, entryLabels);
+    writeValue(out, static_cast<uint64_t>(labels.size()));
+    for (const string& label : labels.all()) {
+        writeValue(out, static_cast<uint32_t>(label.size()));
+        out.write(label.data(), label.size());
+    }
+    writeArray(out, levels);
+    writeArray(out, bottomLinks);
+    for (const vector<int>& nodeLinks : upperLinks) {
+        writeArray(out, nodeLinks);
+    }
+    if (!out) {
+        cerr << "Error: failed writing HNSW index " << path << endl;
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Check every size and node ID of a loaded graph, so a damaged file cannot make a query read
+ *        out of bounds: link counts and targets, layers of linked nodes, label IDs, entry point and top layer.
+ * @return true if the graph is consistent
+ */
+bool HNSWIndex::validGraph(size_t labelCount) const {
+    if (M < 2 || M > MAX_M || points.size() != count || entryLabels.size() != count || levels.size() != count
+        || bottomLinks.size() != count * (1 + 2 * M) || upperLinks.size() != count) {
+        return false;
+    }
+    if (count == 0) {
+        return maxLevel == -1 && entryPoint == -1;
+    }
+    if (entryPoint < 0 || static_cast<size_t>(entryPoint) >= count || maxLevel < 0 || maxLevel > MAX_LEVEL
+        || levels[entryPoint] != maxLevel) {
+        return false;
+    }
+    for (size_t node = 0; node < count; node++) {
+        int level = levels[node];
+        if (entryLabels[node] < 0 || static_cast<size_t>(entryLabels[node]) >= labelCount
+            || level < 0 || level > maxLevel
+            || upperLinks[node].size() != static_cast<size_t>(level) * (1 + M)) {
+            return false;
+        }
+        for (int l = 0; l <= level; l++) {
+            const int* list = links(static_cast<int>(node), l);
+            if (list[0] < 0 || list[0] > maxLinks(l)) {
+                return false;
+            }
+            for (int i = 1; i <= list[0]; i++) {
+                if (list[i] < 0 || static_cast<size_t>(list[i]) >= count || levels[list[i]] < l) {
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Load an index written by save(). The graph is only swapped in after the header matches the
+ *        expected training set and validGraph() accepted it; otherwise the current index is kept.
+ * @param path index file
+ * @param expectedFingerprint fingerprint() of the current training data
+ * @return -1 failure, 0 success
+ */
+int HNSWIndex::load(const string& path, uint64_t expectedFingerprint) {
+    ifstream in(path, ios::binary);
+    if (!in) {
+        cerr << "Error: cannot open HNSW index " << path << endl;
+        return -1;
+    }
+    char magic[4];
+    uint32_t version = 0;
+    uint64_t fileFingerprint = 0, fileCount = 0, fileDims = 0, labelCount = 0;
+    int32_t fileM = 0, fileEfConstruction = 0, fileMaxLevel = 0, fileEntryPoint = 0;
+    bool ok = in.read(magic, sizeof(magic)) && memcmp(magic, MAGIC, sizeof(MAGIC)) == 0
+              && readValue(in, version) && version == VERSION && readValue(in, fileFingerprint);
+    if (ok && fileFingerprint != expectedFingerprint) {
+        cerr << "HNSW index " << path << " was built from other training data" << endl;
+        return -1;
+    }
+    HNSWIndex loaded;
+    ok = ok && readValue(in, fileCount) && readValue(in, fileDims) && fileDims == FEATURE_DIMS
+         && readValue(in, fileM) && fileM >= 2 && fileM <= MAX_M && readValue(in, fileEfConstruction)
+         && readValue(in, fileMaxLevel) && readValue(in, fileEntryPoint)
+         && readFeatures(in, &loaded.scale, 1)
+         && fileCount <= remainingBytes(in) / (FEATURE_DIMS * sizeof(float));  // Points must fit in the file
+    loaded.points.resize(ok ? fileCount : 0);
+    ok = ok && readFeatures(in, loaded.points.data(), loaded.points.size())
+         && readArray(in, loaded.entryLabels, fileCount)
+         && readValue(in, labelCount) && labelCount <= fileCount;
+    for (uint64_t i = 0; ok && i < labelCount; i++) {
+        uint32_t length = 0;
+        ok = readValue(in, length) && length < 4096;
+        string label(ok ? length : 0, '\0');
+        ok = ok && in.read(&label[0], length)
+             && loaded.labels.intern(label) == static_cast<int>(i);  // Names are unique
+    }
+    ok = ok && readArray(in, loaded.levels, fileCount)
+         && readArray(in, loaded.bottomLinks, fileCount * (1 + 2 * static_cast<uint64_t>(fileM)));
+    loaded.upperLinks.resize(ok ? fileCount : 0);
+    for (uint64_t i = 0; ok && i < fileCount; i++) {
+        int level = loaded.levels[i];
+        ok = level >= 0 && level <= MAX_LEVEL
+             && readArray(in, loaded.upperLinks[i], static_cast<uint64_t>(level) * (1 + fileM));
+    }
+    if (ok) {
+        loaded.count = fileCount;
+        loaded.M = fileM;
+        loaded.efConstruction = fileEfConstruction;
+        loaded.maxLevel = fileMaxLevel;
+        loaded.entryPoint = fileEntryPoint;
+        loaded.sourceFingerprint = fileFingerprint;
+        ok = loaded.validGraph(labelCount);
+    }
+    if (!ok) {
+        cerr << "Error: invalid HNSW index " << path << endl;
+        return -1;
+    }
+    loaded.ef = ef;
+    *this = move(loaded);
+    return 0;
+}
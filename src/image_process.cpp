@@ -9,7 +9,112 @@
 #include <vector>
 #include <cmath>
 #include <algorithm>
-#include <unordered_set>
+#include <cstdint>
+#include <opencv2/core/hal/intrin.hpp>
+
+// Reference per-pixel BGR -> HSV conversion in float. This is the original conversion and
+// defines the exact output the fixed-point path below has to reproduce.
+static inline void bgrPixelToHsvReference(const uchar* bgr, uchar* hsv) {
+    // Scale BGR values from 0 to 1
+    float B = bgr[0] / 255.0f;
+    float G = bgr[1] / 255.0f;
+    float R = bgr[2] / 255.0f;
+
+    // Value
+    float V = max({R, G, B});
+
+    // Saturation
+    float S = 0.0f;
+
+    if (V > 0) {
+        float minVal = min({R, G, B});
+        S = (V - minVal) / V;
+    }
+
+    // Hue
+    float H = 0.0f;
+
+    if (S > 0) {
+        float maxVal = V;
+        float minVal = min({R, G, B});
+        float delta = maxVal - minVal;
+
+        if (R == maxVal) {
+            H = 60.0f * (G - B) / delta;
+        } else if (G == maxVal) {
+            H = 60.0f * (2 + (B - R) / delta);
+        } else { // B == maxVal
+            H = 60.0f * (4 + (R - G) / delta);
+        }
+
+        if (H < 0) {
+            H += 360.0f;
+        }
+    }
+
+    // Set HSV values
+    hsv[0] = static_cast<uchar>((H / 2.0f));   // OpenCV H is in [0, 180]
+    hsv[1] = static_cast<uchar>(S * 255);   // S is in [0, 255]
+    hsv[2] = static_cast<uchar>(V * 255);   // V is in [0, 255]
+}
+
+// Reciprocals ceil(2^32 / d) for d in [1, 255]. For numerators below 2^16 (all hue and
+// saturation numerators are) (t * recip[d]) >> 32 == t / d exactly.
+static const uint64_t* divisionTable() {
+    static const vector<uint64_t> table = [] {
+        vector<uint64_t> t(256, 0);
+        for (uint64_t d = 1; d < 256; ++d) {
+            t[d] = ((uint64_t(1) << 32) + d - 1) / d;
+        }
+        return t;
+    }();
+    return table.data();
+}
+
+// Fixed-point HSV for a single row. The integer results equal the float reference except when
+// a division is exact, where float rounding may land just below the integer; those (rare)
+// pixels are recomputed with the reference so the output stays bit-compatible.
+static void bgrRowToHsvFixed(const uchar* src, uchar* dst, int cols, const uint64_t* recip) {
+    for (int x = 0; x < cols; ++x, src += 3, dst += 3) {
+        int b = src[0], g = src[1], r = src[2];
+        int maxVal = max({r, g, b});
+        int minVal = min({r, g, b});
+        int delta = maxVal - minVal;
+
+        if (delta == 0) { // Gray (or black) pixel: H = S = 0
+            dst[0] = 0;
+            dst[1] = 0;
+            dst[2] = static_cast<uchar>(maxVal);
+            continue;
+        }
+
+        // S = 255 * delta / V
+        uint32_t sNum = 255 * delta;
+        uint32_t s = static_cast<uint32_t>((sNum * recip[maxVal]) >> 32);
+
+        // H / 2 = base + 30 * diff / delta, wrapped into [0, 180]
+        int hNum;
+        if (r == maxVal) {
+            hNum = 30 * (g - b);
+        } else if (g == maxVal) {
+            hNum = 60 * delta + 30 * (b - r);
+        } else {
+            hNum = 120 * delta + 30 * (r - g);
+        }
+        if (hNum < 0) {
+            hNum += 180 * delta;
+        }
+        uint32_t h = static_cast<uint32_t>((static_cast<uint64_t>(hNum) * recip[delta]) >> 32);
+
+        if (s * maxVal == sNum || h * delta == static_cast<uint32_t>(hNum)) {
+            bgrPixelToHsvReference(src, dst); // Exact division, defer to float rounding
+            continue;
+        }
+        dst[0] = static_cast<uchar>(h);
+        dst[1] = static_cast<uchar>(s);
+        dst[2] = static_cast<uchar>(maxVal);
+    }
+}
 
 // Convert BGR image to HSV
 void bgr_to_hsv(const Mat& src, Mat& dst) {
@@ -22,183 +127,184 @@ void bgr_to_hsv(const Mat& src, Mat& dst) {
     // Create the destination image
     dst.create(src.size(), CV_8UC3);
 
-    // Image properties
-    int rows = src.rows;
+    const uint64_t* recip = divisionTable();
     int cols = src.cols;
 
-    // Pointers to image data
-    const uchar* src_data = src.data;
-    uchar* dst_data = dst.data;
-
-    // Steps through the rows and columns
-    size_t src_step = src.step;
-    size_t dst_step = dst.step;
+    // Rows are independent, split them across the OpenCV thread pool
+    parallel_for_(Range(0, src.rows), [&](const Range& range) {
+        for (int y = range.start; y < range.end; ++y) {
+            bgrRowToHsvFixed(src.ptr<uchar>(y), dst.ptr<uchar>(y), cols, recip);
+        }
+    });
+}
 
-    // Cycle through the images and assign the appropriate values
-    for (int y = 0; y < rows; ++y) {
-        const uchar* src_row = src_data + y * src_step;
-        uchar* dst_row = dst_data + y * dst_step;
+// Fused BGR -> V conversion: writes the HSV value plane (max of B, G, R) without building the
+// 3-channel HSV image. Output is identical to channel 2 of bgr_to_hsv.
+void bgr_to_value(const Mat& src, Mat& dst) {
+    // Check if the input image is valid
+    if (src.empty() || src.type() != CV_8UC3) {
+        cerr << "Error: Invalid input image in bgr_to_value" << endl;
+        return;
+    }
 
-        for (int x = 0; x < cols; ++x) {
-            // Scale BGR values from 0 to 1
-            float B = src_row[x * 3 + 0] / 255.0f;
-            float G = src_row[x * 3 + 1] / 255.0f;
-            float R = src_row[x * 3 + 2] / 255.0f;
+    dst.create(src.size(), CV_8UC1);
 
-            // Value
-            float V = max({R, G, B});
+    int rows = src.rows;
+    int cols = src.cols;
+    if (src.isContinuous() && dst.isContinuous()) { // Treat the image as one long row
+        cols *= rows;
+        rows = 1;
+    }
 
-            // Saturation
-            float S = 0.0f;
+    for (int y = 0; y < rows; ++y) {
+        const uchar* src_row = src.ptr<uchar>(y);
+        uchar* dst_row = dst.ptr<uchar>(y);
+        int x = 0;
+#if CV_SIMD
+        const int lanes = v_uint8::nlanes;
+        for (; x <= cols - lanes; x += lanes) {
+            v_uint8 b, g, r;
+            v_load_deinterleave(src_row + x * 3, b, g, r);
+            v_store(dst_row + x, v_max(v_max(b, g), r));
+        }
+#endif
+        for (; x < cols; ++x) {
+            const uchar* p = src_row + x * 3;
+            dst_row[x] = max({p[0], p[1], p[2]});
+        }
+    }
+}
 
-            if (V > 0) {
-                float minVal = min({R, G, B});
-                S = (V - minVal) / V;
-            }
+// Compute the 256-bin histogram of a CV_8UC1 image. Four interleaved sub-histograms are
+// used so consecutive equal pixels do not serialize on the same counter.
+void computeHistogram(const Mat& src, int hist[256]) {
+    int sub[4][256] = {};
 
-            // Hue
-            float H = 0.0f;
-
-            if (S > 0) {
-                float maxVal = V;
-                float minVal = min({R, G, B});
-                float delta = maxVal - minVal;
-
-                if (R == maxVal) {
-                    H = 60.0f * (G - B) / delta;
-                } else if (G == maxVal) {
-                    H = 60.0f * (2 + (B - R) / delta);
-                } else { // B == maxVal
-                    H = 60.0f * (4 + (R - G) / delta);
-                }
-
-                if (H < 0) {
-                    H += 360.0f;
-                }
-            }
+    int rows = src.rows;
+    int cols = src.cols;
+    if (src.isContinuous()) { // Treat the image as one long row
+        cols *= rows;
+        rows = 1;
+    }
 
-            // Set HSV values
-            dst_row[x * 3 + 0] = static_cast<uchar>((H / 2.0f));   // OpenCV H is in [0, 180]
-            dst_row[x * 3 + 1] = static_cast<uchar>(S * 255);   // S is in [0, 255]
-            dst_row[x * 3 + 2] = static_cast<uchar>(V * 255);   // V is in [0, 255]
+    for (int y = 0; y < rows; y++) {
+        const uchar* row = src.ptr<uchar>(y);
+        int x = 0;
+        for (; x <= cols - 4; x += 4) {
+            sub[0][row[x]]++;
+            sub[1][row[x + 1]]++;
+            sub[2][row[x + 2]]++;
+            sub[3][row[x + 3]]++;
+        }
+        for (; x < cols; x++) {
+            sub[0][row[x]]++;
         }
     }
-}
 
-// Function to calculate the mean of a vector
-float calculateMean(const vector<float>& data) {
-    if (data.empty()) return 0;
-    float sum = 0;
-    for (float val : data) {
-        sum += val;
+    for (int i = 0; i < 256; i++) {
+        hist[i] = sub[0][i] + sub[1][i] + sub[2][i] + sub[3][i];
     }
-    return sum / data.size();
 }
 
-// Function to perform ISODATA (K-Means with K=2) thresholding
-void threshold(const Mat& src, Mat& dst) {
-    // Check if the input image is valid
-    if (src.empty() || src.type() != CV_8UC1) {
-        cerr << "Error: Invalid input image in threshold" << endl;
-        return;
+/**
+ * @brief ISODATA (K-Means with K=2) threshold computed on a histogram.
+ *        Pixels below the threshold are background, the rest are object. Class means come
+ *        from prefix sums, so every iteration is O(1) after one O(256) setup.
+ * @param hist 256-bin histogram.
+ * @param initialThreshold Starting threshold, e.g. the previous frame's result.
+ * @return the converged threshold
+ */
+float isodataThreshold(const int hist[256], float initialThreshold) {
+    // Prefix pixel counts and intensity sums: bins [0, i) hold count[i] pixels summing to sum[i]
+    int64_t count[257], sum[257];
+    count[0] = sum[0] = 0;
+    for (int i = 0; i < 256; i++) {
+        count[i + 1] = count[i] + hist[i];
+        sum[i + 1] = sum[i] + static_cast<int64_t>(hist[i]) * i;
     }
 
-    // Create the destination image (CV_8UC1)
-    dst.create(src.size(), CV_8UC1);
-
-    // 1. Initialization
-    float thresholdValue = 128; // Initial threshold
-    float oldThreshold;
-    bool converged = false;
-    int iteration = 0;
+    float thresholdValue = initialThreshold;
     int maxIterations = 50;
 
-    while (!converged && iteration < maxIterations) {
-        iteration++;
-        oldThreshold = thresholdValue;
-
-        // 2. Segmentation
-        vector<float> backgroundPixels, objectPixels;
-
-        // Use pointers for faster pixel access
-        uchar* src_data = src.data;
-        int src_step = src.step;
-
-        for (int y = 0; y < src.rows; y++) {
-            uchar* row = src_data + y * src_step; // Pointer to the beginning of the row
-            for (int x = 0; x < src.cols; x++) {
-                float pixelValue = row[x]; // Access pixel directly using pointer
-                if (pixelValue < thresholdValue) {
-                    backgroundPixels.push_back(pixelValue);
-                } else {
-                    objectPixels.push_back(pixelValue);
-                }
-            }
-        }
+    for (int iteration = 0; iteration < maxIterations; iteration++) {
+        float oldThreshold = thresholdValue;
 
-        // 3. Calculate new means
-        float backgroundMean = calculateMean(backgroundPixels);
-        float objectMean = calculateMean(objectPixels);
+        // Background is every bin strictly below the threshold
+        int split = min(256, max(0, static_cast<int>(ceil(thresholdValue))));
+        int64_t objectCount = count[256] - count[split];
+        int64_t objectSum = sum[256] - sum[split];
+
+        float backgroundMean = count[split] ? static_cast<float>(static_cast<double>(sum[split]) / count[split]) : 0;
+        float objectMean = objectCount ? static_cast<float>(static_cast<double>(objectSum) / objectCount) : 0;
 
-        // 4. Update threshold
         thresholdValue = (backgroundMean + objectMean) / 2.0f;
 
-        // 5. Check for convergence
         if (abs(thresholdValue - oldThreshold) < 0.5f) {
-            converged = true;
+            break; // Converged
         }
     }
+    return thresholdValue;
+}
 
-    // Apply final threshold
-    uchar* dst_data = dst.data;
-    int dst_step = dst.step;
-
-    for (int y = 0; y < src.rows; y++) {
-        const uchar* src_row = src.ptr<uchar>(y);
-        uchar* dst_row = dst_data + y * dst_step;
+/**
+ * @brief Otsu threshold computed on a histogram.
+ * @param hist 256-bin histogram.
+ * @return threshold t maximizing the between-class variance of [0, t] and (t, 255]
+ */
+float otsuThreshold(const int hist[256]) {
+    double total = 0, totalSum = 0;
+    for (int i = 0; i < 256; i++) {
+        total += hist[i];
+        totalSum += static_cast<double>(hist[i]) * i;
+    }
 
-        for (int x = 0; x < src.cols; x++) {
-           // Apply threshold using pointers for direct access
-            dst_row[x] = (src_row[x] > thresholdValue) ? 255 : 0;
+    double backgroundCount = 0, backgroundSum = 0;
+    double bestVariance = -1;
+    int bestThreshold = 0;
+
+    for (int t = 0; t < 256; t++) {
+        backgroundCount += hist[t];
+        backgroundSum += static_cast<double>(hist[t]) * t;
+        double objectCount = total - backgroundCount;
+        if (backgroundCount == 0 || objectCount == 0) continue;
+
+        double meanDiff = backgroundSum / backgroundCount - (totalSum - backgroundSum) / objectCount;
+        double variance = backgroundCount * objectCount * meanDiff * meanDiff;
+        if (variance > bestVariance) {
+            bestVariance = variance;
+            bestThreshold = t;
         }
     }
+    return static_cast<float>(bestThreshold);
 }
 
-// Clean up your thresholded image with morphological filtering
-void applyMorphologicalFiltering(const Mat& src, Mat& dst) {
-    // 1. Validation of image data (the source file)
+/**
+ * @brief Threshold image to separate foreground and background.
+ *        The histogram is built once per frame, the threshold search runs on it.
+ * @param src Input image (CV_8UC1).
+ * @param dst Output binary image (CV_8UC1, 0/255), 255 where src > threshold.
+ * @param initialThreshold ISODATA starting point (warm start from the previous frame).
+ * @param method ISODATA or OTSU.
+ * @return the threshold used, -1 on failure
+ */
+float threshold(const Mat& src, Mat& dst, float initialThreshold, ThresholdMethod method) {
+    // Check if the input image is valid
     if (src.empty() || src.type() != CV_8UC1) {
-        cerr << "Error: Source invalid" << endl;
-        return;
+        cerr << "Error: Invalid input image in threshold" << endl;
+        return -1;
     }
 
-    // 2. Destination Creation
-    dst = src.clone();
-
-    // 3. Assign structure and structure value. Based on the comments, the size is set to "1", this number was arrived at after multiple tests.
-    int morph_size = 1;
-    int elementHeight = 2 * morph_size + 1;
-    int elementWidth = 2 * morph_size + 1;
-    Mat element = getStructuringElement(
-        MORPH_RECT, Size(elementWidth, elementHeight), Point(morph_size, morph_size));
-
-    // 4. Loop through the array and generate the new morph matrix
-    for (int y = morph_size; y < src.rows - morph_size; ++y) {
-        for (int x = morph_size; x < src.cols - morph_size; ++x) {
-            //Apply structuring element
-            int local_min = 255;
-            for (int i = -morph_size; i <= morph_size; ++i) {
-                for (int j = -morph_size; j <= morph_size; ++j) {
-                    local_min = min(local_min, (int)src.at<uchar>(y + i, x + j));
-                }
-            }
+    int hist[256];
+    computeHistogram(src, hist);
 
-            //Erode and create image
-            dst.at<uchar>(y, x) = local_min;
-        }
-    }
-}
+    float thresholdValue = (method == ThresholdMethod::OTSU)
+                           ? otsuThreshold(hist)
+                           : isodataThreshold(hist, initialThreshold);
 
+    // Apply final threshold. Pixels are integers, so src > t is the same as src > floor(t)
+    cv::threshold(src, dst, floor(thresholdValue), 255, THRESH_BINARY);
+    return thresholdValue;
+}
 
 // Find function for Union-Find (Path Compression), return the root
 int find(vector<int>& parent, int x) {
@@ -236,7 +342,8 @@ int twoPassSegmentation4conn(const Mat& binaryImage, Mat& regionMap, int minRegi
     }
 
     int rows = binaryImage.rows, cols = binaryImage.cols;
-    regionMap = Mat::zeros(rows, cols, CV_32S); // Initialize output matrix
+    regionMap.create(rows, cols, CV_32S); // Initialize output matrix, reusing its buffer
+    regionMap.setTo(0);
 
     vector<int> parent(1, 0);  // Union-Find parent array
     int nextLabel = 1;         // Label counter
@@ -335,11 +442,12 @@ int twoPassSegmentation8conn(const Mat& binaryImage, Mat& regionMap, int minRegi
     }
 
     int rows = binaryImage.rows, cols = binaryImage.cols;
-    regionMap = Mat::zeros(rows, cols, CV_32S); // Initialize output matrix
+    regionMap.create(rows, cols, CV_32S); // Initialize output matrix, reusing its buffer
+    regionMap.setTo(0);
 
     vector<int> parent(1, 0);  // Union-Find parent array
     int nextLabel = 1;         // Label counter
-    unordered_set<int> boundaryLabels;  // Store labels touching the boundary
+    vector<uchar> boundaryLabels(1, 0);  // Flat bitmap of labels touching the boundary
     // ** First Pass: Label Assignment & Union-Find **
     for (int i = 0; i < rows; i++) {
         int* regionRow = regionMap.ptr<int>(i);
@@ -364,6 +472,7 @@ int twoPassSegmentation8conn(const Mat& binaryImage, Mat& regionMap, int minRegi
             if (minLabel == INT_MAX) { // No neighbors, assign a new label
                 regionRow[j] = nextLabel;
                 parent.push_back(nextLabel);
+                boundaryLabels.push_back(0);
                 nextLabel++;
             } else { // Assign the smallest existing label
                 regionRow[j] = minLabel;
@@ -375,7 +484,7 @@ int twoPassSegmentation8conn(const Mat& binaryImage, Mat& regionMap, int minRegi
             }
             // ** Track boundary labels **
             if (i == 0 || i == rows - 1 || j == 0 || j == cols - 1) {
-                boundaryLabels.insert(regionRow[j]);  // Mark region as touching boundary
+                boundaryLabels[regionRow[j]] = 1;  // Mark region as touching boundary
             }
         }
     }
@@ -393,12 +502,20 @@ int twoPassSegmentation8conn(const Mat& binaryImage, Mat& regionMap, int minRegi
         }
     }
 
+    // Boundary marks were set on provisional labels; move them to the final (root) labels
+    vector<uchar> boundaryRoots(nextLabel, 0);
+    for (int label = 1; label < nextLabel; label++) {
+        if (boundaryLabels[label]) {
+            boundaryRoots[find(parent, label)] = 1;
+        }
+    }
+
     // ** Third Pass: Remove Small & Boundary-Connected Regions **
     for (int i = 0; i < rows; i++) {
         int* regionRow = regionMap.ptr<int>(i);
         for (int j = 0; j < cols; j++) {
             int label = regionRow[j];
-            if (label > 0 && (labelSize[label] < minRegionSize || boundaryLabels.count(label))) {
+            if (label > 0 && (labelSize[label] < minRegionSize || boundaryRoots[label])) {
                 regionRow[j] = 0; // Remove small and boundary-connected regions
             }
         }
@@ -409,7 +526,7 @@ int twoPassSegmentation8conn(const Mat& binaryImage, Mat& regionMap, int minRegi
     int newLabel = 1;
 
     for (int i = 1; i < nextLabel; i++) {
-        if (labelSize[i] >= minRegionSize) {
+        if (labelSize[i] >= minRegionSize && !boundaryRoots[i]) {
             relabel[i] = newLabel++;
         }
     }
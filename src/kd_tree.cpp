@@ -0,0 +1,140 @@
+/*
+ * Authors: Yuyang Tian and Arun Mekkad
+ * Date: 2025/3/3
+ * Purpose: Exact k-d tree nearest neighbor index
+ */
+
+#include "../include/kd_tree.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+
+/**
+ * @brief Normalize the training set with the scaling of classifyByNN and build the tree.
+ * @param dbFeatures all training data
+ */
+void KDTreeIndex::build(const TrainingSet& dbFeatures) {
+    count = dbFeatures.size();
+    treeDepth = 0;
+    nodes.clear();
+    order.resize(count);
+    iota(order.begin(), order.end(), 0);
+    normalize(dbFeatures);
+    if (count == 0) {
+        points.clear();
+        return;
+    }
+
+    // Database order first, buildNode permutes whole rows (labels stay in database order)
+    points.resize(count);
+    for (size_t i = 0; i < count; i++) {
+        points[i] = scaled(dbFeatures.features()[i]);
+    }
+
+    nodes.reserve(2 * (count / LEAF_SIZE + 1));
+    buildNode(0, static_cast<int>(count), 1);
+}
+
+/**
+ * @brief Build the subtree over tree positions [begin, end): split at the median of the
+ *        dimension with the largest spread, so both halves shrink even on skewed data.
+ * @return index of the new node
+ */
+int KDTreeIndex::buildNode(int begin, int end, int level) {
+    treeDepth = max(treeDepth, level);
+    int nodeIndex = static_cast<int>(nodes.size());
+    nodes.push_back({-1, 0.0f, begin, end});
+    if (end - begin <= LEAF_SIZE) {
+        return nodeIndex;
+    }
+
+    int splitDim = 0;
+    float widest = -1.0f;
+    for (size_t d = 0; d < FEATURE_DIMS; d++) {
+        float low = numeric_limits<float>::max(), high = numeric_limits<float>::lowest();
+        for (int i = begin; i < end; i++) {
+            float v = points[i][d];
+            low = min(low, v);
+            high = max(high, v);
+        }
+        if (high - low > widest) {
+            widest = high - low;
+            splitDim = static_cast<int>(d);
+        }
+    }
+    if (widest <= 0.0f) {
+        return nodeIndex;  // All entries identical: one (large) leaf
+    }
+
+    // Median by position, then move whole rows into place
+    int middle = begin + (end - begin) / 2;
+    vector<int> positions(end - begin);
+    iota(positions.begin(), positions.end(), begin);
+    nth_element(positions.begin(), positions.begin() + (middle - begin), positions.end(), [&](int a, int b) {
+        return points[a][splitDim] < points[b][splitDim];
+    });
+    vector<ObjectFeatures> rows(positions.size());
+    vector<int> rowOrder(positions.size());
+    for (size_t k = 0; k < positions.size(); k++) {
+        rows[k] = points[positions[k]];
+        rowOrder[k] = order[positions[k]];
+    }
+    copy(rows.begin(), rows.end(), points.begin() + begin);
+    copy(rowOrder.begin(), rowOrder.end(), order.begin() + begin);
+
+    float splitValue = points[middle][splitDim];
+    int left = buildNode(begin, middle, level + 1);
+    int right = buildNode(middle, end, level + 1);
+    nodes[nodeIndex] = {splitDim, splitValue, left, right};
+    return nodeIndex;
+}
+
+// Depth first, nearer child first; a subtree is skipped when the splitting plane is farther than the best match
+void KDTreeIndex::search(int nodeIndex, const ObjectFeatures& query, Match& best) const {
+    const Node& node = nodes[nodeIndex];
+    if (node.splitDim < 0) {
+        for (int i = node.left; i < node.right; i++) {
+            const ObjectFeatures& point = points[i];
+            float sum = 0.0f;
+            for (size_t d = 0; d < FEATURE_DIMS; d++) {  // Constant trip count: unrolled, no early exit
+                float diff = query[d] - point[d];
+                sum += diff * diff;
+            }
+            if (sum < best.distance || (sum == best.distance && order[i] < best.entry)) {
+                best = {sum, order[i]};
+            }
+        }
+        return;
+    }
+    float diff = query[node.splitDim] - node.splitValue;
+    int nearChild = diff < 0 ? node.left : node.right;
+    int farChild = diff < 0 ? node.right : node.left;
+    search(nearChild, query, best);
+    if (diff * diff <= best.distance) {
+        search(farChild, query, best);
+    }
+}
+
+/**
+ * @brief Exact nearest entry by scaled Euclidean distance. The search starts from the
+ *        MAX_DISTANCE^2 cutoff, so distant queries prune most of the tree.
+ * @param features the current object features vector
+ * @param distance optional output, distance of the match
+ * @return label ID, -1 if the index is empty or nothing is within MAX_DISTANCE
+ */
+int KDTreeIndex::nearest(const ObjectFeatures& features, float* distance) const {
+    if (count == 0) {
+        return -1;
+    }
+    ObjectFeatures query = scaled(features);
+    Match best = {MAX_DISTANCE * MAX_DISTANCE, numeric_limits<int>::max()};
+    search(0, query, best);
+    if (best.entry == numeric_limits<int>::max()) {
+        return -1;
+    }
+    if (distance) {
+        *distance = sqrt(best.distance);
+    }
+    return entryLabels[best.entry];
+}
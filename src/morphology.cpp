@@ -0,0 +1,282 @@
+/*
+ * Authors: Yuyang Tian and Arun Mekkad
+ * Date: 2025/2/20
+ * Purpose: Morphological filtering with rectangular kernels (van Herk/Gil-Werman)
+ */
+
+#include "../include/image_process.h"
+#include <iostream>
+#include <vector>
+#include <sstream>
+#include <algorithm>
+#include <cstring>
+#include <opencv2/core/hal/intrin.hpp>
+
+// Erosion: min filter, out-of-image pixels never win
+struct ErodeOp {
+    static constexpr uchar identity = 255;
+    static inline uchar apply(uchar a, uchar b) { return min(a, b); }
+#if CV_SIMD
+    static inline v_uint8 apply(const v_uint8& a, const v_uint8& b) { return v_min(a, b); }
+#endif
+};
+
+// Dilation: max filter, out-of-image pixels never win
+struct DilateOp {
+    static constexpr uchar identity = 0;
+    static inline uchar apply(uchar a, uchar b) { return max(a, b); }
+#if CV_SIMD
+    static inline v_uint8 apply(const v_uint8& a, const v_uint8& b) { return v_max(a, b); }
+#endif
+};
+
+// dst[i] = Op(a[i], b[i]) for a whole row
+template <class Op>
+static void combineRows(const uchar* a, const uchar* b, uchar* dst, int n) {
+    int i = 0;
+#if CV_SIMD
+    const int lanes = v_uint8::nlanes;
+    for (; i <= n - lanes; i += lanes) {
+        v_store(dst + i, Op::apply(vx_load(a + i), vx_load(b + i)));
+    }
+#endif
+    for (; i < n; i++) {
+        dst[i] = Op::apply(a[i], b[i]);
+    }
+}
+
+/**
+ * @brief Horizontal van Herk/Gil-Werman pass. The padded row is split in blocks of k pixels,
+ *        each block gets a prefix (g) and suffix (h) running extremum, and every window of k
+ *        pixels is the combination of one suffix and one prefix: 3 operations per pixel for
+ *        any k.
+ */
+template <class Op>
+static void filterRowsVHGW(const Mat& src, Mat& dst, int k, int anchor, MorphScratch& scratch) {
+    int cols = src.cols;
+    int paddedLength = (cols + k - 1 + k - 1) / k * k;  // Padded row, rounded up to whole blocks
+    scratch.rowBuffer.resize(3 * static_cast<size_t>(paddedLength));
+    uchar* f = scratch.rowBuffer.data();
+    uchar* g = f + paddedLength;
+    uchar* h = g + paddedLength;
+
+    for (int y = 0; y < src.rows; y++) {
+        const uchar* srcRow = src.ptr<uchar>(y);
+        uchar* dstRow = dst.ptr<uchar>(y);
+
+        // Pad so that window [x - anchor, x - anchor + k) starts at f[x]
+        fill(f, f + anchor, Op::identity);
+        copy(srcRow, srcRow + cols, f + anchor);
+        fill(f + anchor + cols, f + paddedLength, Op::identity);
+
+        for (int start = 0; start < paddedLength; start += k) {
+            int end = start + k - 1;
+            g[start] = f[start];
+            for (int i = start + 1; i <= end; i++) {
+                g[i] = Op::apply(g[i - 1], f[i]);
+            }
+            h[end] = f[end];
+            for (int i = end - 1; i >= start; i--) {
+                h[i] = Op::apply(h[i + 1], f[i]);
+            }
+        }
+
+        for (int x = 0; x < cols; x++) {
+            dstRow[x] = Op::apply(h[x], g[x + k - 1]);
+        }
+    }
+}
+
+/**
+ * @brief Vertical van Herk/Gil-Werman pass. Same block decomposition as the horizontal pass
+ *        but over rows, so every step combines two whole image rows and vectorizes.
+ *        g and h are read only after src has been consumed, so dst may be src.
+ */
+template <class Op>
+static void filterColumnsVHGW(const Mat& src, Mat& dst, int k, int anchor, MorphScratch& scratch) {
+    int rows = src.rows, cols = src.cols;
+    int paddedRows = (rows + k - 1 + k - 1) / k * k;
+    size_t blockSize = static_cast<size_t>(paddedRows) * cols;
+    scratch.columnBuffer.resize(2 * blockSize);
+    Mat g(paddedRows, cols, CV_8UC1, scratch.columnBuffer.data());
+    Mat h(paddedRows, cols, CV_8UC1, scratch.columnBuffer.data() + blockSize);
+    vector<uchar>& identityRow = scratch.identityRow;
+    identityRow.assign(cols, Op::identity);
+
+    // Padded row p holds source row p - anchor, identity outside the image
+    auto paddedRow = [&](int p) -> const uchar* {
+        int y = p - anchor;
+        return (y >= 0 && y < rows) ? src.ptr<uchar>(y) : identityRow.data();
+    };
+
+    for (int start = 0; start < paddedRows; start += k) {
+        int end = start + k - 1;
+        memcpy(g.ptr<uchar>(start), paddedRow(start), cols);
+        for (int p = start + 1; p <= end; p++) {
+            combineRows<Op>(g.ptr<uchar>(p - 1), paddedRow(p), g.ptr<uchar>(p), cols);
+        }
+        memcpy(h.ptr<uchar>(end), paddedRow(end), cols);
+        for (int p = end - 1; p >= start; p--) {
+            combineRows<Op>(h.ptr<uchar>(p + 1), paddedRow(p), h.ptr<uchar>(p), cols);
+        }
+    }
+
+    for (int y = 0; y < rows; y++) {
+        combineRows<Op>(h.ptr<uchar>(y), g.ptr<uchar>(y + k - 1), dst.ptr<uchar>(y), cols);
+    }
+}
+
+// Separable rectangular filter: horizontal pass then vertical pass. Both passes copy their input
+// before writing, so dst may be src.
+template <class Op>
+static void filterRect(const Mat& src, Mat& dst, Size kernel, MorphScratch& scratch) {
+    Mat horizontal;
+    if (kernel.width > 1) {
+        scratch.horizontal.create(src.size(), CV_8UC1);
+        filterRowsVHGW<Op>(src, scratch.horizontal, kernel.width, kernel.width / 2, scratch);
+        horizontal = scratch.horizontal;
+    } else {
+        horizontal = src;
+    }
+
+    if (kernel.height > 1) {
+        dst.create(src.size(), CV_8UC1);
+        filterColumnsVHGW<Op>(horizontal, dst, kernel.height, kernel.height / 2, scratch);
+    } else if (horizontal.data != dst.data) {
+        horizontal.copyTo(dst);
+    }
+}
+
+// Erode with a rectangular kernel, anchored at its center. Pixels outside the image are ignored.
+int erodeRect(const Mat& src, Mat& dst, Size kernel, MorphScratch& scratch) {
+    if (src.empty() || src.type() != CV_8UC1 || kernel.width < 1 || kernel.height < 1) {
+        cerr << "Error: Invalid input in erodeRect" << endl;
+        return -1;
+    }
+    filterRect<ErodeOp>(src, dst, kernel, scratch);
+    return 0;
+}
+
+// Dilate with a rectangular kernel, anchored at its center. Pixels outside the image are ignored.
+int dilateRect(const Mat& src, Mat& dst, Size kernel, MorphScratch& scratch) {
+    if (src.empty() || src.type() != CV_8UC1 || kernel.width < 1 || kernel.height < 1) {
+        cerr << "Error: Invalid input in dilateRect" << endl;
+        return -1;
+    }
+    filterRect<DilateOp>(src, dst, kernel, scratch);
+    return 0;
+}
+
+int erodeRect(const Mat& src, Mat& dst, Size kernel) {
+    MorphScratch scratch;
+    return erodeRect(src, dst, kernel, scratch);
+}
+
+int dilateRect(const Mat& src, Mat& dst, Size kernel) {
+    MorphScratch scratch;
+    return dilateRect(src, dst, kernel, scratch);
+}
+
+// Clean up your thresholded image with a sequence of morphological operations
+void applyMorphologicalFiltering(const Mat& src, Mat& dst, const vector<MorphStep>& steps, MorphScratch& scratch) {
+    // 1. Validation of image data (the source file)
+    if (src.empty() || src.type() != CV_8UC1) {
+        cerr << "Error: Source invalid" << endl;
+        return;
+    }
+    if (steps.empty()) { // An empty sequence is a plain copy
+        if (src.data != dst.data) src.copyTo(dst);
+        return;
+    }
+
+    // 2. Run the steps in order, each one on the previous result. Intermediate results alternate
+    //    between the two scratch images and the last step writes straight into dst.
+    Mat current = src;
+    for (size_t i = 0; i < steps.size(); i++) {
+        const MorphStep& step = steps[i];
+        Mat& next = (i + 1 == steps.size()) ? dst : ((i % 2 == 0) ? scratch.ping : scratch.pong);
+        switch (step.op) {
+            case MorphOp::ERODE:
+                erodeRect(current, next, step.kernel, scratch);
+                break;
+            case MorphOp::DILATE:
+                dilateRect(current, next, step.kernel, scratch);
+                break;
+            case MorphOp::OPEN:
+                erodeRect(current, next, step.kernel, scratch);
+                dilateRect(next, next, step.kernel, scratch);
+                break;
+            case MorphOp::CLOSE:
+                dilateRect(current, next, step.kernel, scratch);
+                erodeRect(next, next, step.kernel, scratch);
+                break;
+        }
+        current = next;
+    }
+}
+
+// Clean up your thresholded image with a sequence of morphological operations
+void applyMorphologicalFiltering(const Mat& src, Mat& dst, const vector<MorphStep>& steps) {
+    MorphScratch scratch;
+    applyMorphologicalFiltering(src, dst, steps, scratch);
+}
+
+// Clean up your thresholded image with morphological filtering. The default is a 3x3 erosion,
+// this size was arrived at after multiple tests.
+void applyMorphologicalFiltering(const Mat& src, Mat& dst) {
+    static const vector<MorphStep> defaultSteps = {{MorphOp::ERODE, Size(3, 3)}};
+    applyMorphologicalFiltering(src, dst, defaultSteps);
+}
+
+/**
+ * @brief Parse a morphological sequence such as "open:7x7,close:15".
+ *        Each step is <erode|dilate|open|close>:<W>x<H>, or :<N> for a square kernel.
+ * @param spec The sequence description.
+ * @param steps Parsed steps (replaced).
+ * @return -1 failure, 0 success
+ */
+int parseMorphSequence(const string& spec, vector<MorphStep>& steps) {
+    steps.clear();
+    stringstream specStream(spec);
+    string token;
+
+    while (getline(specStream, token, ',')) {
+        size_t colon = token.find(':');
+        if (colon == string::npos) {
+            cerr << "ERROR: morphological step '" << token << "' is missing a kernel size" << endl;
+            return -1;
+        }
+        string name = token.substr(0, colon);
+        string size = token.substr(colon + 1);
+
+        MorphStep step;
+        if (name == "erode") step.op = MorphOp::ERODE;
+        else if (name == "dilate") step.op = MorphOp::DILATE;
+        else if (name == "open") step.op = MorphOp::OPEN;
+        else if (name == "close") step.op = MorphOp::CLOSE;
+        else {
+            cerr << "ERROR: unknown morphological operation '" << name << "'" << endl;
+            return -1;
+        }
+
+        int width = 0, height = 0;
+        char separator = 0;
+        stringstream sizeStream(size);
+        sizeStream >> width;
+        if (sizeStream >> separator) {
+            if (separator != 'x' || !(sizeStream >> height)) {
+                cerr << "ERROR: invalid kernel size '" << size << "'" << endl;
+                return -1;
+            }
+        } else {
+            height = width;
+        }
+        if (width < 1 || height < 1) {
+            cerr << "ERROR: invalid kernel size '" << size << "'" << endl;
+            return -1;
+        }
+        step.kernel = Size(width, height);
+        steps.push_back(step);
+    }
+    return 0;
+}
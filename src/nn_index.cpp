@@ -0,0 +1,262 @@
+/*
+ * Authors: Yuyang Tian and Arun Mekkad
+ * Date: 2025/3/2
+ * Purpose: Normalized nearest neighbor index with a SIMD distance kernel
+ */
+
+#include "../include/nn_index.h"
+#include <opencv2/core.hpp>
+#include <opencv2/core/hal/intrin.hpp>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <limits>
+
+using namespace cv;
+
+static const size_t BLOCK = 16;          // Entries per stride unit, covers 512-bit registers
+static const float PADDING = 1e15f;      // Padding entries: squared distance ~1e30, never the nearest
+
+/**
+ * @brief Normalize the training set once. The scaling is exactly the one of classifyByNN
+ *        (population stdev, + 1e-6), so the index returns the same labels.
+ * @param dbFeatures all training data
+ */
+void NNIndex::build(const TrainingSet& dbFeatures) {
+    count = dbFeatures.size();
+    stride = (count + BLOCK - 1) / BLOCK * BLOCK;
+    columns.assign(FEATURE_DIMS * stride, PADDING);
+    norms.assign(stride, 0.0f);
+
+    normalize(dbFeatures);
+    for (size_t i = 0; i < count; i++) {
+        for (size_t d = 0; d < FEATURE_DIMS; d++) {
+            columns[d * stride + i] = dbFeatures.features()[i][d] * scale[d];
+        }
+    }
+    for (size_t d = 0; d < FEATURE_DIMS; d++) {
+        for (size_t i = 0; i < stride; i++) {
+            norms[i] += columns[d * stride + i] * columns[d * stride + i];
+        }
+    }
+}
+
+size_t NNIndex::memoryBytes() const {
+    return sizeof(*this) + (columns.capacity() + norms.capacity()) * sizeof(float)
+           + entryLabels.capacity() * sizeof(int) + labels.memoryBytes();
+}
+
+/**
+ * @brief Nearest entry by scaled Euclidean distance. Distances stay squared, and a block of
+ *        entries is abandoned as soon as every partial sum already exceeds the best match
+ *        (starting from MAX_DISTANCE^2). Ties go to the first entry, as in classifyByNN.
+ * @param features the current object features vector
+ * @param distance optional output, distance of the match
+ * @return label ID, -1 if the index is empty or nothing is within MAX_DISTANCE
+ */
+int NNIndex::nearest(const ObjectFeatures& features, float* distance) const {
+    if (count == 0) {
+        return -1;
+    }
+    ObjectFeatures query = scaled(features);
+    // Anything up to exactly MAX_DISTANCE is a match
+    float best = nextafter(MAX_DISTANCE * MAX_DISTANCE, numeric_limits<float>::infinity());
+    int bestEntry = -1;
+
+    size_t i = 0;
+#if CV_SIMD
+    const int lanes = v_float32::nlanes;
+    float sums[CV_SIMD_WIDTH / sizeof(float)];
+    for (; i < count; i += lanes) {
+        v_float32 acc = vx_setzero_f32();
+        bool abandoned = false;
+        for (size_t d = 0; d < FEATURE_DIMS; d++) {
+            v_float32 diff = vx_setall_f32(query[d]) - vx_load(columns.data() + d * stride + i);
+            acc = v_fma(diff, diff, acc);
+            if ((d & 3) == 3 && v_check_all(acc >= vx_setall_f32(best))) {
+                abandoned = true;
+                break;
+            }
+        }
+        if (abandoned) continue;
+        v_store(sums, acc);
+        for (int lane = 0; lane < lanes && i + lane < count; lane++) {
+            if (sums[lane] < best) {
+                best = sums[lane];
+                bestEntry = static_cast<int>(i + lane);
+            }
+        }
+    }
+#endif
+    for (; i < count; i++) {
+        float sum = 0.0f;
+        for (size_t d = 0; d < FEATURE_DIMS && sum < best; d++) {
+            float diff = query[d] - columns[d * stride + i];
+            sum += diff * diff;
+        }
+        if (sum < best) {
+            best = sum;
+            bestEntry = static_cast<int>(i);
+        }
+    }
+
+    if (bestEntry < 0) {
+        return -1;
+    }
+    if (distance) {
+        *distance = sqrt(best);
+    }
+    return entryLabels[bestEntry];
+}
+
+static const int QUERY_BLOCK = 32;   // Queries sharing one pass over a training tile
+static const int ENTRY_BLOCK = 256;  // Entries per tile: dims x 256 floats stay in L1 for the query block
+static const int RESCORE_MARGIN = 8; // Extra candidates of the expanded form, its rounding may reorder close ones
+
+// Insert into a list sorted by (distance, entry), keeping the k best
+static inline void insertNeighbor(Neighbor* list, int& filled, int k, Neighbor candidate) {
+    if (filled == k) {
+        const Neighbor& worst = list[k - 1];
+        if (candidate.distance > worst.distance ||
+            (candidate.distance == worst.distance && candidate.entry > worst.entry)) {
+            return;
+        }
+        filled--;
+    }
+    int i = filled++;
+    while (i > 0 && (list[i - 1].distance > candidate.distance ||
+                     (list[i - 1].distance == candidate.distance && list[i - 1].entry > candidate.entry))) {
+        list[i] = list[i - 1];
+        i--;
+    }
+    list[i] = candidate;
+}
+
+/**
+ * @brief Batched k-NN. Candidate distances come from a blocked matrix product,
+ *        |q - x|^2 = |q|^2 + |x|^2 - 2 q.x, tile by tile of the training matrix so each tile is
+ *        read from cache by a whole block of queries. Query blocks run in parallel.
+ *        The expanded form cancels badly for entries close to the query, so the best k + RESCORE_MARGIN
+ *        candidates are rescored as sum (q - x)^2 before the k nearest are ranked and thresholded.
+ * @param queries one feature vector per row, CV_32FC1
+ * @param k neighbors per query
+ * @param results one result per query row
+ * @return -1 on invalid input, 0 on success
+ */
+int NNIndex::knnBatch(const Mat& queries, int k, vector<KNNResult>& results) const {
+    results.clear();
+    if (queries.empty()) {
+        return 0;
+    }
+    if (count == 0) {
+        results.resize(queries.rows);  // Nothing to match: every query is "Unknown"
+        return 0;
+    }
+    if (queries.type() != CV_32FC1 || static_cast<size_t>(queries.cols) != FEATURE_DIMS || k < 1) {
+        cerr << "Error: knnBatch expects CV_32FC1 queries with " << FEATURE_DIMS << " columns and k >= 1" << endl;
+        return -1;
+    }
+    results.resize(queries.rows);
+    int neighborCount = static_cast<int>(min<size_t>(k, count));
+    int candidateCount = static_cast<int>(min<size_t>(static_cast<size_t>(k) + RESCORE_MARGIN, count));
+    int blocks = (queries.rows + QUERY_BLOCK - 1) / QUERY_BLOCK;
+
+    parallel_for_(Range(0, blocks), [&](const Range& range) {
+        vector<float> query(QUERY_BLOCK * FEATURE_DIMS), queryNorms(QUERY_BLOCK);
+        vector<Neighbor> best(QUERY_BLOCK * candidateCount);
+        vector<int> filled(QUERY_BLOCK);
+        vector<int> votes(labels.size() + 1);
+        float dots[ENTRY_BLOCK];
+        for (int block = range.start; block < range.end; block++) {
+            int first = block * QUERY_BLOCK;
+            int rows = min(QUERY_BLOCK, queries.rows - first);
+            for (int q = 0; q < rows; q++) {
+                const float* row = queries.ptr<float>(first + q);
+                float norm = 0.0f;
+                for (size_t d = 0; d < FEATURE_DIMS; d++) {
+                    query[q * FEATURE_DIMS + d] = row[d] * scale[d];
+                    norm += query[q * FEATURE_DIMS + d] * query[q * FEATURE_DIMS + d];
+                }
+                queryNorms[q] = norm;
+                filled[q] = 0;
+            }
+
+            for (size_t tile = 0; tile < stride; tile += ENTRY_BLOCK) {
+                int width = static_cast<int>(min<size_t>(ENTRY_BLOCK, stride - tile));
+                int valid = static_cast<int>(min<size_t>(width, count - min(count, tile)));
+                for (int q = 0; q < rows; q++) {
+                    // dots[j] = -2 q.x_j over the tile, one feature column at a time
+                    fill(dots, dots + width, 0.0f);
+                    for (size_t d = 0; d < FEATURE_DIMS; d++) {
+                        float weight = -2.0f * query[q * FEATURE_DIMS + d];
+                        const float* column = columns.data() + d * stride + tile;
+                        int j = 0;
+#if CV_SIMD
+                        v_float32 w = vx_setall_f32(weight);
+                        for (; j <= width - v_float32::nlanes; j += v_float32::nlanes) {
+                            v_store(dots + j, v_fma(w, vx_load(column + j), vx_load(dots + j)));
+                        }
+#endif
+                        for (; j < width; j++) {
+                            dots[j] += weight * column[j];
+                        }
+                    }
+                    Neighbor* list = &best[q * candidateCount];
+                    for (int j = 0; j < valid; j++) {
+                        float distance = queryNorms[q] + norms[tile + j] + dots[j];
+                        insertNeighbor(list, filled[q], candidateCount, {static_cast<int>(tile + j), distance});
+                    }
+                }
+            }
+
+            for (int q = 0; q < rows; q++) {
+                // Direct squared distances of the candidates, then the k nearest of those
+                Neighbor* list = &best[q * candidateCount];
+                int rescored = 0;
+                for (int c = 0; c < filled[q]; c++) {
+                    Neighbor candidate = list[c];
+                    float sum = 0.0f;
+                    for (size_t d = 0; d < FEATURE_DIMS; d++) {
+                        float diff = query[q * FEATURE_DIMS + d] - columns[d * stride + candidate.entry];
+                        sum += diff * diff;
+                    }
+                    candidate.distance = sum;
+                    insertNeighbor(list, rescored, filled[q], candidate);  // Sorts in place, slot c was read above
+                }
+                KNNResult& result = results[first + q];
+                result.neighbors.assign(list, list + min(rescored, neighborCount));
+                fill(votes.begin(), votes.end(), 0);
+                for (Neighbor& neighbor : result.neighbors) {
+                    neighbor.distance = sqrt(neighbor.distance);
+                    int label = neighbor.distance <= MAX_DISTANCE ? entryLabels[neighbor.entry] : -1;
+                    votes[label + 1]++;
+                }
+                int most = *max_element(votes.begin(), votes.end());
+                for (const Neighbor& neighbor : result.neighbors) {
+                    int label = neighbor.distance <= MAX_DISTANCE ? entryLabels[neighbor.entry] : -1;
+                    if (votes[label + 1] == most) {
+                        result.label = label;
+                        break;
+                    }
+                }
+                result.confidence = static_cast<float>(most) / neighborCount;
+            }
+        }
+    });
+    return 0;
+}
+
+int NNIndex::knnBatch(const vector<ObjectFeatures>& queries, int k, vector<KNNResult>& results) const {
+    return knnBatch(featureMatrix(queries), k, results);  // The queries are read in place
+}
+
+vector<string> NNIndex::classifyBatch(const vector<ObjectFeatures>& batch, int k) const {
+    vector<KNNResult> results;
+    vector<string> result(batch.size(), LabelTable::UNKNOWN);
+    if (knnBatch(batch, k, results) == 0) {
+        for (size_t i = 0; i < results.size(); i++) {
+            result[i] = labelName(results[i].label);
+        }
+    }
+    return result;
+}
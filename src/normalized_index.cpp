@@ -0,0 +1,45 @@
+/*
+ * Authors: Yuyang Tian and Arun Mekkad
+ * Date: 2025/3/9
+ * Purpose: Label table and feature scaling shared by the nearest neighbor indexes
+ */
+
+#include "../include/normalized_index.h"
+#include "../include/classifier.h"
+
+const string LabelTable::UNKNOWN = "Unknown";
+
+void LabelTable::clear() {
+    names.clear();
+    ids.clear();
+}
+
+int LabelTable::intern(const string& name) {
+    auto inserted = ids.emplace(name, static_cast<int>(names.size()));
+    if (inserted.second) {
+        names.push_back(name);
+    }
+    return inserted.first->second;
+}
+
+const string& LabelTable::name(int id) const {
+    return (id >= 0 && id < static_cast<int>(names.size())) ? names[id] : UNKNOWN;
+}
+
+size_t LabelTable::memoryBytes() const {
+    size_t bytes = names.capacity() * sizeof(string) + ids.bucket_count() * sizeof(void*);
+    for (const string& label : names) {
+        // Name in the vector and as a map key, plus a map node (key, value, next pointer and hash)
+        bytes += 2 * label.capacity() + sizeof(string) + sizeof(int) + 2 * sizeof(void*);
+    }
+    return bytes;
+}
+
+ObjectFeatures featureScale(const TrainingSet& dbFeatures) {
+    ObjectFeatures stdevs = computeFeatureStdDevs(dbFeatures);
+    ObjectFeatures scale;
+    for (size_t d = 0; d < FEATURE_DIMS; d++) {
+        scale[d] = static_cast<float>(1.0 / (stdevs[d] + 1e-6));
+    }
+    return scale;
+}
@@ -10,62 +10,188 @@
 using namespace cv;
 using namespace std;
 
-// Extract binary mask of a specific region ID
-int getBinaryMask(Mat& regionMap, int regionID, Mat& binaryMask) {
-    binaryMask = (regionMap == regionID);
-    if (binaryMask.empty()) {
+// Bounding box of all pixels of a region ID, found in a single scan of the region map
+int getRegionBoundingBox(const Mat& regionMap, int regionID, Rect& bbox) {
+    int minX = regionMap.cols, minY = regionMap.rows, maxX = -1, maxY = -1;
+    for (int y = 0; y < regionMap.rows; y++) {
+        const int* row = regionMap.ptr<int>(y);
+        int first = -1, last = -1;
+        for (int x = 0; x < regionMap.cols; x++) {
+            if (row[x] == regionID) {
+                if (first < 0) first = x;
+                last = x;
+            }
+        }
+        if (first < 0) continue;
+        minX = min(minX, first);
+        maxX = max(maxX, last);
+        minY = min(minY, y);
+        maxY = y;
+    }
+    if (maxY < 0) {
+        return -1;  // No region found
+    }
+    bbox = Rect(minX, minY, maxX - minX + 1, maxY - minY + 1);
+    return 0;  // Success
+}
+
+// Bounding boxes of regions 1..numRegions found in a single scan of the region map
+int getRegionBoundingBoxes(const Mat& regionMap, int numRegions, vector<Rect>& boxes) {
+    if (regionMap.empty() || regionMap.type() != CV_32S || numRegions < 0) {
+        cerr << "Error: invalid input for region bounding boxes" << endl;
+        return -1;
+    }
+    // Inclusive corners, empty regions keep minX > maxX
+    vector<Vec4i> corners(numRegions, Vec4i(regionMap.cols, regionMap.rows, -1, -1));
+    for (int y = 0; y < regionMap.rows; y++) {
+        const int* row = regionMap.ptr<int>(y);
+        for (int x = 0; x < regionMap.cols; x++) {
+            int id = row[x];
+            if (id <= 0 || id > numRegions) continue;
+            Vec4i& c = corners[id - 1];
+            c[0] = min(c[0], x);
+            c[1] = min(c[1], y);
+            c[2] = max(c[2], x);
+            c[3] = max(c[3], y);
+        }
+    }
+    boxes.resize(numRegions);
+    for (int i = 0; i < numRegions; i++) {
+        const Vec4i& c = corners[i];
+        boxes[i] = (c[2] < 0) ? Rect() : Rect(c[0], c[1], c[2] - c[0] + 1, c[3] - c[1] + 1);
+    }
+    return 0;
+}
+
+// Extract binary mask of a specific region ID inside a window of the region map. The mask is a
+// header over storage, which only grows, so steady state frames do not allocate.
+int getBinaryMask(const Mat& regionMap, int regionID, const Rect& window, vector<uchar>& storage, Mat& binaryMask) {
+    if (window.area() == 0) {
         return -1;  // Failed to create binary mask
     }
+    if (storage.size() < static_cast<size_t>(window.area())) {
+        storage.resize(window.area());
+    }
+    binaryMask = Mat(window.size(), CV_8UC1, storage.data());
+    compare(regionMap(window), Scalar(regionID), binaryMask, CMP_EQ);
     return 0;  // Success
 }
 
 // Compute the least central moment axis (orientation angle)
-double computeLeastCentralMomentAxis(Moments& m) {
+double computeLeastCentralMomentAxis(const Moments& m) {
     double mu20 = m.mu20 / m.m00;
     double mu02 = m.mu02 / m.m00;
     double mu11 = m.mu11 / m.m00;
     return 0.5 * atan2(2 * mu11, mu20 - mu02);  // Orientation in radians
 }
 
-// Compute the Oriented Bounding Box (OBB) using PCA
-
-int computeOrientedBoundingBox(Mat& binaryMask, RotatedRect& obb) {
-    vector<Point> regionPixels;
-    findNonZero(binaryMask, regionPixels);  // Much faster than manual iteration
-
-    if (regionPixels.empty()) {
+// Compute the Oriented Bounding Box (OBB) with rotating calipers over the convex hull
+int computeOrientedBoundingBox(RegionGeometry& geometry) {
+    vector<Point>& boundary = geometry.boundary;
+    boundary.clear();
+    for (const vector<Point>& contour : geometry.contours) {
+        boundary.insert(boundary.end(), contour.begin(), contour.end());
+    }
+    if (boundary.empty()) {
         cerr << "No region found" << endl;
         return -1;  // No region found
     }
 
-    obb = minAreaRect(regionPixels);
+    // The hull of the outer contours is the hull of the whole region
+    convexHull(boundary, geometry.hull);
+    geometry.obb = minAreaRect(geometry.hull);
     return 0;
 }
 
-// Draw box, axis, centroid on original image
-void drawResults(Mat& image, Point2f centroid, double theta, RotatedRect& obb, vector<float>& features) {
-    if (image.type() == CV_8UC1) {
-        cvtColor(image, image, COLOR_GRAY2BGR); // Convert grayscale to 3-channel BGR
+/**
+ * @brief Extract the geometry of one region: mask cropped to its bounding box, outer contour,
+ *        convex hull, OBB, contour area and perimeter. Everything else is derived from this.
+ * @param regionMap Labeled region map (CV_32S).
+ * @param regionID The region to extract.
+ * @param bbox Bounding box of the region in the region map.
+ * @param knownMoments Moments of the region if already known (e.g. RegionStats), or nullptr.
+ * @param geometry Output geometry.
+ * @return -1 failure, 0 success
+ */
+int extractRegionGeometry(const Mat& regionMap, int regionID, const Rect& bbox,
+                          const Moments* knownMoments, RegionGeometry& geometry) {
+    if (regionMap.empty() || regionMap.type() != CV_32S || bbox.area() == 0) {
+        cerr << "Error: invalid input for region ID: " << regionID << endl;
+        return -1;
+    }
+
+    // Step 1: Binary mask of the bounding box only, one pixel of margin for the contour tracer
+    geometry.bbox = bbox;
+    Rect window = Rect(bbox.x - 1, bbox.y - 1, bbox.width + 2, bbox.height + 2)
+                  & Rect(0, 0, regionMap.cols, regionMap.rows);
+    if (getBinaryMask(regionMap, regionID, window, geometry.maskStorage, geometry.mask) != 0) {
+        cerr << "Error: Unable to extract binary mask for region ID: " << regionID << endl;
+        return -1;  // Failed to get binary mask
     }
+
+    // Step 2: Moments. Central moments do not depend on the window offset, the centroid does.
+    if (knownMoments) {
+        geometry.moments = *knownMoments;
+        geometry.centroid = Point2f(geometry.moments.m10 / geometry.moments.m00,
+                                    geometry.moments.m01 / geometry.moments.m00);
+    } else {
+        geometry.moments = moments(geometry.mask, true);
+        geometry.centroid = Point2f(geometry.moments.m10 / geometry.moments.m00 + window.x,
+                                    geometry.moments.m01 / geometry.moments.m00 + window.y);
+    }
+    if (geometry.moments.m00 == 0) return -1;
+    geometry.theta = computeLeastCentralMomentAxis(geometry.moments);
+
+    // Step 3: Outer contour, traced once, in image coordinates
+    findContours(geometry.mask, geometry.contours, RETR_EXTERNAL, CHAIN_APPROX_SIMPLE, window.tl());
+    if (geometry.contours.empty()) {
+        cerr << "ERROR: contour is empty!" << endl;
+        return -1;
+    }
+    geometry.mainContour = 0;
+    geometry.contourArea = contourArea(geometry.contours[0]);
+    for (size_t i = 1; i < geometry.contours.size(); i++) {
+        double area = contourArea(geometry.contours[i]);
+        if (area > geometry.contourArea) {
+            geometry.contourArea = area;
+            geometry.mainContour = static_cast<int>(i);
+        }
+    }
+    geometry.perimeter = arcLength(geometry.contours[geometry.mainContour], true);
+
+    // Step 4: Hull and OBB
+    if (computeOrientedBoundingBox(geometry) != 0) {
+        cerr << "Error: Unable to compute Oriented Bounding Box for region ID: " << regionID << endl;
+        return -1;  // Failed to compute OBB
+    }
+    return 0;
+}
+
+// Draw centroid, axis (half length axisLength) and OBB of one region
+static void drawGeometry(Mat& image, const RegionGeometry& geometry, float axisLength) {
     // Draw Centroid
-    circle(image, centroid, 4, Scalar(255, 0, 0), -1);
+    circle(image, geometry.centroid, 4, Scalar(255, 0, 0), -1);
 
     // Draw Least Central Moment Axis (Red Line)
-    Point2f axisVector(100 * cos(theta), 100 * sin(theta));
-    arrowedLine(image, centroid - axisVector, centroid + axisVector, Scalar(0, 0, 255), 2, LINE_AA, 0, 0.1);  // Arrow at end
+    Point2f axisVector(axisLength * cos(geometry.theta), axisLength * sin(geometry.theta));
+    arrowedLine(image, geometry.centroid - axisVector, geometry.centroid + axisVector, Scalar(0, 0, 255), 2, LINE_AA, 0, 0.1);  // Arrow at end
 
     // Draw Oriented Bounding Box (Green Box)
     Point2f boxPoints[4];
-    obb.points(boxPoints);
+    geometry.obb.points(boxPoints);
     for (int i = 0; i < 4; i++) {
         line(image, boxPoints[i], boxPoints[(i + 1) % 4], Scalar(0, 255, 0), 2);
     }
-    Scalar textColor(180, 220, 255);
-    if (features.empty()) {
-        cerr << "Error: Features vector is empty!" << endl;
-        return;
+}
+
+// Draw box, axis, centroid on original image
+void drawResults(Mat& image, const RegionGeometry& geometry, const ObjectFeatures& features) {
+    if (image.type() == CV_8UC1) {
+        cvtColor(image, image, COLOR_GRAY2BGR); // Convert grayscale to 3-channel BGR
     }
-    float aspectRatio = features.at(0);
+    drawGeometry(image, geometry, 100);
+    Scalar textColor(180, 220, 255);
+    float aspectRatio = features[7];
     // Positioning the text elegantly near the OBB corners
     putText(image, "Aspect Ratio: " + to_string(aspectRatio), Point(10, 300), FONT_HERSHEY_SIMPLEX, 0.6, textColor, 2);
 }
@@ -73,13 +199,12 @@ void drawResults(Mat& image, Point2f centroid, double theta, RotatedRect& obb, v
 
 
 // Compute Hu Moments (Translation, Scale, and Rotation Invariant Features)
-void computeHuMoments(const Moments& m, vector<double>& huMoments) {
-    double hu[7];
-    HuMoments(m, hu);
-    huMoments.assign(hu, hu + 7);
+void computeHuMoments(const Moments& m, double huMoments[7]) {
+    HuMoments(m, huMoments);
 
     // Log-scale transformation for numerical stability
-    for (double &moment : huMoments) {
+    for (int i = 0; i < 7; i++) {
+        double& moment = huMoments[i];
         moment = -1 * copysign(1.0, moment) * log10(abs(moment) + 1e-10);
     }
 }
@@ -88,71 +213,150 @@ float computeAspectRatio(const RotatedRect& obb) {
     return obb.size.width / obb.size.height;
 }
 
-float computePerimeterToArea(const Mat& binaryMask, const vector<vector<Point>>& contours){
-    double perimeter = arcLength(contours[0], true);
-    double area = contourArea(contours[0]);
+float computePerimeterToArea(const RegionGeometry& geometry) {
+    return (geometry.contourArea > 0) ? (geometry.perimeter / geometry.contourArea) : -1;  // Avoid division by zero
+}
 
-    return (area > 0) ? (perimeter / area) : -1;  // Avoid division by zero
+float computePercentFilled(const RegionGeometry& geometry) {
+    return geometry.contourArea / geometry.obb.size.area();
+}
+
+// Shape features, written after the 7 Hu moments
+int computeRegionShapeFeatures(const RegionGeometry& geometry, ObjectFeatures& features) {
+    features[7] = computeAspectRatio(geometry.obb);
+    features[8] = computePerimeterToArea(geometry);
+    features[9] = computePercentFilled(geometry);
+    return 0;
 }
 
-float computePercentFilled(const vector<vector<Point>>& contours, const RotatedRect& obb) {
-    double regionArea = contourArea(contours[0]);
-    double obbArea = obb.size.area();
+// Feature vector of a region: 7 Hu moments followed by aspect ratio, perimeter/area, percent filled
+int computeRegionFeatures(const RegionGeometry& geometry, ObjectFeatures& features) {
+    static_assert(FEATURE_DIMS == 10, "7 Hu moments + 3 shape features");
+    double huMoments[7];
+    computeHuMoments(geometry.moments, huMoments);
 
-    return regionArea / obbArea;
+    copy(huMoments, huMoments + 7, features.begin());
+    return computeRegionShapeFeatures(geometry, features);
 }
 
-int computeRegionShapeFeatures(const Mat& binaryMask, const RotatedRect& obb, vector<float>& shapeFeatures) {
-    vector<vector<Point>> contours;
-    findContours(binaryMask, contours, RETR_EXTERNAL, CHAIN_APPROX_SIMPLE);
-    if (contours.empty()) {
-        cerr << "ERROR: contour is empty!" << endl;
-        return -1;
+// Draw every object with its label just above the top corner of its OBB
+void drawObjects(Mat& image, const vector<RegionObject>& objects) {
+    if (image.type() == CV_8UC1) {
+        cvtColor(image, image, COLOR_GRAY2BGR); // Convert grayscale to 3-channel BGR
     }
-    float aspectRatio = computeAspectRatio(obb);
-    float perimeterToArea = computePerimeterToArea(binaryMask, contours);
-    float percentFilled = computePercentFilled(contours, obb);
-
-    shapeFeatures.push_back(aspectRatio);
-    shapeFeatures.push_back(perimeterToArea);
-    shapeFeatures.push_back(percentFilled);
+    for (const RegionObject& object : objects) {
+        const RegionGeometry& geometry = object.geometry;
+        float halfAxis = 0.5f * max(geometry.obb.size.width, geometry.obb.size.height);
+        drawGeometry(image, geometry, halfAxis);
 
-    return 0;
+        Point2f boxPoints[4];
+        geometry.obb.points(boxPoints);
+        Point2f top = boxPoints[0];
+        for (int i = 1; i < 4; i++) {
+            if (boxPoints[i].y < top.y) top = boxPoints[i];
+        }
+        Point anchor(max(0, static_cast<int>(top.x)), max(15, static_cast<int>(top.y) - 5));
+        putText(image, object.label.empty() ? to_string(object.regionID) : object.label, anchor,
+                FONT_HERSHEY_SIMPLEX, 0.6, Scalar(255, 127, 80), 2);
+    }
 }
-// Main function to compute OBB and draw OBB
-int computeRegionFeatures(Mat& regionMap, int regionID, Mat& image, Mat& dst, vector<float>& features) {
-    // Step 1: Get Binary Mask
-    Mat binaryMask;
-    if (getBinaryMask(regionMap, regionID, binaryMask) != 0) {
-        std::cerr << "Error: Unable to extract binary mask for region ID: " << regionID << std::endl;
-        return -1;  // Failed to get binary mask
+
+/**
+ * @brief Compute geometry and features of every region of a frame. Regions are independent,
+ *        so each one is a separate task of cv::parallel_for_ and the work spreads over all cores.
+ * @param regionMap Labeled region map (CV_32S), regions numbered 1..N.
+ * @param stats Statistics from run-length labeling (stats[i] is region i + 1), or empty.
+ * @param objects Output, one entry per region in label order. Regions that fail are dropped.
+ * @return number of objects, -1 on failure
+ */
+int computeAllRegionFeatures(const Mat& regionMap, const vector<RegionStats>& stats,
+                             vector<RegionObject>& objects) {
+    objects.clear();
+    if (regionMap.empty() || regionMap.type() != CV_32S) {
+        cerr << "Error: invalid region map for multi-object features" << endl;
+        return -1;
     }
 
-    Moments m = moments(binaryMask, true);
-    if (m.m00 == 0) return -1;
+    // Without statistics, one scan finds every bounding box
+    vector<Rect> boxes;
+    if (stats.empty()) {
+        double maxLabel = 0;
+        minMaxLoc(regionMap, nullptr, &maxLabel);
+        if (getRegionBoundingBoxes(regionMap, static_cast<int>(maxLabel), boxes) != 0) {
+            return -1;
+        }
+    }
+    int numRegions = stats.empty() ? static_cast<int>(boxes.size()) : static_cast<int>(stats.size());
+    objects.resize(numRegions);
+    vector<uchar> extracted(numRegions, 0);
 
-    Point2f centroid(m.m10 / m.m00, m.m01 / m.m00);
-    double theta = computeLeastCentralMomentAxis(m);
+    parallel_for_(Range(0, numRegions), [&](const Range& range) {
+        for (int i = range.start; i < range.end; i++) {
+            RegionObject& object = objects[i];
+            object.regionID = stats.empty() ? i + 1 : stats[i].label;
+            int status;
+            if (stats.empty()) {
+                status = boxes[i].area() > 0
+                         ? extractRegionGeometry(regionMap, object.regionID, boxes[i], nullptr, object.geometry)
+                         : -1;
+            } else {
+                Moments m = stats[i].moments();
+                status = extractRegionGeometry(regionMap, object.regionID, stats[i].bbox, &m, object.geometry);
+            }
+            if (status == 0) {
+                computeRegionFeatures(object.geometry, object.features);
+                extracted[i] = 1;
+            }
+        }
+    });
 
-    RotatedRect obb;
-    if (computeOrientedBoundingBox(binaryMask, obb) != 0) {
-        std::cerr << "Error: Unable to compute Oriented Bounding Box for region ID: " << regionID << std::endl;
-        return -1;  // Failed to compute OBB
+    // Drop failed regions, keeping label order
+    size_t kept = 0;
+    for (int i = 0; i < numRegions; i++) {
+        if (!extracted[i]) continue;
+        if (kept != static_cast<size_t>(i)) {
+            objects[kept] = move(objects[i]);
+        }
+        kept++;
     }
+    objects.resize(kept);
+    return static_cast<int>(objects.size());
+}
 
-    // Compute Features
-    vector<double> huMoments;
-    computeHuMoments(m, huMoments);
-    vector<float> shapeFeatures;
-    computeRegionShapeFeatures(binaryMask, obb, shapeFeatures);
+// Compute features of a region and draw its OBB over a copy of the image
+static int computeAndDraw(const Mat& regionMap, int regionID, const Rect& bbox, const Moments* knownMoments,
+                          Mat& image, Mat& dst, ObjectFeatures& features, RegionGeometry& geometry) {
+    if (extractRegionGeometry(regionMap, regionID, bbox, knownMoments, geometry) != 0) {
+        return -1;
+    }
+    computeRegionFeatures(geometry, features);
 
-    dst = image.clone();
-    drawResults(dst, centroid, theta, obb, features);
+    image.copyTo(dst);
+    drawResults(dst, geometry, features);
+    return 0;  // Success
+}
 
-    // Combine feature vectors
-    features.clear();
-    features.insert(features.end(), huMoments.begin(), huMoments.end());
-    features.insert(features.end(), shapeFeatures.begin(), shapeFeatures.end());
+// Compute OBB and draw OBB, reusing the scratch geometry of the previous frame
+int computeRegionFeatures(Mat& regionMap, int regionID, Mat& image, Mat& dst, ObjectFeatures& features,
+                          RegionGeometry& geometry) {
+    // Step 1: Crop to the region, everything after this works on the bounding box only
+    Rect bbox;
+    if (getRegionBoundingBox(regionMap, regionID, bbox) != 0) {
+        std::cerr << "Error: Unable to extract binary mask for region ID: " << regionID << std::endl;
+        return -1;
+    }
+    return computeAndDraw(regionMap, regionID, bbox, nullptr, image, dst, features, geometry);
+}
 
-    return 0;  // Success
+// Main function to compute OBB and draw OBB
+int computeRegionFeatures(Mat& regionMap, int regionID, Mat& image, Mat& dst, ObjectFeatures& features) {
+    RegionGeometry geometry;
+    return computeRegionFeatures(regionMap, regionID, image, dst, features, geometry);
+}
+
+// Compute OBB and draw OBB for a region with precomputed statistics
+int computeRegionFeatures(Mat& regionMap, const RegionStats& stats, Mat& image, Mat& dst, ObjectFeatures& features) {
+    Moments m = stats.moments();
+    RegionGeometry geometry;
+    return computeAndDraw(regionMap, stats.label, stats.bbox, &m, image, dst, features, geometry);
 }
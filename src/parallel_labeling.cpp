@@ -0,0 +1,254 @@
+/*
+ * Authors: Yuyang Tian and Arun Mekkad
+ * Date: 2025/2/22
+ * Purpose: Multi-threaded connected-component labeling over horizontal strips
+ */
+
+#include "../include/image_process.h"
+#include <iostream>
+#include <vector>
+#include <atomic>
+#include <memory>
+#include <algorithm>
+#include <climits>
+
+// Per-strip result of the local labeling pass. Labels are local to the strip (1..numLabels).
+struct StripLabels {
+    int rowStart = 0;
+    int rowEnd = 0;
+    int numLabels = 0;
+    vector<int> root;       // Local root of every local label (flattened)
+    vector<int> size;       // Pixel count of every local label
+    vector<uchar> boundary; // Local label has a pixel on the image border
+};
+
+// Local union: keep the smaller label as root so roots are the first label in raster order
+static int findLocal(vector<int>& parent, int x) {
+    while (parent[x] != x) {
+        parent[x] = parent[parent[x]];
+        x = parent[x];
+    }
+    return x;
+}
+
+static void connectLocal(vector<int>& parent, int x, int y) {
+    x = findLocal(parent, x);
+    y = findLocal(parent, y);
+    if (x < y) parent[y] = x;
+    else if (y < x) parent[x] = y;
+}
+
+// Lock-free find on the shared parent array. parent[x] <= x always holds, so this terminates.
+static int findConcurrent(atomic<int>* parent, int x) {
+    int p;
+    while ((p = parent[x].load(memory_order_acquire)) != x) {
+        x = p;
+    }
+    return x;
+}
+
+// Lock-free union: link the larger root under the smaller one, retry if another thread won the race
+static void connectConcurrent(atomic<int>* parent, int x, int y) {
+    while (true) {
+        x = findConcurrent(parent, x);
+        y = findConcurrent(parent, y);
+        if (x == y) return;
+        if (x < y) swap(x, y);
+        int expected = x;
+        if (parent[x].compare_exchange_strong(expected, y, memory_order_acq_rel)) return;
+    }
+}
+
+/**
+ * @brief First pass over one strip: provisional labels written into the region map, local
+ *        equivalences resolved and per-label sizes / border contact collected.
+ */
+static void labelStrip(const Mat& binaryImage, Mat& regionMap, StripLabels& strip, bool eightConnectivity) {
+    int rows = binaryImage.rows, cols = binaryImage.cols;
+    vector<int> parent(1, 0);
+    int nextLabel = 1;
+
+    for (int i = strip.rowStart; i < strip.rowEnd; i++) {
+        int* regionRow = regionMap.ptr<int>(i);
+        const int* topRow = (i > strip.rowStart) ? regionMap.ptr<int>(i - 1) : nullptr;
+        const uchar* binaryRow = binaryImage.ptr<uchar>(i);
+
+        for (int j = 0; j < cols; j++) {
+            if (binaryRow[j] == 0) {
+                regionRow[j] = 0;
+                continue;
+            }
+
+            // Neighbors inside the strip only, the strip border is merged afterwards
+            int left = (j > 0) ? regionRow[j - 1] : 0;
+            int top = topRow ? topRow[j] : 0;
+            int topLeft = (eightConnectivity && topRow && j > 0) ? topRow[j - 1] : 0;
+            int topRight = (eightConnectivity && topRow && j < cols - 1) ? topRow[j + 1] : 0;
+
+            int minLabel = INT_MAX;
+            if (left) minLabel = min(minLabel, left);
+            if (top) minLabel = min(minLabel, top);
+            if (topLeft) minLabel = min(minLabel, topLeft);
+            if (topRight) minLabel = min(minLabel, topRight);
+
+            if (minLabel == INT_MAX) {
+                regionRow[j] = nextLabel;
+                parent.push_back(nextLabel);
+                nextLabel++;
+            } else {
+                regionRow[j] = minLabel;
+                if (left) connectLocal(parent, left, minLabel);
+                if (top) connectLocal(parent, top, minLabel);
+                if (topLeft) connectLocal(parent, topLeft, minLabel);
+                if (topRight) connectLocal(parent, topRight, minLabel);
+            }
+        }
+    }
+
+    // Local root of every label (the smallest label of its component inside the strip)
+    strip.numLabels = nextLabel - 1;
+    strip.root.assign(nextLabel, 0);
+    for (int l = 1; l < nextLabel; l++) {
+        strip.root[l] = findLocal(parent, l);
+    }
+
+    strip.size.assign(nextLabel, 0);
+    strip.boundary.assign(nextLabel, 0);
+    for (int i = strip.rowStart; i < strip.rowEnd; i++) {
+        const int* regionRow = regionMap.ptr<int>(i);
+        bool borderRow = (i == 0 || i == rows - 1);
+        for (int j = 0; j < cols; j++) {
+            int label = regionRow[j];
+            if (label == 0) continue;
+            strip.size[label]++;
+            if (borderRow || j == 0 || j == cols - 1) {
+                strip.boundary[label] = 1;
+            }
+        }
+    }
+}
+
+/**
+ * @brief Strip-parallel segmentation.
+ *        1. Strips are labeled concurrently with local labels.
+ *        2. Local labels get a global offset and equivalences across strip borders are merged
+ *           concurrently into a lock-free union-find.
+ *        3. Resolve, small/boundary region removal and sequential relabeling are folded into a
+ *           single lookup table, applied in one parallel pass over the region map.
+ * @return -1 failure, success return number of regions (numbered 1..N in raster order)
+ */
+static int parallelSegmentation(const Mat& binaryImage, Mat& regionMap, int minRegionSize,
+                                int numStrips, bool eightConnectivity, bool removeBoundary) {
+    if (binaryImage.empty()) {
+        cerr << "ERROR: parallel_segmentation - empty image" << endl;
+        return -1;
+    }
+    if (binaryImage.type() != CV_8UC1) { // Ensure it's a binary image
+        cerr << "ERROR: parallel_segmentation - not Binary image" << endl;
+        return -1;
+    }
+
+    int rows = binaryImage.rows, cols = binaryImage.cols;
+    if (numStrips <= 0) {
+        numStrips = getNumThreads();
+    }
+    numStrips = max(1, min(numStrips, rows));
+    regionMap.create(rows, cols, CV_32S);
+
+    // ** Pass 1: label strips concurrently **
+    vector<StripLabels> strips(numStrips);
+    for (int s = 0; s < numStrips; s++) {
+        strips[s].rowStart = static_cast<int>(static_cast<int64>(rows) * s / numStrips);
+        strips[s].rowEnd = static_cast<int>(static_cast<int64>(rows) * (s + 1) / numStrips);
+    }
+    parallel_for_(Range(0, numStrips), [&](const Range& range) {
+        for (int s = range.start; s < range.end; s++) {
+            labelStrip(binaryImage, regionMap, strips[s], eightConnectivity);
+        }
+    });
+
+    // ** Global label space: strip s owns labels offset[s] + 1 .. offset[s] + numLabels **
+    vector<int> offset(numStrips, 0);
+    int totalLabels = 0;
+    for (int s = 0; s < numStrips; s++) {
+        offset[s] = totalLabels;
+        totalLabels += strips[s].numLabels;
+    }
+    unique_ptr<atomic<int>[]> parent(new atomic<int>[totalLabels + 1]);
+    parent[0].store(0);
+    for (int s = 0; s < numStrips; s++) {
+        for (int l = 1; l <= strips[s].numLabels; l++) {
+            parent[offset[s] + l].store(offset[s] + strips[s].root[l], memory_order_relaxed);
+        }
+    }
+
+    // ** Merge equivalences across strip borders concurrently **
+    parallel_for_(Range(1, numStrips), [&](const Range& range) {
+        for (int s = range.start; s < range.end; s++) {
+            int i = strips[s].rowStart;
+            const int* regionRow = regionMap.ptr<int>(i);
+            const int* topRow = regionMap.ptr<int>(i - 1);
+            for (int j = 0; j < cols; j++) {
+                if (regionRow[j] == 0) continue;
+                int label = offset[s] + regionRow[j];
+                for (int dj = eightConnectivity ? -1 : 0; dj <= (eightConnectivity ? 1 : 0); dj++) {
+                    int k = j + dj;
+                    if (k < 0 || k >= cols || topRow[k] == 0) continue;
+                    connectConcurrent(parent.get(), label, offset[s - 1] + topRow[k]);
+                }
+            }
+        }
+    });
+
+    // ** Resolve roots, sizes and border contact per label (no pixel access) **
+    vector<int> root(totalLabels + 1, 0), regionSize(totalLabels + 1, 0);
+    vector<uchar> touchesBoundary(totalLabels + 1, 0);
+    for (int s = 0; s < numStrips; s++) {
+        for (int l = 1; l <= strips[s].numLabels; l++) {
+            int g = offset[s] + l;
+            int p = parent[g].load(memory_order_relaxed);
+            root[g] = (p == g) ? g : root[p];  // p < g is already resolved
+            regionSize[root[g]] += strips[s].size[l];
+            touchesBoundary[root[g]] |= strips[s].boundary[l];
+        }
+    }
+
+    // ** Sequential labels for surviving regions, folded with the root lookup **
+    vector<int> relabel(totalLabels + 1, 0);
+    int newLabel = 1;
+    for (int g = 1; g <= totalLabels; g++) {
+        if (root[g] == g && regionSize[g] >= minRegionSize && !(removeBoundary && touchesBoundary[g])) {
+            relabel[g] = newLabel++;
+        }
+    }
+    for (int g = 1; g <= totalLabels; g++) {
+        relabel[g] = relabel[root[g]];
+    }
+
+    // ** Single fused pass: local label -> final label **
+    parallel_for_(Range(0, numStrips), [&](const Range& range) {
+        for (int s = range.start; s < range.end; s++) {
+            const int* table = relabel.data() + offset[s];
+            for (int i = strips[s].rowStart; i < strips[s].rowEnd; i++) {
+                int* regionRow = regionMap.ptr<int>(i);
+                for (int j = 0; j < cols; j++) {
+                    if (regionRow[j]) {
+                        regionRow[j] = table[regionRow[j]];
+                    }
+                }
+            }
+        }
+    });
+
+    return newLabel - 1; // Return number of valid regions
+}
+
+// Strip-parallel segmentation with 4-connectivity, same region set as twoPassSegmentation4conn
+int parallelSegmentation4conn(const Mat& binaryImage, Mat& regionMap, int minRegionSize, int numStrips) {
+    return parallelSegmentation(binaryImage, regionMap, minRegionSize, numStrips, false, false);
+}
+
+// Strip-parallel segmentation with 8-connectivity, regions touching the image border are removed
+int parallelSegmentation8conn(const Mat& binaryImage, Mat& regionMap, int minRegionSize, int numStrips) {
+    return parallelSegmentation(binaryImage, regionMap, minRegionSize, numStrips, true, true);
+}
@@ -0,0 +1,222 @@
+/*
+ * Authors: Yuyang Tian and Arun Mekkad
+ * Date: 2025/3/8
+ * Purpose: Quantized (int8 / float16) nearest neighbor index with SIMD distance kernels and float rescoring
+ */
+
+#include "../include/quantized_index.h"
+#include <opencv2/core.hpp>
+#include <opencv2/core/hal/intrin.hpp>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+using namespace cv;
+
+static const size_t BLOCK = 16;  // Entries per stride unit, covers 512-bit registers
+
+// Candidate of the compressed scan
+struct Candidate {
+    float distance;  // Squared
+    int entry;
+};
+
+// Insert into a list sorted by distance, keeping the best limit; entries arrive in increasing order,
+// so equal distances keep the first entry in front
+static inline void insertCandidate(Candidate* list, int& filled, int limit, Candidate candidate) {
+    if (filled == limit) {
+        if (candidate.distance >= list[limit - 1].distance) return;
+        filled--;
+    }
+    int i = filled++;
+    while (i > 0 && list[i - 1].distance > candidate.distance) {
+        list[i] = list[i - 1];
+        i--;
+    }
+    list[i] = candidate;
+}
+
+static inline float decode(int8_t code) { return code; }
+static inline float decode(cv::float16_t half) { return static_cast<float>(half); }
+#if CV_SIMD
+static inline v_float32 loadColumn(const int8_t* codes) { return v_cvt_f32(vx_load_expand_q(codes)); }
+static inline v_float32 loadColumn(const cv::float16_t* halves) { return vx_load_expand(halves); }
+#endif
+
+/**
+ * @brief Compressed distance scan of feature-major columns: the value of entry i in dimension d is
+ *        columns[d * stride + i] * step[d]. Blocks of entries are abandoned once every partial sum
+ *        exceeds the worst kept candidate.
+ * @param query scaled and centered query
+ * @param best sorted candidate list of up to limit entries
+ */
+template <typename T>
+static void scanColumns(const T* columns, size_t count, size_t stride, const ObjectFeatures& step,
+                        const ObjectFeatures& query, Candidate* best, int& filled, int limit) {
+    float worst = numeric_limits<float>::infinity();
+    size_t i = 0;
+#if CV_SIMD
+    const int lanes = v_float32::nlanes;
+    float sums[CV_SIMD_WIDTH / sizeof(float)];
+    for (; i < count; i += lanes) {
+        v_float32 acc = vx_setzero_f32();
+        bool abandoned = false;
+        for (size_t d = 0; d < FEATURE_DIMS; d++) {
+            v_float32 diff = v_fma(loadColumn(columns + d * stride + i), vx_setall_f32(-step[d]),
+                                   vx_setall_f32(query[d]));
+            acc = v_fma(diff, diff, acc);
+            if ((d & 3) == 3 && v_check_all(acc >= vx_setall_f32(worst))) {
+                abandoned = true;
+                break;
+            }
+        }
+        if (abandoned) continue;
+        v_store(sums, acc);
+        for (int lane = 0; lane < lanes && i + lane < count; lane++) {
+            if (sums[lane] < worst) {
+                insertCandidate(best, filled, limit, {sums[lane], static_cast<int>(i + lane)});
+                if (filled == limit) worst = best[limit - 1].distance;
+            }
+        }
+    }
+#endif
+    for (; i < count; i++) {
+        float sum = 0.0f;
+        for (size_t d = 0; d < FEATURE_DIMS && sum < worst; d++) {
+            float diff = query[d] - decode(columns[d * stride + i]) * step[d];
+            sum += diff * diff;
+        }
+        if (sum < worst) {
+            insertCandidate(best, filled, limit, {sum, static_cast<int>(i)});
+            if (filled == limit) worst = best[limit - 1].distance;
+        }
+    }
+}
+
+/**
+ * @brief Normalize with the scaling of classifyByNN, center every dimension on the middle of its range
+ *        and compress: INT8 maps the range onto codes -127..127, FP16 rounds to half precision.
+ *        What the compression lost is kept as a float16 residual for rescoring.
+ * @param dbFeatures all training data, not referenced after the build
+ * @param precision storage of the compressed features
+ */
+void QuantizedIndex::build(const TrainingSet& dbFeatures, Precision precision) {
+    storage = precision;
+    count = dbFeatures.size();
+    stride = (count + BLOCK - 1) / BLOCK * BLOCK;
+    codes.clear();
+    halves.clear();
+    residuals.assign(count * FEATURE_DIMS, cv::float16_t(0.0f));
+    if (storage == Precision::INT8) {
+        codes.assign(FEATURE_DIMS * stride, 0);
+    } else {
+        halves.assign(FEATURE_DIMS * stride, cv::float16_t(0.0f));
+    }
+
+    normalize(dbFeatures);
+    for (size_t d = 0; d < FEATURE_DIMS; d++) {
+        float low = numeric_limits<float>::max(), high = numeric_limits<float>::lowest();
+        for (const ObjectFeatures& entry : dbFeatures.features()) {
+            low = min(low, entry[d] * scale[d]);
+            high = max(high, entry[d] * scale[d]);
+        }
+        center[d] = count ? 0.5f * (low + high) : 0.0f;
+        float range = count ? 0.5f * (high - low) : 0.0f;
+        step[d] = (storage == Precision::FP16 || range <= 0.0f) ? 1.0f : range / 127.0f;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        for (size_t d = 0; d < FEATURE_DIMS; d++) {
+            float value = dbFeatures.features()[i][d] * scale[d] - center[d];
+            float decoded;
+            if (storage == Precision::INT8) {
+                codes[d * stride + i] = static_cast<int8_t>(min(127, max(-127, cvRound(value / step[d]))));
+                decoded = decode(codes[d * stride + i]) * step[d];
+            } else {
+                halves[d * stride + i] = cv::float16_t(value);
+                decoded = decode(halves[d * stride + i]);
+            }
+            residuals[i * FEATURE_DIMS + d] = cv::float16_t(value - decoded);
+        }
+    }
+}
+
+void QuantizedIndex::setRescore(int candidates) {
+    rescoreCount = max(1, candidates);
+}
+
+size_t QuantizedIndex::memoryBytes() const {
+    return sizeof(*this) + codes.capacity() * sizeof(int8_t) + halves.capacity() * sizeof(cv::float16_t);
+}
+
+size_t QuantizedIndex::coldBytes() const {
+    return residuals.capacity() * sizeof(cv::float16_t) + entryLabels.capacity() * sizeof(int)
+           + labels.memoryBytes();
+}
+
+/**
+ * @brief Compressed scan for the rescore() best candidates, then their distances from the decoded
+ *        values plus residuals, which are within float16 rounding of the residual of the scaled
+ *        features. Ties go to the first entry, as in classifyByNN.
+ * @param features the current object features vector
+ * @param squaredDistance output, squared scaled distance of the match
+ * @return database position, -1 if the index is empty
+ */
+int QuantizedIndex::search(const ObjectFeatures& features, float& squaredDistance) const {
+    if (count == 0) {
+        return -1;
+    }
+    ObjectFeatures query = scaled(features), centered;
+    for (size_t d = 0; d < FEATURE_DIMS; d++) {
+        centered[d] = query[d] - center[d];
+    }
+    int limit = static_cast<int>(min<size_t>(rescoreCount, count));
+    AutoBuffer<Candidate, DEFAULT_RESCORE> candidates(limit);
+    int filled = 0;
+    if (storage == Precision::INT8) {
+        scanColumns(codes.data(), count, stride, step, centered, candidates.data(), filled, limit);
+    } else {
+        scanColumns(halves.data(), count, stride, step, centered, candidates.data(), filled, limit);
+    }
+
+    int bestEntry = -1;
+    float best = numeric_limits<float>::infinity();
+    for (int c = 0; c < filled; c++) {
+        int entry = candidates[c].entry;
+        const cv::float16_t* residual = &residuals[static_cast<size_t>(entry) * FEATURE_DIMS];
+        float sum = 0.0f;
+        for (size_t d = 0; d < FEATURE_DIMS; d++) {
+            float decoded = storage == Precision::INT8 ? decode(codes[d * stride + entry]) * step[d]
+                                                       : decode(halves[d * stride + entry]);
+            float diff = centered[d] - (decoded + decode(residual[d]));
+            sum += diff * diff;
+        }
+        if (sum < best || (sum == best && entry < bestEntry)) {
+            best = sum;
+            bestEntry = entry;
+        }
+    }
+    squaredDistance = best;
+    return bestEntry;
+}
+
+int QuantizedIndex::nearestEntry(const ObjectFeatures& features, float* distance) const {
+    float squared = 0.0f;
+    int entry = search(features, squared);
+    if (entry >= 0 && distance) {
+        *distance = sqrt(squared);
+    }
+    return entry;
+}
+
+int QuantizedIndex::nearest(const ObjectFeatures& features, float* distance) const {
+    float squared = 0.0f;
+    int entry = search(features, squared);
+    if (entry < 0 || squared > MAX_DISTANCE * MAX_DISTANCE) {
+        return -1;
+    }
+    if (distance) {
+        *distance = sqrt(squared);
+    }
+    return entryLabels[entry];
+}
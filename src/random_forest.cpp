@@ -0,0 +1,272 @@
+/*
+ * Authors: Yuyang Tian and Arun Mekkad
+ * Date: 2025/3/6
+ * Purpose: Random forest training with bagging on all cores and batched tree-by-tree inference
+ */
+
+#include "../include/random_forest.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <unordered_map>
+
+static const string UNKNOWN = "Unknown";
+static const char MAGIC[4] = {'P', '3', 'R', 'F'};
+static const uint32_t VERSION = 1;
+
+/**
+ * @brief Bagging: tree t is grown on n samples drawn with replacement by its own generator
+ *        (seeded from seed and t), so the forest does not depend on the number of threads.
+ * @param data labeled feature vectors (e.g. from DBManager::loadFeatureVectors)
+ * @param trees number of trees
+ * @param maxDepth maximum depth of each tree
+ * @param minSamplesLeaf minimum samples in each leaf
+ * @param seed seed of the bootstrap samples and feature draws
+ * @return -1 on invalid data, 0 on success
+ */
+int RandomForest::train(const TrainingSet& data, int trees, int maxDepth, int minSamplesLeaf, uint32_t seed) {
+    if (data.empty() || trees < 1) {
+        cerr << "Error: no training data for the random forest" << endl;
+        return -1;
+    }
+    vector<string> names;
+    unordered_map<string, int> labelIds;
+    vector<int> sampleLabels(data.size());
+    for (size_t i = 0; i < data.size(); i++) {
+        auto inserted = labelIds.emplace(data.labels()[i], static_cast<int>(names.size()));
+        if (inserted.second) names.push_back(data.labels()[i]);
+        sampleLabels[i] = inserted.first->second;
+    }
+    int classes = static_cast<int>(names.size());
+
+    TreeOptions options;
+    options.maxDepth = max(1, maxDepth);
+    options.minSamplesLeaf = minSamplesLeaf;
+    options.featuresPerSplit = max(1, cvRound(sqrt(static_cast<double>(FEATURE_DIMS))));
+    vector<vector<TreeNode>> treeNodes(trees);
+    vector<vector<int32_t>> treeLeaves(trees);
+    vector<int32_t> treeDepths(trees);
+    parallel_for_(Range(0, trees), [&](const Range& range) {
+        vector<int> samples(data.size());
+        for (int t = range.start; t < range.end; t++) {
+            mt19937 rng(seed + static_cast<uint32_t>(t) * 0x9E3779B9u);
+            for (int& sample : samples) {
+                sample = static_cast<int>(rng() % data.size());
+            }
+            TreeOptions treeOptions = options;
+            treeOptions.seed = rng();
+            treeDepths[t] = growTree(data, sampleLabels, classes, samples, treeOptions, treeNodes[t], treeLeaves[t]);
+        }
+    });
+
+    // One contiguous array: tree t starts at roots[t], child indices are shifted by the same offset
+    nodes.clear();
+    leafLabels.clear();
+    roots.assign(trees, 0);
+    for (int t = 0; t < trees; t++) {
+        int32_t offset = static_cast<int32_t>(nodes.size());
+        roots[t] = offset;
+        for (TreeNode node : treeNodes[t]) {
+            node.next += offset;
+            nodes.push_back(node);
+        }
+        leafLabels.insert(leafLabels.end(), treeLeaves[t].begin(), treeLeaves[t].end());
+    }
+    depths.swap(treeDepths);
+    labels.swap(names);
+    return 0;
+}
+
+int RandomForest::predict(const ObjectFeatures& features, float* confidence) const {
+    if (confidence) *confidence = 0;
+    if (roots.empty()) {
+        return -1;
+    }
+    AutoBuffer<int, 16> votes(labels.size());
+    fill(votes.data(), votes.data() + labels.size(), 0);
+    for (size_t t = 0; t < roots.size(); t++) {
+        int node = roots[t];
+        for (int step = 0; step < depths[t]; step++) {
+            const TreeNode& current = nodes[node];
+            node = current.next + (features[current.feature] > current.threshold);
+        }
+        if (leafLabels[node] >= 0) votes[leafLabels[node]]++;  // Only a corrupt model ends on an inner node
+    }
+    int best = static_cast<int>(max_element(votes.data(), votes.data() + labels.size()) - votes.data());
+    if (confidence) *confidence = static_cast<float>(votes[best]) / roots.size();
+    return best;
+}
+
+const string& RandomForest::labelName(int id) const {
+    return (id >= 0 && id < static_cast<int>(labels.size())) ? labels[id] : UNKNOWN;
+}
+
+string RandomForest::classify(const ObjectFeatures& features) const {
+    return labelName(predict(features));
+}
+
+/**
+ * @brief Batched inference: a block of rows goes through one tree before the next tree is loaded,
+ *        so each tree's nodes stay in cache for the whole block, and the rows advance one level at a
+ *        time so their node loads overlap. Votes are counted per row and label.
+ * @param features one feature vector per row, CV_32FC1
+ * @param labelIds output label ID per row, -1 if the forest is empty or the row size is wrong
+ * @param confidences optional output, share of trees voting for each row's label
+ */
+void RandomForest::predictBatch(const Mat& features, vector<int>& labelIds, vector<float>* confidences) const {
+    labelIds.assign(features.rows, -1);
+    if (confidences) confidences->assign(features.rows, 0.0f);
+    if (roots.empty() || features.type() != CV_32FC1 || static_cast<size_t>(features.cols) != FEATURE_DIMS) {
+        return;
+    }
+    const int BLOCK = 64;
+    int classes = static_cast<int>(labels.size());
+    int current[BLOCK];
+    const float* rows[BLOCK];
+    vector<int> votes(static_cast<size_t>(BLOCK) * classes);
+    for (int first = 0; first < features.rows; first += BLOCK) {
+        int count = min(BLOCK, features.rows - first);
+        for (int r = 0; r < count; r++) {
+            rows[r] = features.ptr<float>(first + r);
+        }
+        fill(votes.begin(), votes.end(), 0);
+        for (size_t t = 0; t < roots.size(); t++) {
+            for (int r = 0; r < count; r++) {
+                current[r] = roots[t];
+            }
+            for (int step = 0; step < depths[t]; step++) {
+                for (int r = 0; r < count; r++) {
+                    const TreeNode& node = nodes[current[r]];
+                    current[r] = node.next + (rows[r][node.feature] > node.threshold);
+                }
+            }
+            for (int r = 0; r < count; r++) {
+                int label = leafLabels[current[r]];
+                if (label >= 0) votes[r * classes + label]++;
+            }
+        }
+        for (int r = 0; r < count; r++) {
+            const int* rowVotes = &votes[r * classes];
+            int best = static_cast<int>(max_element(rowVotes, rowVotes + classes) - rowVotes);
+            labelIds[first + r] = best;
+            if (confidences) (*confidences)[first + r] = static_cast<float>(rowVotes[best]) / roots.size();
+        }
+    }
+}
+
+vector<string> RandomForest::classifyBatch(const vector<ObjectFeatures>& batch) const {
+    vector<string> result(batch.size(), UNKNOWN);
+    vector<int> labelIds;
+    predictBatch(featureMatrix(batch), labelIds);
+    for (size_t i = 0; i < batch.size(); i++) {
+        result[i] = labelName(labelIds[i]);
+    }
+    return result;
+}
+
+/**
+ * @brief Save the model: "P3RF", version, feature count, tree count, node count, root and depth per
+ *        tree, nodes (threshold, feature, next, leaf label) and label names, host byte order.
+ * @param path model file
+ * @return -1 failure, 0 success
+ */
+int RandomForest::save(const string& path) const {
+    ofstream out(path, ios::binary);
+    if (!out) {
+        cerr << "Error: cannot write random forest " << path << endl;
+        return -1;
+    }
+    uint32_t header[4] = {VERSION, static_cast<uint32_t>(FEATURE_DIMS), static_cast<uint32_t>(roots.size()),
+                          static_cast<uint32_t>(nodes.size())};
+    out.write(MAGIC, sizeof(MAGIC));
+    out.write(reinterpret_cast<const char*>(header), sizeof(header));
+    for (size_t t = 0; t < roots.size(); t++) {
+        out.write(reinterpret_cast<const char*>(&roots[t]), sizeof(int32_t));
+        out.write(reinterpret_cast<const char*>(&depths[t]), sizeof(int32_t));
+    }
+    for (size_t i = 0; i < nodes.size(); i++) {
+        out.write(reinterpret_cast<const char*>(&nodes[i].threshold), sizeof(float));
+        out.write(reinterpret_cast<const char*>(&nodes[i].feature), sizeof(int32_t));
+        out.write(reinterpret_cast<const char*>(&nodes[i].next), sizeof(int32_t));
+        out.write(reinterpret_cast<const char*>(&leafLabels[i]), sizeof(int32_t));
+    }
+    uint32_t labelCount = static_cast<uint32_t>(labels.size());
+    out.write(reinterpret_cast<const char*>(&labelCount), sizeof(labelCount));
+    for (const string& label : labels) {
+        uint32_t length = static_cast<uint32_t>(label.size());
+        out.write(reinterpret_cast<const char*>(&length), sizeof(length));
+        out.write(label.data(), length);
+    }
+    if (!out) {
+        cerr << "Error: failed writing random forest " << path << endl;
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Load a model written by save(); the current forest is kept if the file is invalid.
+ * @param path model file
+ * @return -1 failure, 0 success
+ */
+int RandomForest::load(const string& path) {
+    ifstream in(path, ios::binary);
+    if (!in) {
+        cerr << "Error: cannot open random forest " << path << endl;
+        return -1;
+    }
+    char magic[4];
+    uint32_t header[4] = {};
+    bool ok = in.read(magic, sizeof(magic)) && memcmp(magic, MAGIC, sizeof(MAGIC)) == 0
+              && in.read(reinterpret_cast<char*>(header), sizeof(header)) && header[0] == VERSION
+              && header[1] == FEATURE_DIMS && header[2] > 0 && header[2] < (1u << 16) && header[3] > 0 && header[3] < (1u << 26);
+    vector<int32_t> loadedRoots(ok ? header[2] : 0), loadedDepths(loadedRoots.size());
+    for (size_t t = 0; ok && t < loadedRoots.size(); t++) {
+        ok = in.read(reinterpret_cast<char*>(&loadedRoots[t]), sizeof(int32_t))
+             && in.read(reinterpret_cast<char*>(&loadedDepths[t]), sizeof(int32_t))
+             && loadedRoots[t] >= 0 && static_cast<uint32_t>(loadedRoots[t]) < header[3]
+             && loadedDepths[t] >= 0 && static_cast<uint32_t>(loadedDepths[t]) < header[3];
+    }
+    vector<TreeNode> loadedNodes(ok ? header[3] : 0);
+    vector<int32_t> loadedLeaves(loadedNodes.size());
+    for (size_t i = 0; ok && i < loadedNodes.size(); i++) {
+        ok = in.read(reinterpret_cast<char*>(&loadedNodes[i].threshold), sizeof(float))
+             && in.read(reinterpret_cast<char*>(&loadedNodes[i].feature), sizeof(int32_t))
+             && in.read(reinterpret_cast<char*>(&loadedNodes[i].next), sizeof(int32_t))
+             && in.read(reinterpret_cast<char*>(&loadedLeaves[i]), sizeof(int32_t));
+    }
+    uint32_t labelCount = 0;
+    ok = ok && in.read(reinterpret_cast<char*>(&labelCount), sizeof(labelCount)) && labelCount > 0 && labelCount < 65536;
+    vector<string> loadedLabels;
+    for (uint32_t i = 0; ok && i < labelCount; i++) {
+        uint32_t length = 0;
+        ok = in.read(reinterpret_cast<char*>(&length), sizeof(length)) && length < 4096;
+        string label(ok ? length : 0, '\0');
+        ok = ok && in.read(&label[0], length);
+        loadedLabels.push_back(label);
+    }
+    // Every step must stay inside the array: a leaf loops back to itself whatever the feature value
+    // (threshold +infinity) and names a label, a split has both children in the array
+    for (size_t i = 0; ok && i < loadedNodes.size(); i++) {
+        const TreeNode& node = loadedNodes[i];
+        bool leaf = loadedLeaves[i] >= 0;
+        ok = node.feature >= 0 && static_cast<uint32_t>(node.feature) < header[1] && node.next >= 0
+             && (leaf ? static_cast<size_t>(node.next) == i && node.threshold == numeric_limits<float>::infinity()
+                            && loadedLeaves[i] < static_cast<int32_t>(labelCount)
+                      : static_cast<size_t>(node.next) + 1 < loadedNodes.size());
+    }
+    if (!ok) {
+        cerr << "Error: invalid random forest " << path << endl;
+        return -1;
+    }
+    nodes.swap(loadedNodes);
+    leafLabels.swap(loadedLeaves);
+    roots.swap(loadedRoots);
+    depths.swap(loadedDepths);
+    labels.swap(loadedLabels);
+    return 0;
+}
@@ -0,0 +1,290 @@
+/*
+ * Authors: Yuyang Tian and Arun Mekkad
+ * Date: 2025/2/23
+ * Purpose: Run-length labeling that collects region statistics in the same pass
+ */
+
+#include "../include/region_stats.h"
+#include <iostream>
+#include <algorithm>
+
+// Sum of x^k for x in [0, n), k = 0..3
+static inline void powerSums(int64_t n, int64_t sums[4]) {
+    sums[0] = n;
+    sums[1] = n * (n - 1) / 2;
+    sums[2] = (n - 1) * n * (2 * n - 1) / 6;
+    sums[3] = sums[1] * sums[1];
+}
+
+/**
+ * @brief Add the pixels of one run to the statistics of its region.
+ *        Sums of x^p over the run come from closed forms, so a run costs O(1) whatever its length.
+ */
+void accumulateRun(RegionStats& stats, const PixelRun& run) {
+    int64_t upTo[4], below[4];
+    powerSums(run.end, upTo);
+    powerSums(run.start, below);
+    double s0 = static_cast<double>(upTo[0] - below[0]);
+    double s1 = static_cast<double>(upTo[1] - below[1]);
+    double s2 = static_cast<double>(upTo[2] - below[2]);
+    double s3 = static_cast<double>(upTo[3] - below[3]);
+    double y = run.row;
+
+    stats.m00 += s0;
+    stats.m10 += s1;
+    stats.m01 += s0 * y;
+    stats.m20 += s2;
+    stats.m11 += s1 * y;
+    stats.m02 += s0 * y * y;
+    stats.m30 += s3;
+    stats.m21 += s2 * y;
+    stats.m12 += s1 * y * y;
+    stats.m03 += s0 * y * y * y;
+
+    Rect runRect(run.start, run.row, run.end - run.start, 1);
+    stats.bbox = (stats.area == 0) ? runRect : (stats.bbox | runRect);
+    stats.area += run.end - run.start;
+}
+
+// Collect the foreground runs of every row of a 0 / non-zero CV_8UC1 image, in raster order
+void extractRuns(const Mat& binaryImage, vector<PixelRun>& runs) {
+    runs.clear();
+    for (int y = 0; y < binaryImage.rows; y++) {
+        const uchar* row = binaryImage.ptr<uchar>(y);
+        const uchar* end = row + binaryImage.cols;
+        const uchar* p = row;
+        while (p < end) {
+            p = find_if(p, end, [](uchar v) { return v != 0; });
+            if (p == end) break;
+            const uchar* runEnd = find(p, end, 0);
+            runs.push_back({y, static_cast<int>(p - row), static_cast<int>(runEnd - row), 0});
+            p = runEnd;
+        }
+    }
+}
+
+static int runLengthSegmentation(const Mat& binaryImage, Mat& regionMap, vector<RegionStats>& stats,
+                                 int minRegionSize, bool eightConnectivity, LabelScratch* scratch) {
+    if (binaryImage.empty()) {
+        cerr << "ERROR: run_length_segmentation - empty image" << endl;
+        return -1;
+    }
+    if (binaryImage.type() != CV_8UC1) { // Ensure it's a binary image
+        cerr << "ERROR: run_length_segmentation - not Binary image" << endl;
+        return -1;
+    }
+    vector<PixelRun> localRuns;
+    vector<PixelRun>& runs = scratch ? scratch->runs : localRuns;
+    extractRuns(binaryImage, runs);
+    return labelRuns(runs, binaryImage.size(), regionMap, minRegionSize,
+                     eightConnectivity, eightConnectivity, &stats, scratch);
+}
+
+// Run-length segmentation with 4-connectivity; stats[i] describes region i + 1
+int runLengthSegmentation4conn(const Mat& binaryImage, Mat& regionMap, vector<RegionStats>& stats,
+                               int minRegionSize) {
+    return runLengthSegmentation(binaryImage, regionMap, stats, minRegionSize, false, nullptr);
+}
+
+// Run-length segmentation with 8-connectivity, border regions removed; stats[i] describes region i + 1
+int runLengthSegmentation8conn(const Mat& binaryImage, Mat& regionMap, vector<RegionStats>& stats,
+                               int minRegionSize) {
+    return runLengthSegmentation(binaryImage, regionMap, stats, minRegionSize, true, nullptr);
+}
+
+// Same as above with caller-owned scratch buffers
+int runLengthSegmentation8conn(const Mat& binaryImage, Mat& regionMap, vector<RegionStats>& stats,
+                               LabelScratch& scratch, int minRegionSize) {
+    return runLengthSegmentation(binaryImage, regionMap, stats, minRegionSize, true, &scratch);
+}
+
+static int runLengthSegmentationPacked(const PackedBinaryImage& binary, Mat& regionMap, vector<RegionStats>& stats,
+                                       int minRegionSize, LabelScratch* scratch) {
+    if (binary.empty()) {
+        cerr << "ERROR: run_length_segmentation - empty image" << endl;
+        return -1;
+    }
+    vector<PixelRun> localRuns;
+    vector<PixelRun>& runs = scratch ? scratch->runs : localRuns;
+    extractRuns(binary, runs);
+    return labelRuns(runs, Size(binary.cols, binary.rows), regionMap, minRegionSize, true, true, &stats, scratch);
+}
+
+// Run-length segmentation of a packed binary image with 8-connectivity, border regions removed
+int runLengthSegmentation8conn(const PackedBinaryImage& binary, Mat& regionMap, vector<RegionStats>& stats,
+                               int minRegionSize) {
+    return runLengthSegmentationPacked(binary, regionMap, stats, minRegionSize, nullptr);
+}
+
+// Same as above with caller-owned scratch buffers
+int runLengthSegmentation8conn(const PackedBinaryImage& binary, Mat& regionMap, vector<RegionStats>& stats,
+                               LabelScratch& scratch, int minRegionSize) {
+    return runLengthSegmentationPacked(binary, regionMap, stats, minRegionSize, &scratch);
+}
+
+// Pad boxes, clip them to the frame and merge overlapping or touching windows until they are apart
+static void mergeWindows(const vector<Rect>& boxes, int margin, Size frameSize, vector<Rect>& windows) {
+    Rect frameRect(Point(0, 0), frameSize);
+    windows.clear();
+    for (const Rect& box : boxes) {
+        Rect window = Rect(box.x - margin, box.y - margin, box.width + 2 * margin, box.height + 2 * margin) & frameRect;
+        if (window.area() > 0) windows.push_back(window);
+    }
+    bool merged = true;
+    while (merged) {
+        merged = false;
+        for (size_t i = 0; i < windows.size() && !merged; i++) {
+            for (size_t j = i + 1; j < windows.size(); j++) {
+                // Touching windows are merged too, a region may cross from one into the other
+                Rect grown(windows[i].x - 1, windows[i].y - 1, windows[i].width + 2, windows[i].height + 2);
+                if ((grown & windows[j]).area() > 0) {
+                    windows[i] |= windows[j];
+                    windows.erase(windows.begin() + j);
+                    merged = true;
+                    break;
+                }
+            }
+        }
+    }
+}
+
+/**
+ * @brief Incremental segmentation: only the windows around known objects are processed.
+ * @param frame BGR frame (CV_8UC3).
+ * @param boxes Bounding boxes of the objects of the previous frame.
+ * @param margin Padding around each box, the distance an object may move between frames.
+ * @param thresholdValue Threshold of the last full-frame scan (a window histogram is biased by the object).
+ * @param morphSteps Morphological filtering applied to each window.
+ * @param regionMap Output region map of the whole frame, 0 outside the regions.
+ * @param stats Output statistics, stats[i] describes region i + 1.
+ * @param clippedRegions Number of regions touching a window edge that is not the frame border.
+ * @param minRegionSize Minimum region size in pixels.
+ * @return number of regions, -1 on failure
+ */
+int segmentWindows8conn(const Mat& frame, const vector<Rect>& boxes, int margin, float thresholdValue,
+                        const vector<MorphStep>& morphSteps, Mat& regionMap, vector<RegionStats>& stats,
+                        int& clippedRegions, int minRegionSize) {
+    clippedRegions = 0;
+    if (frame.empty() || frame.type() != CV_8UC3) {
+        cerr << "ERROR: segmentWindows8conn - invalid frame" << endl;
+        return -1;
+    }
+    vector<Rect> windows;
+    mergeWindows(boxes, margin, frame.size(), windows);
+
+    // Windows are disjoint, each one is processed independently
+    vector<vector<PixelRun>> windowRuns(windows.size());
+    parallel_for_(Range(0, static_cast<int>(windows.size())), [&](const Range& range) {
+        for (int w = range.start; w < range.end; w++) {
+            const Rect& window = windows[w];
+            Mat value, binary, filtered;
+            bgr_to_value(frame(window), value);
+            cv::threshold(value, binary, floor(thresholdValue), 255, THRESH_BINARY);
+            applyMorphologicalFiltering(binary, filtered, morphSteps);
+            extractRuns(filtered, windowRuns[w]);
+            for (PixelRun& run : windowRuns[w]) {
+                run.row += window.y;
+                run.start += window.x;
+                run.end += window.x;
+            }
+        }
+    });
+
+    // Raster order over the whole frame, then the usual labeling
+    vector<PixelRun> runs;
+    for (const vector<PixelRun>& windowRun : windowRuns) {
+        runs.insert(runs.end(), windowRun.begin(), windowRun.end());
+    }
+    sort(runs.begin(), runs.end(), [](const PixelRun& a, const PixelRun& b) {
+        return (a.row != b.row) ? a.row < b.row : a.start < b.start;
+    });
+    int count = labelRuns(runs, frame.size(), regionMap, minRegionSize, true, true, &stats);
+
+    // A region reaching an inner window edge may have been cut by the window
+    vector<uchar> clipped(count + 1, 0);
+    for (const PixelRun& run : runs) {
+        if (!run.label || clipped[run.label]) continue;
+        for (const Rect& window : windows) {
+            if (run.row < window.y || run.row >= window.y + window.height ||
+                run.start < window.x || run.end > window.x + window.width) {
+                continue;
+            }
+            if ((run.row == window.y && window.y > 0) ||
+                (run.row == window.y + window.height - 1 && window.y + window.height < frame.rows) ||
+                (run.start == window.x && window.x > 0) ||
+                (run.end == window.x + window.width && window.x + window.width < frame.cols)) {
+                clipped[run.label] = 1;
+                clippedRegions++;
+            }
+            break;
+        }
+    }
+    return count;
+}
+
+/**
+ * @brief Coarse-to-fine segmentation. The coarse level only has to find the objects: its kernels
+ *        and minimum size are scaled down, and its boxes are padded by one coarse pixel plus margin
+ *        before the full-resolution pass, which produces the regions and statistics.
+ * @param frame BGR frame (CV_8UC3).
+ * @param levels Pyramid levels, 1 = half size, 2 = quarter size.
+ * @param margin Padding around each upscaled candidate box.
+ * @param thresholdValue In: initial threshold, out: threshold used for both levels.
+ * @param method Threshold selection on the coarse histogram.
+ * @param morphSteps Morphological filtering at full resolution.
+ * @param regionMap Output region map of the whole frame, 0 outside the regions.
+ * @param stats Output statistics, stats[i] describes region i + 1.
+ * @param clippedRegions Number of full-resolution regions cut by a window; if non-zero the caller
+ *        should fall back to a full-frame segmentation.
+ * @param minRegionSize Minimum region size in full-resolution pixels.
+ * @return number of regions, -1 on failure
+ */
+int pyramidSegmentation8conn(const Mat& frame, int levels, int margin, float& thresholdValue,
+                             ThresholdMethod method, const vector<MorphStep>& morphSteps, Mat& regionMap,
+                             vector<RegionStats>& stats, int& clippedRegions, int minRegionSize) {
+    clippedRegions = 0;
+    if (frame.empty() || frame.type() != CV_8UC3 || levels < 1) {
+        cerr << "ERROR: pyramidSegmentation8conn - invalid frame or levels" << endl;
+        return -1;
+    }
+    int factor = 1 << levels;
+    Size coarseSize(frame.cols / factor, frame.rows / factor);
+    if (coarseSize.width < 8 || coarseSize.height < 8) {
+        cerr << "ERROR: pyramidSegmentation8conn - frame too small for " << levels << " levels" << endl;
+        return -1;
+    }
+
+    // Coarse level: area averaging keeps the histogram close to the full-resolution one
+    Mat coarse, value, binary, filtered, coarseMap;
+    resize(frame, coarse, coarseSize, 0, 0, INTER_AREA);
+    bgr_to_value(coarse, value);
+    float used = threshold(value, binary, thresholdValue, method);
+    if (used < 0) {
+        return -1;
+    }
+    thresholdValue = used;
+    vector<MorphStep> coarseSteps;
+    for (const MorphStep& step : morphSteps) {
+        Size kernel(max(1, cvRound(step.kernel.width / static_cast<double>(factor))),
+                    max(1, cvRound(step.kernel.height / static_cast<double>(factor))));
+        coarseSteps.push_back({step.op, kernel});
+    }
+    applyMorphologicalFiltering(binary, filtered, coarseSteps);
+    vector<RegionStats> coarseStats;
+    // Half the scaled minimum size, so borderline regions are still refined and decided at full size
+    int coarseCount = runLengthSegmentation8conn(filtered, coarseMap, coarseStats,
+                                                 max(1, minRegionSize / (2 * factor * factor)));
+    if (coarseCount < 0) {
+        return -1;
+    }
+
+    // Fine level: full resolution inside the upscaled candidate boxes
+    vector<Rect> boxes;
+    boxes.reserve(coarseStats.size());
+    for (const RegionStats& region : coarseStats) {
+        boxes.emplace_back(region.bbox.x * factor, region.bbox.y * factor,
+                           region.bbox.width * factor, region.bbox.height * factor);
+    }
+    return segmentWindows8conn(frame, boxes, margin + factor, thresholdValue, morphSteps, regionMap, stats,
+                               clippedRegions, minRegionSize);
+}
@@ -0,0 +1,119 @@
+/*
+ * Authors: Yuyang Tian and Arun Mekkad
+ * Date: 2025/3/1
+ * Purpose: Lock-free per-stage latency histograms and metrics export
+ */
+
+#include "../include/stage_metrics.h"
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+
+// Values below 16 map to themselves, larger ones to (exponent group, top 4 bits below the msb)
+int LatencyHistogram::bucketIndex(uint64_t value) {
+    if (value < SUB_BUCKETS) {
+        return static_cast<int>(value);
+    }
+    int msb = 63 - __builtin_clzll(value);
+    int group = msb - SUB_BUCKET_BITS + 1;
+    int sub = static_cast<int>(value >> (msb - SUB_BUCKET_BITS)) - SUB_BUCKETS;
+    return group * SUB_BUCKETS + sub;
+}
+
+uint64_t LatencyHistogram::bucketLowerBound(int index) {
+    int group = index / SUB_BUCKETS;
+    uint64_t sub = index % SUB_BUCKETS;
+    return group == 0 ? sub : (SUB_BUCKETS + sub) << (group - 1);
+}
+
+void LatencyHistogram::record(int64_t ns) {
+    uint64_t value = ns > 0 ? static_cast<uint64_t>(ns) : 0;
+    counts[bucketIndex(value)].fetch_add(1, memory_order_relaxed);
+    total.fetch_add(1, memory_order_relaxed);
+    int64_t previous = maxValue.load(memory_order_relaxed);
+    while (ns > previous && !maxValue.compare_exchange_weak(previous, ns, memory_order_relaxed)) {
+    }
+}
+
+int64_t LatencyHistogram::percentile(double p) const {
+    uint64_t n = count();
+    if (n == 0) {
+        return 0;
+    }
+    uint64_t target = std::max<uint64_t>(1, static_cast<uint64_t>(ceil(p * n)));
+    uint64_t seen = 0;
+    for (int i = 0; i < NUM_BUCKETS; i++) {
+        seen += counts[i].load(memory_order_relaxed);
+        if (seen >= target) {
+            uint64_t upper = (i + 1 < NUM_BUCKETS) ? bucketLowerBound(i + 1) - 1 : UINT64_MAX;
+            return static_cast<int64_t>(std::min<uint64_t>(upper, static_cast<uint64_t>(max())));
+        }
+    }
+    return max();  // Counts moved by a concurrent record
+}
+
+void LatencyHistogram::reset() {
+    for (atomic<uint64_t>& bucket : counts) {
+        bucket.store(0, memory_order_relaxed);
+    }
+    total.store(0, memory_order_relaxed);
+    maxValue.store(0, memory_order_relaxed);
+}
+
+const char* StageMetrics::stageName(Stage stage) {
+    static const char* names[] = {"hsv", "threshold", "morphology", "labeling", "features",
+                                  "classification", "display"};
+    return names[static_cast<int>(stage)];
+}
+
+void StageMetrics::summaryLines(vector<string>& lines) const {
+    lines.clear();
+    char line[96];
+    for (int s = 0; s < static_cast<int>(Stage::COUNT); s++) {
+        const LatencyHistogram& h = histograms[s];
+        if (h.count() == 0) continue;
+        snprintf(line, sizeof(line), "%-14s p50 %7.2f ms  p99 %7.2f ms", stageName(static_cast<Stage>(s)),
+                 h.percentile(0.5) * 1e-6, h.percentile(0.99) * 1e-6);
+        lines.emplace_back(line);
+    }
+}
+
+/**
+ * @brief Dump every stage in a Prometheus-style text format. The file is written next to the
+ *        target and renamed over it, so a reader never sees a partial dump.
+ * @param path The metrics file.
+ * @return -1 failure, 0 success
+ */
+int StageMetrics::writeTextFile(const string& path) const {
+    string temporary = path + ".tmp";
+    {
+        ofstream out(temporary);
+        if (!out) {
+            cerr << "Error: cannot write metrics to " << temporary << endl;
+            return -1;
+        }
+        out << "# Per-stage latency in nanoseconds since the previous dump\n";
+        for (int s = 0; s < static_cast<int>(Stage::COUNT); s++) {
+            const LatencyHistogram& h = histograms[s];
+            const char* name = stageName(static_cast<Stage>(s));
+            out << "proj3_stage_count{stage=\"" << name << "\"} " << h.count() << "\n";
+            out << "proj3_stage_max_ns{stage=\"" << name << "\"} " << h.max() << "\n";
+            for (double q : {0.5, 0.9, 0.99}) {
+                out << "proj3_stage_latency_ns{stage=\"" << name << "\",quantile=\"" << q << "\"} "
+                    << h.percentile(q) << "\n";
+            }
+        }
+    }
+    if (rename(temporary.c_str(), path.c_str()) != 0) {
+        cerr << "Error: cannot replace " << path << endl;
+        return -1;
+    }
+    return 0;
+}
+
+void StageMetrics::reset() {
+    for (LatencyHistogram& h : histograms) {
+        h.reset();
+    }
+}
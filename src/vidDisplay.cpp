@@ -6,10 +6,26 @@
 
 #include <opencv2/opencv.hpp>
 #include <iostream>
+#include <thread>
+#include <chrono>
+#include <mutex>
+#include <atomic>
+#include "../include/frame_ring.h"
+#include "../include/frame_arena.h"
 #include "../include/image_process.h"
+#include "../include/binary_image.h"
+#include "../include/region_stats.h"
+#include "../include/change_detector.h"
+#include "../include/stage_metrics.h"
 #include "../include/obb_feature_extraction.h"
 #include "../db/db_manager.h"
 #include "../include/classifier.h"
+#include "../include/nn_index.h"
+#include "../include/kd_tree.h"
+#include "../include/hnsw_index.h"
+#include "../include/quantized_index.h"
+#include "../include/decision_tree.h"
+#include "../include/random_forest.h"
 #include "../include/evaluate.h"
 
 using namespace cv;
@@ -28,6 +44,15 @@ private:
     enum class CLASSIFIER {
         NN,
         DT,
+        RF,
+    };
+    // How the nearest neighbor classifier searches the training data
+    enum class NNSearch {
+        LINEAR,  // NNIndex: SIMD scan, fastest for small databases
+        KDTREE,  // KDTreeIndex: exact, logarithmic for large databases
+        HNSW,    // HNSWIndex: approximate, for pooled stores with millions of samples
+        INT8,    // QuantizedIndex: int8 scan + float rescoring, about a third of the NNIndex memory
+        FP16,    // QuantizedIndex: float16 scan + float rescoring
     };
 
     // Constants for window names
@@ -40,24 +65,88 @@ private:
     // Member variables
     VideoCapture cap;
     DBManager db;
-    vector<pair<string, vector<float>>> dbFeatures; // Static storage
+    size_t trainingSamples = 0;  // Samples the indexes were built from; the training set itself is released
+    NNSearch nnSearch = NNSearch::LINEAR;
+    int nnK = 1;  // Neighbors voting on a label; k > 1 always uses the batched NNIndex
+    NNIndex nnIndex;  // Training set normalized once for nearest neighbor queries
+    KDTreeIndex kdTree;
+    HNSWIndex hnsw;
+    QuantizedIndex quantized;  // Rescores from its own residuals
+    string hnswPath;  // Saved graph, loaded instead of rebuilt when present
+    DecisionTree decisionTree;  // Trained from the database when first selected
+    int decisionTreeDepth = 3;
+    string decisionTreePath;  // Trained model is exported here, empty = not saved
+    RandomForest randomForest;  // Trained from the database on all cores when first selected
+    int forestTrees = 32;
+    int forestDepth = 8;
+    string forestPath;  // Trained forest is exported here, empty = not saved
     const string OUTPUT_DIR = "../outputs/";
     int imageId = 0;
     Mode currentMode = Mode::NORMAL;
     CLASSIFIER currentClassifier = CLASSIFIER::NN;
     float scale_factor;
+    float lastThreshold = 128.0f;  // Warm start for ISODATA on the next frame
+    ThresholdMethod thresholdMethod = ThresholdMethod::ISODATA;
+    vector<MorphStep> morphSequence = {{MorphOp::ERODE, Size(3, 3)}};
+    bool packedBinary = false;  // Keep binary masks bit-packed between threshold and labeling
+    bool parallelLabeling = false;  // Label horizontal strips concurrently
+    bool multiObject = false;  // Classify every region of the frame instead of a single one
+    // Incremental mode: only windows around the previous frame's objects are processed
+    bool incremental = false;
+    bool fullScanRequested = false;
+    int framesSinceFullScan = 0;
+    vector<Rect> trackedBoxes;
+    const int FULL_SCAN_INTERVAL = 30;  // Frames between full scans that discover new objects
+    const int ROI_MARGIN = 16;  // Pixels an object may move between two frames
+    // Pyramid mode: objects are found at 1 / 2^pyramidLevels scale and segmented at full resolution
+    bool pyramid = false;
+    int pyramidLevels = 1;
+    const int PYRAMID_MARGIN = 8;  // Padding around the upscaled coarse boxes
+    // Change gating: static frames keep the previous segmentation, features and labels
+    bool changeGating = false;
+    ChangeDetector changeDetector;
     Size targetSize;
     bool trainingMode;
+
+    // Pipeline: capture thread -> processing thread -> display (main thread, HighGUI and keys)
+    struct CapturedFrame {
+        Mat image;
+        int64 captureTick = 0;
+    };
+    struct DisplayFrame {
+        vector<pair<string, Mat>> views;  // Window name and image, shown in order; buffers are reused
+        size_t viewCount = 0;  // Views of this frame, the rest are spare buffers
+        int64 captureTick = 0;
+        int settingsVersion = 0;  // Views produced before a key press are stale
+    };
+    TripleBuffer<CapturedFrame> captureRing;
+    TripleBuffer<DisplayFrame> displayRing;
+    atomic<bool> running{false};
+    atomic<int> settingsVersion{0};
+    mutex stateMutex;  // Processing state: held for a whole frame and while handling a key
+    bool pipelineStats = false;  // Report stage rates, queue depths and frame age periodically
+    const double STATS_INTERVAL = 5.0;  // Seconds between reports
+    // Stage counters; ages are measured from capture to display (glass to label)
+    atomic<int> capturedFrames{0}, droppedFrames{0}, processedFrames{0}, supersededFrames{0}, displayedFrames{0};
+    double frameAgeSum = 0, frameAgeMax = 0;  // Display thread only
+    StageMetrics stageMetrics;  // Per-stage latency, recorded by the processing and display threads
+    bool latencyOverlay = false;  // Draw p50 / p99 per stage on the OBB window
+    string metricsPath;  // Stage latencies are dumped here every STATS_INTERVAL, empty = off
+    vector<string> latencyLines;  // Overlay text, reused between frames
     struct Images {
         Mat frame;
-        Mat hsv;
         Mat valueChannel;
         Mat thresholded;
         Mat morp;
+        PackedBinaryImage packedThresholded;
+        PackedBinaryImage packedMorp;
         Mat regionMap;
+        vector<RegionStats> regionStats;  // Filled by run-length labeling
         Mat colorizedRegions;
         Mat obb;
-        vector<float> features;
+        ObjectFeatures features;
+        vector<RegionObject> objects;  // Multi-object mode
+        FrameArena arena;  // Scratch buffers, sized once from targetSize
     } imgs;
 
     string generateFilename(const string& task = "", const string& suffix = "") {
@@ -86,27 +175,128 @@ private:
                 break;
         }
     }
+    /**
+     * @brief Loads the training data and builds the selected nearest neighbor index, once. The indexes
+     *        keep what they need, so the loaded training set is freed afterwards.
+     */
+    void loadTrainingData() {
+        if (trainingSamples == 0) {
+            TrainingSet dbFeatures;
+            db.loadFeatureVectors(dbFeatures); // Load features only once
+            trainingSamples = dbFeatures.size();
+            if (nnSearch == NNSearch::KDTREE) {
+                kdTree.build(dbFeatures);
+            }
+            if (nnSearch == NNSearch::HNSW) {
+                loadHNSW(dbFeatures);
+            }
+            if (nnSearch == NNSearch::INT8 || nnSearch == NNSearch::FP16) {
+                quantized.build(dbFeatures, nnSearch == NNSearch::INT8 ? QuantizedIndex::Precision::INT8
+                                                                       : QuantizedIndex::Precision::FP16);
+            }
+            if (nnSearch == NNSearch::LINEAR || nnK > 1) {
+                nnIndex.build(dbFeatures);
+            }
+        }
+    }
+
+    /**
+     * @brief Trains the decision tree or random forest the first time it classifies, so sessions that
+     *        never select them skip the training (seconds for a forest over a large database). The
+     *        training set is reloaded for it and freed again.
+     * @param classifier The classifier about to be used.
+     */
+    void trainClassifier(CLASSIFIER classifier) {
+        bool needsTree = classifier == CLASSIFIER::DT && decisionTree.empty();
+        bool needsForest = classifier == CLASSIFIER::RF && randomForest.empty();
+        if (trainingSamples == 0 || (!needsTree && !needsForest)) {
+            return;
+        }
+        TrainingSet dbFeatures;
+        db.loadFeatureVectors(dbFeatures);
+        if (needsTree) {
+            if (decisionTree.train(dbFeatures, decisionTreeDepth) == 0 && !decisionTreePath.empty()) {
+                decisionTree.save(decisionTreePath);
+            }
+        } else {
+            cout << "Training random forest over " << dbFeatures.size() << " samples..." << endl;
+            if (randomForest.train(dbFeatures, forestTrees, forestDepth) == 0 && !forestPath.empty()) {
+                randomForest.save(forestPath);
+            }
+        }
+    }
+
+    /**
+     * @brief Decision tree label: the tree trained on the database, or the built-in tree without data.
+     * @param features The feature vector of an object.
+     * @return The label of the leaf reached.
+     */
+    string decisionTreeLabel(const ObjectFeatures& features) const {
+        return decisionTree.empty() ? classifyByDecisionTree(features) : decisionTree.classify(features);
+    }
+
+    /**
+     * @brief Loads the saved HNSW graph if it matches the training data, otherwise builds and saves it.
+     * @param dbFeatures The training data.
+     */
+    void loadHNSW(const TrainingSet& dbFeatures) {
+        int ef = hnsw.efSearch();
+        if (!hnswPath.empty() && hnsw.load(hnswPath, HNSWIndex::fingerprint(dbFeatures)) == 0) {
+            hnsw.setEfSearch(ef);
+            return;
+        }
+        cout << "Building HNSW index over " << dbFeatures.size() << " samples..." << endl;
+        hnsw.build(dbFeatures);
+        hnsw.setEfSearch(ef);
+        if (!hnswPath.empty()) {
+            hnsw.save(hnswPath);
+        }
+    }
+
+    /**
+     * @brief Nearest neighbor label with the selected search.
+     * @param features The feature vector of an object.
+     * @return The label of the closest object in the database, "Unknown" if none is close enough.
+     */
+    string nearestNeighbor(const ObjectFeatures& features) const {
+        if (nnK > 1) {
+            return nnIndex.classifyBatch({features}, nnK)[0];
+        }
+        switch (nnSearch) {
+            case NNSearch::KDTREE:
+                return kdTree.classify(features);
+            case NNSearch::HNSW:
+                return hnsw.classify(features);
+            case NNSearch::INT8:
+            case NNSearch::FP16:
+                return quantized.classify(features);
+            default:
+                return nnIndex.classify(features);
+        }
+    }
     /**
      * @brief Classifies the current object using the specified classifier.
      * @param currentFeatures The feature vector of the current object.
-     * @param classifier The classifier to use (NN or Decision Tree).
+     * @param classifier The classifier to use (NN, Decision Tree or Random Forest).
      * @return The label of the closest object in the database.
      */
 
-    string classifyObject(const vector<float>& currentFeatures, CLASSIFIER classifier) {
-        if (dbFeatures.empty()) {
-            db.loadFeatureVectors(dbFeatures); // Load features only once
-        }
-        if (dbFeatures.empty()) {
+    string classifyObject(const ObjectFeatures& currentFeatures, CLASSIFIER classifier) {
+        loadTrainingData();
+        trainClassifier(classifier);
+        if (trainingSamples == 0) {
             return "Unknown";
         }
         string closestLabel = "Unknown";
         switch (classifier) {
             case CLASSIFIER::NN:
-                closestLabel = classifyByNN(dbFeatures, currentFeatures);
+                closestLabel = nearestNeighbor(currentFeatures);
                 break;
             case CLASSIFIER::DT:
-                closestLabel = classifyByDecisionTree(currentFeatures);
+                closestLabel = decisionTreeLabel(currentFeatures);
+                break;
+            case CLASSIFIER::RF:
+                closestLabel = randomForest.classify(currentFeatures);
                 break;
             default:
                 cerr << "ERROR: it's not a valid classifier!";
@@ -115,42 +305,193 @@ private:
         return closestLabel;
     }
 
+    /**
+     * @brief Classifies every object of the frame as one batch and stores the labels in place.
+     * @param objects The objects of the current frame, with features.
+     * @param classifier The classifier to use (NN, Decision Tree or Random Forest).
+     */
+    void classifyObjects(vector<RegionObject>& objects, CLASSIFIER classifier) {
+        loadTrainingData();
+        trainClassifier(classifier);
+        vector<ObjectFeatures> batch;
+        batch.reserve(objects.size());
+        for (const RegionObject& object : objects) {
+            batch.push_back(object.features);
+        }
+        vector<string> labels;
+        switch (classifier) {
+            case CLASSIFIER::NN:
+                if (nnK > 1) {
+                    labels = nnIndex.classifyBatch(batch, nnK);  // All objects in one blocked k-NN pass
+                } else {
+                    for (const ObjectFeatures& features : batch) {
+                        labels.push_back(nearestNeighbor(features));
+                    }
+                }
+                break;
+            case CLASSIFIER::DT:
+                labels = decisionTree.empty() ? vector<string>() : decisionTree.classifyBatch(batch);
+                for (size_t i = labels.size(); i < batch.size(); i++) {
+                    labels.push_back(classifyByDecisionTree(batch[i]));
+                }
+                break;
+            case CLASSIFIER::RF:
+                labels = randomForest.classifyBatch(batch);  // Tree by tree over all objects of the frame
+                break;
+        }
+        for (size_t i = 0; i < objects.size(); i++) {
+            objects[i].label = labels[i];
+        }
+    }
+
+    /**
+     * @brief Queues an image for display; the display thread may show it while the next frame is
+     *        processed, so it gets its own copy. A later view of the same window replaces it.
+     *        View buffers come back through the display ring, so copies do not allocate.
+     */
+    void show(DisplayFrame& output, const string& window, const Mat& image) {
+        for (size_t i = 0; i < output.viewCount; i++) {
+            if (output.views[i].first == window) {
+                image.copyTo(output.views[i].second);
+                return;
+            }
+        }
+        if (output.viewCount == output.views.size()) {
+            output.views.emplace_back();
+        }
+        pair<string, Mat>& view = output.views[output.viewCount++];
+        view.first = window;
+        image.copyTo(view.second);
+    }
+
 // Applies image processing and classification respective to the current mode
-    void processFrame() {
-        resize(imgs.frame, imgs.frame, targetSize);
+    void processFrame(const Mat& captured, DisplayFrame& output) {
+        resize(captured, imgs.frame, targetSize);
         if (trainingMode) {
-            imshow(WINDOW_VIDEO, imgs.frame);
+            show(output, WINDOW_VIDEO, imgs.frame);
+        }
+
+        // Incremental mode reuses the last threshold on the windows around the known objects and
+        // falls back to a full scan periodically, on request, or when an object left its window
+        bool incrementalFrame = false;
+        if (incremental && !trainingMode && !trackedBoxes.empty() && !fullScanRequested
+            && framesSinceFullScan < FULL_SCAN_INTERVAL) {
+            int clippedRegions = 0;
+            ScopedStageTimer timer(stageMetrics, Stage::LABELING);  // Windows are thresholded, filtered and labeled together
+            int count = segmentWindows8conn(imgs.frame, trackedBoxes, ROI_MARGIN, lastThreshold, morphSequence,
+                                            imgs.regionMap, imgs.regionStats, clippedRegions);
+            incrementalFrame = count > 0 && clippedRegions == 0;
+        }
+        if (incremental && !trainingMode) {
+            framesSinceFullScan = incrementalFrame ? framesSinceFullScan + 1 : 0;
+            fullScanRequested = false;
         }
 
-        if (currentMode >= Mode::THRESHOLD) {
-            bgr_to_hsv(imgs.frame, imgs.hsv);
-            extractChannel(imgs.hsv, imgs.valueChannel, 2);
-            threshold(imgs.valueChannel, imgs.thresholded);
-            if(trainingMode)
-            imshow(WINDOW_THRESHOLD, imgs.thresholded);
+        // Pyramid mode segments the full frame through its coarse level; a region cut by its window
+        // falls back to the full-resolution stages below
+        bool pyramidFrame = false;
+        if (pyramid && !trainingMode && !incrementalFrame) {
+            int clippedRegions = 0;
+            float usedThreshold = lastThreshold;
+            ScopedStageTimer timer(stageMetrics, Stage::LABELING);
+            int count = pyramidSegmentation8conn(imgs.frame, pyramidLevels, PYRAMID_MARGIN, usedThreshold,
+                                                 thresholdMethod, morphSequence, imgs.regionMap, imgs.regionStats,
+                                                 clippedRegions);
+            if (count >= 0) {
+                lastThreshold = usedThreshold;
+            }
+            pyramidFrame = count >= 0 && clippedRegions == 0;
         }
+        bool windowedFrame = incrementalFrame || pyramidFrame;
 
-        if (currentMode >= Mode::MORPHOLOGICAL) {
-            applyMorphologicalFiltering(imgs.thresholded, imgs.morp);
-            if(trainingMode)
-            imshow(WINDOW_MORPH, imgs.morp);
+        if (currentMode >= Mode::THRESHOLD && !windowedFrame) {
+            {
+                ScopedStageTimer timer(stageMetrics, Stage::HSV);
+                bgr_to_value(imgs.frame, imgs.valueChannel); // Only V is used for thresholding
+            }
+            {
+                ScopedStageTimer timer(stageMetrics, Stage::THRESHOLD);
+                float usedThreshold = packedBinary
+                        ? thresholdPacked(imgs.valueChannel, imgs.packedThresholded, lastThreshold, thresholdMethod)
+                        : threshold(imgs.valueChannel, imgs.thresholded, lastThreshold, thresholdMethod);
+                if (usedThreshold >= 0) {
+                    lastThreshold = usedThreshold;
+                }
+            }
+            if(trainingMode) {
+                if (packedBinary) unpackBinary(imgs.packedThresholded, imgs.thresholded);
+                show(output, WINDOW_THRESHOLD, imgs.thresholded);
+            }
         }
 
-        if (currentMode >= Mode::COLOR_SEG) {
-            twoPassSegmentation8conn(imgs.morp, imgs.regionMap);
-            colorizeRegions(imgs.regionMap, imgs.colorizedRegions);
-            if(trainingMode)
-            imshow(WINDOW_SEG, imgs.colorizedRegions);
+        if (currentMode >= Mode::MORPHOLOGICAL && !windowedFrame) {
+            {
+                ScopedStageTimer timer(stageMetrics, Stage::MORPHOLOGY);
+                if (packedBinary) {
+                    applyMorphologicalFilteringPacked(imgs.packedThresholded, imgs.packedMorp, morphSequence,
+                                                      imgs.arena.packedMorph);
+                } else {
+                    applyMorphologicalFiltering(imgs.thresholded, imgs.morp, morphSequence, imgs.arena.morph);
+                }
+            }
+            if(trainingMode) {
+                if (packedBinary) unpackBinary(imgs.packedMorp, imgs.morp);
+                show(output, WINDOW_MORPH, imgs.morp);
+            }
+        }
+
+        if (currentMode >= Mode::COLOR_SEG && !windowedFrame) {
+            {
+                ScopedStageTimer timer(stageMetrics, Stage::LABELING);
+                if (packedBinary) {
+                    runLengthSegmentation8conn(imgs.packedMorp, imgs.regionMap, imgs.regionStats, imgs.arena.labels);
+                } else if (parallelLabeling) {
+                    parallelSegmentation8conn(imgs.morp, imgs.regionMap);
+                    imgs.regionStats.clear();
+                } else {
+                    runLengthSegmentation8conn(imgs.morp, imgs.regionMap, imgs.regionStats, imgs.arena.labels);
+                }
+            }
+            if(trainingMode) { // Only shown in training mode
+                colorizeRegions(imgs.regionMap, imgs.colorizedRegions);
+                show(output, WINDOW_SEG, imgs.colorizedRegions);
+            }
         }
 
-        if (currentMode == Mode::OBB || !trainingMode) {
-            computeRegionFeatures(imgs.regionMap, 0, imgs.frame, imgs.obb, imgs.features);
+        if ((multiObject || incremental) && !trainingMode) {
+            // Every region, features extracted concurrently and classified as one batch
+            {
+                ScopedStageTimer timer(stageMetrics, Stage::FEATURES);
+                computeAllRegionFeatures(imgs.regionMap, imgs.regionStats, imgs.objects);
+            }
+            if (incremental) {
+                trackedBoxes.clear();
+                for (const RegionObject& object : imgs.objects) {
+                    trackedBoxes.push_back(object.geometry.bbox);
+                }
+            }
+            {
+                ScopedStageTimer timer(stageMetrics, Stage::CLASSIFICATION);
+                classifyObjects(imgs.objects, currentClassifier);
+            }
+            imgs.frame.copyTo(imgs.obb);
+            drawObjects(imgs.obb, imgs.objects);
+            show(output, WINDOW_OBB, imgs.obb);
+        } else if (currentMode == Mode::OBB || !trainingMode) {
+            {
+                ScopedStageTimer timer(stageMetrics, Stage::FEATURES);
+                computeRegionFeatures(imgs.regionMap, 0, imgs.frame, imgs.obb, imgs.features, imgs.arena.geometry);
+            }
             if (trainingMode) {
-                imshow(WINDOW_OBB, imgs.obb);
+                show(output, WINDOW_OBB, imgs.obb);
             } else {
-                string label = classifyObject(imgs.features, currentClassifier);
+                string label;
+                {
+                    ScopedStageTimer timer(stageMetrics, Stage::CLASSIFICATION);
+                    label = classifyObject(imgs.features, currentClassifier);
+                }
                 putText(imgs.obb, label, Point(10, 30), FONT_HERSHEY_SIMPLEX, 1, Scalar(255, 127, 80), 2);
-                imshow(WINDOW_OBB, imgs.obb);
+                show(output, WINDOW_OBB, imgs.obb);
             }
         }
         if (!trainingMode) {
@@ -158,14 +499,35 @@ private:
             switch (currentClassifier) {
                 case CLASSIFIER::NN:
                     putText(imgs.obb, "Nearest neighbor", Point(400, 300), FONT_HERSHEY_SIMPLEX, 0.5, Scalar(147, 112, 219), 1);
-                    imshow(WINDOW_OBB, imgs.obb);
+                    show(output, WINDOW_OBB, imgs.obb);
                     break;
                 case CLASSIFIER::DT:
                     putText(imgs.obb, "Decison tree", Point(400, 300), FONT_HERSHEY_SIMPLEX, 0.5, Scalar(147, 112, 219), 1);
-                    imshow(WINDOW_OBB, imgs.obb);
+                    show(output, WINDOW_OBB, imgs.obb);
+                    break;
+                case CLASSIFIER::RF:
+                    putText(imgs.obb, "Random forest", Point(400, 300), FONT_HERSHEY_SIMPLEX, 0.5, Scalar(147, 112, 219), 1);
+                    show(output, WINDOW_OBB, imgs.obb);
                     break;
             }
         }
+        if (latencyOverlay && (!trainingMode || currentMode == Mode::OBB)) {
+            drawLatencyOverlay(imgs.obb);
+            show(output, WINDOW_OBB, imgs.obb);
+        }
+    }
+
+    /**
+     * @brief Draws p50 / p99 of every stage measured since the last metrics interval.
+     * @param image The OBB image to draw on.
+     */
+    void drawLatencyOverlay(Mat& image) {
+        stageMetrics.summaryLines(latencyLines);
+        int y = image.rows - 8 - 14 * (static_cast<int>(latencyLines.size()) - 1);
+        for (const string& line : latencyLines) {
+            putText(image, line, Point(8, y), FONT_HERSHEY_PLAIN, 0.9, Scalar(0, 255, 255), 1);
+            y += 14;
+        }
     }
     /**
      * @brief Routes keypresses to the appropriate handler.
@@ -181,7 +543,7 @@ private:
                         cout << "Quitting..." << endl;
                         currentMode = Mode::NORMAL;  // Reset mode
                         destroyAllWindows();  // Close all windows
-                        exit(0);
+                        running = false;
                         break;
                     case 'z':
                         if (currentMode < Mode::THRESHOLD) {
@@ -192,6 +554,15 @@ private:
                             destroyWindow(WINDOW_THRESHOLD);
                         }
                         break;
+                    case 'o':
+                        if (thresholdMethod == ThresholdMethod::ISODATA) {
+                            thresholdMethod = ThresholdMethod::OTSU;
+                            cout << "using Otsu threshold" << endl;
+                        } else {
+                            thresholdMethod = ThresholdMethod::ISODATA;
+                            cout << "using ISODATA threshold" << endl;
+                        }
+                        break;
                     case 'f':
                         if (currentMode < Mode::MORPHOLOGICAL) {
                             currentMode = Mode::MORPHOLOGICAL;
@@ -245,15 +616,48 @@ private:
                     currentClassifier = CLASSIFIER::DT;
                     cout << "using DT" << endl;
                     break;
+                case 'f':
+                    currentClassifier = CLASSIFIER::RF;
+                    cout << "using RF" << endl;
+                    break;
+                case 'i':
+                    incremental = !incremental;
+                    trackedBoxes.clear();
+                    cout << (incremental ? "incremental ROI processing" : "full frame processing") << endl;
+                    break;
+                case 'r':
+                    fullScanRequested = true;  // Rediscover objects on the next frame
+                    break;
+                case 'p':
+                    pyramid = !pyramid;
+                    cout << (pyramid ? "coarse-to-fine segmentation" : "full resolution segmentation") << endl;
+                    break;
+                case 'm':
+                    multiObject = !multiObject;
+                    cout << (multiObject ? "classifying every object" : "classifying a single object") << endl;
+                    break;
                 case 'q':
                     cout << "Quitting..." << endl;
+                    if (changeGating) {
+                        cout << "Skipped " << changeDetector.framesSkipped() << " of "
+                             << changeDetector.framesSeen() << " frames" << endl;
+                    }
                     currentMode = Mode::NORMAL;  // Reset mode
                     destroyAllWindows();  // Close all windows
-                    exit(0);
+                    running = false;
+                    break;
+                case 'l':
+                    latencyOverlay = !latencyOverlay;
+                    break;
+                case 'g':
+                    changeGating = !changeGating;
+                    cout << (changeGating ? "skipping static frames" : "processing every frame") << endl;
                     break;
                 case 'e':
                     if(currentClassifier == CLASSIFIER::NN) {
-                        evaluateConfusionMatrix(0);
+                        evaluateConfusionMatrix(0, nnK);
+                    } else if (currentClassifier == CLASSIFIER::RF) {
+                        evaluateConfusionMatrix(2);
                     } else {
                         evaluateConfusionMatrix(1);
                     }
@@ -277,6 +681,7 @@ public:
         targetSize.width = frameSize.width * scale_factor;
         targetSize.height = frameSize.height * scale_factor;
         cout << "Camera initialized with resolution: " << targetSize.width << "x" << targetSize.height << endl;
+        imgs.arena.reserve(targetSize);
 
         namedWindow(WINDOW_VIDEO, WINDOW_AUTOSIZE);
         db = DBManager();
@@ -288,6 +693,276 @@ public:
         }
     }
 
+    /**
+     * @brief Capture stage: grabs frames as fast as the camera delivers them. When processing is
+     *        behind, a new frame replaces the unread one instead of queueing latency.
+     */
+    void captureLoop() {
+        CapturedFrame captured;
+        while (running) {
+            if (!cap.grab() || !cap.retrieve(captured.image) || captured.image.empty()) {
+                cout << "Exiting: Failed to capture frame" << endl;
+                running = false;
+                break;
+            }
+            captured.captureTick = getTickCount();
+            capturedFrames++;
+            if (!captureRing.push(captured)) {
+                droppedFrames++;  // The replaced frame was never processed
+            }
+        }
+    }
+
+    /**
+     * @brief Processing stage: always works on the newest captured frame.
+     */
+    void processLoop() {
+        CapturedFrame captured;
+        DisplayFrame output;
+        while (running) {
+            if (!captureRing.popLatest(captured)) {
+                this_thread::sleep_for(chrono::milliseconds(1));
+                continue;
+            }
+            try {
+                lock_guard<mutex> lock(stateMutex);
+                // Static scene: the last segmentation, features and labels are still valid
+                bool gated = changeGating && !trainingMode;
+                if (gated && !changeDetector.hasChanged(captured.image)) {
+                    continue;
+                }
+                output.viewCount = 0;
+                processFrame(captured.image, output);
+                output.captureTick = captured.captureTick;
+                output.settingsVersion = settingsVersion;
+            } catch (const exception& e) {
+                cerr << "Error: " << e.what() << endl;
+                running = false;
+                break;
+            }
+            processedFrames++;
+            if (!displayRing.push(output)) {
+                supersededFrames++;  // Processed but replaced before the display showed it
+            }
+        }
+    }
+
+    /**
+     * @brief Display stage (main thread): shows the newest processed views and handles keys.
+     */
+    void displayLoop() {
+        DisplayFrame frame;
+        int64 lastReport = getTickCount();
+        int64 lastMetrics = lastReport;
+        while (running) {
+            if (displayRing.popLatest(frame) && frame.settingsVersion == settingsVersion) {
+                {
+                    ScopedStageTimer timer(stageMetrics, Stage::DISPLAY);
+                    for (size_t i = 0; i < frame.viewCount; i++) {
+                        imshow(frame.views[i].first, frame.views[i].second);
+                    }
+                }
+                double age = (getTickCount() - frame.captureTick) * 1000.0 / getTickFrequency();
+                frameAgeSum += age;
+                frameAgeMax = max(frameAgeMax, age);
+                displayedFrames++;
+            }
+            int key = waitKey(5);
+            if (key != -1) {
+                lock_guard<mutex> lock(stateMutex);
+                handleKeyPress(static_cast<char>(key));
+                changeDetector.reset();  // Classifier or mode may have changed, refresh the results
+                settingsVersion++;
+            }
+            double elapsed = (getTickCount() - lastReport) / getTickFrequency();
+            if (pipelineStats && elapsed >= STATS_INTERVAL) {
+                reportStats(elapsed);
+                lastReport = getTickCount();
+            }
+            // Latency windows restart every interval, so the overlay and dump follow recent frames
+            if ((latencyOverlay || !metricsPath.empty())
+                && (getTickCount() - lastMetrics) / getTickFrequency() >= STATS_INTERVAL) {
+                if (!metricsPath.empty()) {
+                    stageMetrics.writeTextFile(metricsPath);
+                }
+                stageMetrics.reset();
+                lastMetrics = getTickCount();
+            }
+        }
+    }
+
+    /**
+     * @brief Prints per-stage rates, queue depths and capture-to-display age, then resets the counters.
+     * @param elapsed Seconds covered by the counters, 0 for a summary without rates.
+     */
+    void reportStats(double elapsed) {
+        int displayed = displayedFrames.exchange(0);
+        int captured = capturedFrames.exchange(0);
+        int processed = processedFrames.exchange(0);
+        cout << "Pipeline:";
+        if (elapsed > 0) {
+            cout << " capture " << captured / elapsed << " fps, process " << processed / elapsed
+                 << " fps, display " << displayed / elapsed << " fps;";
+        } else {
+            cout << " captured " << captured << ", processed " << processed << ", displayed " << displayed << ";";
+        }
+        cout << " queue depth capture " << captureRing.size() << " display " << displayRing.size()
+             << "; dropped " << droppedFrames.exchange(0) << " superseded " << supersededFrames.exchange(0)
+             << "; frame age mean " << (displayed ? frameAgeSum / displayed : 0.0)
+             << " ms max " << frameAgeMax << " ms" << endl;
+        frameAgeSum = 0;
+        frameAgeMax = 0;
+    }
+
+    /**
+     * @brief Replaces the morphological filtering sequence (default: 3x3 erosion).
+     * @param steps The steps to apply after thresholding.
+     */
+    void setMorphSequence(const vector<MorphStep>& steps) {
+        morphSequence = steps;
+    }
+
+    /**
+     * @brief Switches threshold, morphology and labeling to bit-packed binary images.
+     * @param enabled true to use the packed pipeline.
+     */
+    void setPackedBinary(bool enabled) {
+        packedBinary = enabled;
+    }
+
+    /**
+     * @brief Switches connected-component labeling to the strip-parallel implementation.
+     * @param enabled true to label with all OpenCV threads.
+     */
+    void setParallelLabeling(bool enabled) {
+        parallelLabeling = enabled;
+    }
+
+    /**
+     * @brief Classifies every region of the frame instead of a single one (classification mode).
+     * @param enabled true to detect multiple objects per frame.
+     */
+    void setMultiObject(bool enabled) {
+        multiObject = enabled;
+    }
+
+    /**
+     * @brief Processes only windows around the previous frame's objects, with periodic full scans
+     *        (classification mode, implies multi-object detection).
+     * @param enabled true to process frames incrementally.
+     */
+    void setIncremental(bool enabled) {
+        incremental = enabled;
+        trackedBoxes.clear();
+    }
+
+    /**
+     * @brief Selects the nearest neighbor search; call before the first frame.
+     * @param search "linear" (SIMD scan), "kdtree" (exact), "hnsw" (approximate), "int8" or "fp16"
+     *        (compressed scan, rescored in float).
+     * @param indexPath HNSW graph file, loaded if present and written after a build.
+     * @param efSearch HNSW beam width: higher raises recall and latency.
+     * @return -1 for an unknown search, 0 on success
+     */
+    int setNNSearch(const string& search, const string& indexPath, int efSearch) {
+        if (search == "kdtree") {
+            nnSearch = NNSearch::KDTREE;
+        } else if (search == "hnsw") {
+            nnSearch = NNSearch::HNSW;
+        } else if (search == "int8") {
+            nnSearch = NNSearch::INT8;
+        } else if (search == "fp16") {
+            nnSearch = NNSearch::FP16;
+        } else if (search == "linear") {
+            nnSearch = NNSearch::LINEAR;
+        } else {
+            cerr << "Error: unknown nearest neighbor search " << search << " (linear, kdtree, hnsw, int8, fp16)"
+                 << endl;
+            return -1;
+        }
+        hnswPath = indexPath;
+        hnsw.setEfSearch(efSearch);
+        return 0;
+    }
+
+    /**
+     * @brief Decision tree training settings.
+     * @param depth Maximum depth of the tree.
+     * @param modelPath File the trained model is written to (for BatchProcess --dt-model), empty for none.
+     */
+    void setDecisionTree(int depth, const string& modelPath) {
+        decisionTreeDepth = max(1, depth);
+        decisionTreePath = modelPath;
+    }
+
+    /**
+     * @brief Random forest training settings.
+     * @param trees Number of trees.
+     * @param depth Maximum depth of each tree.
+     * @param modelPath File the trained forest is written to (for BatchProcess --rf-model), empty for none.
+     */
+    void setRandomForest(int trees, int depth, const string& modelPath) {
+        forestTrees = max(1, trees);
+        forestDepth = max(1, depth);
+        forestPath = modelPath;
+    }
+
+    /**
+     * @brief Number of nearest neighbors voting on a label (also used by 'e').
+     * @param k neighbors, 1 for plain nearest neighbor.
+     */
+    void setNeighborCount(int k) {
+        nnK = max(1, k);
+    }
+
+    /**
+     * @brief Candidates of the int8 / fp16 scan that are rescored with the float features.
+     * @param candidates more raises the chance that the exact nearest sample is among them.
+     */
+    void setRescore(int candidates) {
+        quantized.setRescore(candidates);
+    }
+
+    /**
+     * @brief Finds objects on a downscaled copy and segments only their windows at full resolution
+     *        (classification mode).
+     * @param enabled true to segment coarse-to-fine.
+     * @param levels Pyramid levels of the coarse pass, 1 = half size, 2 = quarter size.
+     */
+    void setPyramid(bool enabled, int levels) {
+        pyramid = enabled;
+        pyramidLevels = max(1, levels);
+    }
+
+    /**
+     * @brief Skips the pipeline on static frames (classification mode) and reuses the last results.
+     * @param enabled true to gate frames on scene change.
+     * @param pixelThreshold Gray level difference that counts a downsampled pixel as changed.
+     * @param changedFraction Fraction of changed pixels that makes the frame changed.
+     */
+    void setChangeGating(bool enabled, int pixelThreshold, float changedFraction) {
+        changeGating = enabled;
+        changeDetector.setSensitivity(pixelThreshold, changedFraction);
+    }
+
+    /**
+     * @brief Prints pipeline rates, queue depths and frame age every few seconds.
+     * @param enabled true to report.
+     */
+    void setPipelineStats(bool enabled) {
+        pipelineStats = enabled;
+    }
+
+    /**
+     * @brief Per-stage latency reporting.
+     * @param overlay true to draw p50 / p99 per stage on the OBB window.
+     * @param path File the stage percentiles are written to every few seconds, empty for none.
+     */
+    void setStageMetrics(bool overlay, const string& path) {
+        latencyOverlay = overlay;
+        metricsPath = path;
+    }
+
     /**
      * @brief Main application loop.
      */
@@ -296,6 +971,7 @@ public:
             cout << "Training Mode:\n"
                  << " 's' - Save photo\n"
                  << " 'z' - Toggle Thresholding\n"
+                 << " 'o' - Toggle ISODATA / Otsu threshold\n"
                  << " 'f' - Toggle Morphological window\n"
                  << " 'c' - Toggle Colored segmented region window\n"
                  << " 't' - Toggle traning mode\n"
@@ -305,26 +981,23 @@ public:
             cout << "Classification Mode: DEFAULT classifier - Nearest neighbor\n"
                  << " 'n' - Nearest neighbor \n"
                  << " 'd' - Decision tree \n"
+                 << " 'f' - Random forest \n"
+                 << " 'm' - Toggle multi-object detection\n"
+                 << " 'i' - Toggle incremental ROI processing\n"
+                 << " 'r' - Full rescan for new objects\n"
+                 << " 'p' - Toggle coarse-to-fine segmentation\n"
+                 << " 'g' - Toggle skipping static frames\n"
+                 << " 'l' - Toggle stage latency overlay\n"
                  << " 'q' - Quit\n";
         }
-        try {
-            while (true) {
-                if (!cap.read(imgs.frame)) {
-                    throw runtime_error("Failed to capture frame");
-                }
-                if (imgs.frame.empty()) {
-                    cerr << "Error: Image not loaded!" << endl;
-                    return;
-                }
-                processFrame();
-                int key = waitKey(30);
-                if (key != -1) {
-                    handleKeyPress(static_cast<char>(key));
-                }
-            }
-        } catch (const runtime_error& e) {
-            cout << "Exiting: " << e.what() << endl;
-        }
+        running = true;
+        thread captureThread(&CameraApp::captureLoop, this);
+        thread processThread(&CameraApp::processLoop, this);
+        displayLoop();
+        running = false;
+        captureThread.join();
+        processThread.join();
+        reportStats(0);
     }
 
     ~CameraApp() {
@@ -336,10 +1009,111 @@ public:
 int main(int argc, char* argv[]) {
     try {
         bool trainingMode = false;
-        if (argc > 1 && string(argv[1]) == "--train") {
-            trainingMode = true;
+        vector<MorphStep> morphSequence;
+        bool packedBinary = false;
+        bool parallelLabeling = false;
+        bool multiObject = false;
+        bool incremental = false;
+        bool pyramid = false;
+        int pyramidLevels = 1;
+        string nnSearch = "linear";
+        string hnswPath;
+        int hnswEf = 32;
+        int rescore = QuantizedIndex::DEFAULT_RESCORE;
+        int dtDepth = 3;
+        string dtModelPath;
+        int rfTrees = 32;
+        int rfDepth = 8;
+        string rfModelPath;
+        int nnK = 1;
+        bool changeGating = false;
+        bool pipelineStats = false;
+        bool latencyOverlay = false;
+        string metricsPath;
+        int gateThreshold = 12;
+        float gateFraction = 0.005f;
+        bool rebuildStats = false;
+        for (int i = 1; i < argc; i++) {
+            string arg = argv[i];
+            if (arg == "--rebuild-stats") {
+                rebuildStats = true;
+            } else if (arg == "--train") {
+                trainingMode = true;
+            } else if (arg == "--packed") {
+                packedBinary = true;
+            } else if (arg == "--parallel-labeling") {
+                parallelLabeling = true;
+            } else if (arg == "--pipeline-stats") {
+                pipelineStats = true;
+            } else if (arg == "--latency-overlay") {
+                latencyOverlay = true;
+            } else if (arg == "--metrics" && i + 1 < argc) {
+                metricsPath = argv[++i];
+            } else if (arg == "--gate") {
+                changeGating = true;
+            } else if (arg == "--gate-threshold" && i + 1 < argc) {
+                gateThreshold = stoi(argv[++i]);
+            } else if (arg == "--gate-fraction" && i + 1 < argc) {
+                gateFraction = stof(argv[++i]);
+            } else if (arg == "--incremental") {
+                incremental = true;
+            } else if (arg == "--knn" && i + 1 < argc) {
+                nnK = stoi(argv[++i]);
+            } else if (arg == "--nn-search" && i + 1 < argc) {
+                nnSearch = argv[++i];
+            } else if (arg == "--dt-depth" && i + 1 < argc) {
+                dtDepth = stoi(argv[++i]);
+            } else if (arg == "--dt-model" && i + 1 < argc) {
+                dtModelPath = argv[++i];
+            } else if (arg == "--rf-trees" && i + 1 < argc) {
+                rfTrees = stoi(argv[++i]);
+            } else if (arg == "--rf-depth" && i + 1 < argc) {
+                rfDepth = stoi(argv[++i]);
+            } else if (arg == "--rf-model" && i + 1 < argc) {
+                rfModelPath = argv[++i];
+            } else if (arg == "--hnsw-index" && i + 1 < argc) {
+                hnswPath = argv[++i];
+            } else if (arg == "--hnsw-ef" && i + 1 < argc) {
+                hnswEf = stoi(argv[++i]);
+            } else if (arg == "--rescore" && i + 1 < argc) {
+                rescore = stoi(argv[++i]);
+            } else if (arg == "--pyramid") {
+                pyramid = true;
+            } else if (arg == "--pyramid-levels" && i + 1 < argc) {
+                pyramidLevels = stoi(argv[++i]);
+            } else if (arg == "--multi") {
+                multiObject = true;
+            } else if (arg == "--morph" && i + 1 < argc) {
+                // e.g. --morph open:7x7,close:15
+                if (parseMorphSequence(argv[++i], morphSequence) != 0) {
+                    return -1;
+                }
+            }
+        }
+        if (rebuildStats) {
+            // Maintenance only: loads never write, so stale statistics are repaired here
+            DBManager db;
+            return db.rebuildFeatureStats() < 0 ? -1 : 0;
         }
         CameraApp app(2, trainingMode); // Pass trainingMode to constructor
+        if (!morphSequence.empty()) {
+            app.setMorphSequence(morphSequence);
+        }
+        app.setPackedBinary(packedBinary);
+        app.setParallelLabeling(parallelLabeling);
+        app.setMultiObject(multiObject);
+        app.setIncremental(incremental);
+        app.setPyramid(pyramid, pyramidLevels);
+        if (app.setNNSearch(nnSearch, hnswPath, hnswEf) != 0) {
+            return -1;
+        }
+        app.setNeighborCount(nnK);
+        app.setRescore(rescore);
+        app.setDecisionTree(dtDepth, dtModelPath);
+        app.setRandomForest(rfTrees, rfDepth, rfModelPath);
+        app.setChangeGating(changeGating, gateThreshold, gateFraction);
+        app.setPipelineStats(pipelineStats);
+        app.setStageMetrics(latencyOverlay, metricsPath);
         app.run();
         return 0;
     } catch (const exception& e) {
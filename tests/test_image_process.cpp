@@ -8,6 +8,24 @@
 #include <opencv2/opencv.hpp>
 #include "../include/image_process.h"
 #include "../include/obb_feature_extraction.h"
+#include "../include/binary_image.h"
+#include "../include/change_detector.h"
+#include "../include/frame_ring.h"
+#include "../include/frame_arena.h"
+#include "../include/stage_metrics.h"
+#include "../include/classifier.h"
+#include "../include/nn_index.h"
+#include "../include/kd_tree.h"
+#include "../include/hnsw_index.h"
+#include "../include/quantized_index.h"
+#include "../include/decision_tree.h"
+#include "../include/random_forest.h"
+#include <random>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <atomic>
+#include <thread>
 #include "../db/db_manager.h"
 
 using namespace cv;
@@ -24,7 +42,7 @@ class ImageProcessingTest : public ::testing::Test {
 protected:
     cv::Mat binaryImage;
     cv::Mat regionMap;
-    vector<float> features;
+    ObjectFeatures features;
     DBManager db;
     int regionId = 2;
     cv::Mat dst;
@@ -74,7 +92,7 @@ TEST_F(ImageProcessingTest, TwoPassSegmentationTest) {
 TEST_F(ImageProcessingTest, OBBTest) {
     int regionId = 2;
     cv::Mat dst;
-    vector<float> features;
+    ObjectFeatures features;
     int result = computeRegionFeatures(regionMap, regionId, binaryImage, dst, features);
 
 // Validate the function execution
@@ -88,16 +106,1114 @@ TEST_F(ImageProcessingTest, OBBTest) {
 
 TEST_F(ImageProcessingTest, DBWriteTest) {
     db.deleteAll(); // clear previous records
-    ASSERT_FALSE(features.empty()) << "Feature vector is empty before DB write!";
+    ASSERT_NE(features, ObjectFeatures()) << "Feature vector is empty before DB write!";
     string label = "test";
     int result = db.writeFeatureVector(label, features);
     EXPECT_EQ(result, 0) << "DB Write failed to execute properly.";
 }
 
 TEST_F(ImageProcessingTest, DBReadTest) {
-    vector<pair<string, vector<float>>> data;
+    TrainingSet data;
     int result = db.loadFeatureVectors(data);
     // Validate the function execution
     cout << "The size is " << result << endl;
     EXPECT_GT(result, 0) << "DB Write failed to execute properly.";
-}
\ No newline at end of file
+}
+
+TEST_F(ImageProcessingTest, DBStatsTest) {
+    ASSERT_GE(db.rebuildFeatureStats(), 0);  // Statistics of every sample, whatever wrote the database before
+    TrainingSet data;
+    db.loadFeatureVectors(data);
+    FeatureStats before;
+    ASSERT_EQ(db.loadFeatureStats(before), 0);
+    EXPECT_EQ(before.count, static_cast<int64_t>(data.size()));
+
+    ObjectFeatures shifted = features;
+    for (float& value : shifted) value += 1.0f;
+    ASSERT_EQ(db.writeFeatureVector("stats test", features), 0);
+    ASSERT_EQ(db.writeFeatureVector("stats test", shifted), 0);
+    FeatureStats after;
+    ASSERT_EQ(db.loadFeatureStats(after), 0);
+    EXPECT_EQ(after.count, before.count + 2);
+
+    // Deleting the label takes both samples back out of the statistics
+    EXPECT_EQ(db.deleteLabel("stats test"), 2);
+    ASSERT_EQ(db.loadFeatureStats(after), 0);
+    EXPECT_EQ(after.count, before.count);
+    for (size_t d = 0; d < FEATURE_DIMS; d++) {
+        EXPECT_NEAR(after.mean[d], before.mean[d], 1e-9 * (1.0 + fabs(before.mean[d])));
+        EXPECT_NEAR(after.m2[d], before.m2[d], 1e-6 * (1.0 + before.m2[d]));
+    }
+}
+
+TEST_F(ImageProcessingTest, DBStatsConcurrentWrites) {
+    FeatureStats before;
+    ASSERT_EQ(db.loadFeatureStats(before), 0);
+
+    // Writers with their own connections: no statistics update may be lost
+    const int writers = 4, samples = 5;
+    atomic<int> stored{0};
+    vector<thread> threads;
+    for (int w = 0; w < writers; w++) {
+        threads.emplace_back([&, w] {
+            DBManager connection;
+            ObjectFeatures sample = features;
+            for (int i = 0; i < samples; i++) {
+                sample[0] = features[0] + w * samples + i;
+                stored += connection.writeFeatureVector("stats race", sample) == 0;
+            }
+        });
+    }
+    for (thread& t : threads) t.join();
+    EXPECT_EQ(stored.load(), writers * samples);
+    FeatureStats after;
+    ASSERT_EQ(db.loadFeatureStats(after), 0);
+    EXPECT_EQ(after.count, before.count + writers * samples);
+
+    EXPECT_EQ(db.deleteLabel("stats race"), writers * samples);
+    ASSERT_EQ(db.loadFeatureStats(after), 0);
+    EXPECT_EQ(after.count, before.count);
+}
+
+TEST_F(ImageProcessingTest, DBLoadUsesStoredStats) {
+    ASSERT_GE(db.rebuildFeatureStats(), 0);
+    EXPECT_EQ(db.rebuildFeatureStats(), 0);  // Nothing left to repair
+    FeatureStats stored;
+    ASSERT_EQ(db.loadFeatureStats(stored), 0);
+
+    // The load takes the stored statistics as they are instead of its own sums
+    TrainingSet data;
+    db.loadFeatureVectors(data);
+    EXPECT_EQ(data.stats().count, stored.count);
+    for (size_t d = 0; d < FEATURE_DIMS; d++) {
+        EXPECT_EQ(data.stats().mean[d], stored.mean[d]);
+        EXPECT_EQ(data.stats().m2[d], stored.m2[d]);
+    }
+}
+// Original float conversion, used as the bit-exact reference for bgr_to_hsv / bgr_to_value
+static Vec3b referenceHsv(const Vec3b& bgr) {
+    float B = bgr[0] / 255.0f, G = bgr[1] / 255.0f, R = bgr[2] / 255.0f;
+    float V = max({R, G, B});
+    float S = (V > 0) ? (V - min({R, G, B})) / V : 0.0f;
+    float H = 0.0f;
+    if (S > 0) {
+        float delta = V - min({R, G, B});
+        if (R == V) H = 60.0f * (G - B) / delta;
+        else if (G == V) H = 60.0f * (2 + (B - R) / delta);
+        else H = 60.0f * (4 + (R - G) / delta);
+        if (H < 0) H += 360.0f;
+    }
+    return Vec3b(static_cast<uchar>(H / 2.0f), static_cast<uchar>(S * 255), static_cast<uchar>(V * 255));
+}
+
+// Every 24-bit BGR color must convert exactly like the float implementation
+TEST(HsvConversionTest, MatchesFloatReferenceForAllColors) {
+    Mat allColors(4096, 4096, CV_8UC3);
+    for (int i = 0; i < allColors.rows; i++) {
+        Vec3b* row = allColors.ptr<Vec3b>(i);
+        for (int j = 0; j < allColors.cols; j++) {
+            int c = i * allColors.cols + j;
+            row[j] = Vec3b(c & 0xFF, (c >> 8) & 0xFF, (c >> 16) & 0xFF);
+        }
+    }
+    Mat hsv, value;
+    bgr_to_hsv(allColors, hsv);
+    bgr_to_value(allColors, value);
+
+    int hsvMismatches = 0, valueMismatches = 0;
+    for (int i = 0; i < allColors.rows; i++) {
+        for (int j = 0; j < allColors.cols; j++) {
+            Vec3b expected = referenceHsv(allColors.at<Vec3b>(i, j));
+            if (hsv.at<Vec3b>(i, j) != expected) hsvMismatches++;
+            if (value.at<uchar>(i, j) != expected[2]) valueMismatches++;
+        }
+    }
+    EXPECT_EQ(hsvMismatches, 0);
+    EXPECT_EQ(valueMismatches, 0);
+}
+
+// Original per-iteration ISODATA over pixel lists, used as the reference for the histogram version
+static float referenceIsodata(const Mat& src) {
+    float thresholdValue = 128;
+    for (int iteration = 0; iteration < 50; iteration++) {
+        float oldThreshold = thresholdValue;
+        double backgroundSum = 0, objectSum = 0;
+        int backgroundCount = 0, objectCount = 0;
+        for (int i = 0; i < src.rows; i++) {
+            for (int j = 0; j < src.cols; j++) {
+                float pixelValue = src.at<uchar>(i, j);
+                if (pixelValue < thresholdValue) {
+                    backgroundSum += pixelValue;
+                    backgroundCount++;
+                } else {
+                    objectSum += pixelValue;
+                    objectCount++;
+                }
+            }
+        }
+        float backgroundMean = backgroundCount ? backgroundSum / backgroundCount : 0;
+        float objectMean = objectCount ? objectSum / objectCount : 0;
+        thresholdValue = (backgroundMean + objectMean) / 2.0f;
+        if (abs(thresholdValue - oldThreshold) < 0.5f) break;
+    }
+    return thresholdValue;
+}
+
+// The histogram threshold must binarize every test image exactly like the pixel-list version
+TEST(ThresholdTest, HistogramIsodataMatchesReference) {
+    for (const string& name : {"example001.png", "example068.png", "example167.png", "img1p3.png",
+                               "img2P3.png", "img3P3.png", "img4P3.png", "img5P3.png"}) {
+        Mat image = cv::imread("../test-imgs/" + name);
+        ASSERT_FALSE(image.empty()) << "Failed to load test image: " << name;
+        Mat value, thresholded;
+        bgr_to_value(image, value);
+
+        float expected = referenceIsodata(value);
+        float actual = threshold(value, thresholded);
+        EXPECT_NEAR(actual, expected, 0.5f) << name;
+        EXPECT_EQ(cv::countNonZero(thresholded != (value > expected)), 0) << name;
+
+        // Otsu should land next to OpenCV's own implementation
+        Mat otsu;
+        double cvOtsu = cv::threshold(value, otsu, 0, 255, THRESH_BINARY | THRESH_OTSU);
+        EXPECT_NEAR(threshold(value, thresholded, 128.0f, ThresholdMethod::OTSU), cvOtsu, 1.0) << name;
+    }
+}
+
+// Rectangular erosion / dilation must match OpenCV (default border) for small and large kernels
+TEST(MorphologyTest, RectFiltersMatchOpenCV) {
+    RNG rng(5330);
+    Mat gray(97, 131, CV_8UC1), binary;
+    rng.fill(gray, RNG::UNIFORM, 0, 256);
+    binary = (gray > 100);
+
+    for (const Mat& src : {gray, binary}) {
+        for (Size kernel : {Size(1, 1), Size(3, 3), Size(4, 2), Size(7, 7), Size(15, 15), Size(1, 9), Size(12, 1)}) {
+            Mat element = getStructuringElement(MORPH_RECT, kernel);
+            Mat expected, actual;
+
+            cv::erode(src, expected, element);
+            ASSERT_EQ(erodeRect(src, actual, kernel), 0);
+            EXPECT_EQ(cv::countNonZero(expected != actual), 0) << "erode " << kernel;
+
+            cv::dilate(src, expected, element);
+            ASSERT_EQ(dilateRect(src, actual, kernel), 0);
+            EXPECT_EQ(cv::countNonZero(expected != actual), 0) << "dilate " << kernel;
+        }
+    }
+}
+
+TEST(MorphologyTest, SequenceParsingAndComposites) {
+    vector<MorphStep> steps;
+    ASSERT_EQ(parseMorphSequence("open:7x5,close:15", steps), 0);
+    ASSERT_EQ(steps.size(), 2u);
+    EXPECT_EQ(steps[0].op, MorphOp::OPEN);
+    EXPECT_EQ(steps[0].kernel, Size(7, 5));
+    EXPECT_EQ(steps[1].op, MorphOp::CLOSE);
+    EXPECT_EQ(steps[1].kernel, Size(15, 15));
+    EXPECT_EQ(parseMorphSequence("blur:3", steps), -1);
+    EXPECT_EQ(parseMorphSequence("erode:0", steps), -1);
+
+    Mat binary = loadTestImage("example001.png") > 127;
+    Mat expected, actual;
+    ASSERT_EQ(parseMorphSequence("open:7x5,close:15", steps), 0);
+    cv::morphologyEx(binary, expected, MORPH_OPEN, getStructuringElement(MORPH_RECT, Size(7, 5)));
+    cv::morphologyEx(expected, expected, MORPH_CLOSE, getStructuringElement(MORPH_RECT, Size(15, 15)));
+    applyMorphologicalFiltering(binary, actual, steps);
+    EXPECT_EQ(cv::countNonZero(expected != actual), 0);
+}
+
+// True when two region maps hold the same regions, allowing the labels to be numbered differently
+static bool sameRegionSet(const Mat& a, const Mat& b) {
+    if (a.size() != b.size()) return false;
+    map<int, int> aToB, bToA;
+    for (int i = 0; i < a.rows; i++) {
+        for (int j = 0; j < a.cols; j++) {
+            int la = a.at<int>(i, j), lb = b.at<int>(i, j);
+            if ((la == 0) != (lb == 0)) return false;
+            if (la == 0) continue;
+            if (aToB.emplace(la, lb).first->second != lb) return false;
+            if (bToA.emplace(lb, la).first->second != la) return false;
+        }
+    }
+    return true;
+}
+
+// The packed pipeline must produce the same masks and regions as the 8-bit one
+TEST(PackedBinaryTest, MatchesUnpackedPipeline) {
+    Mat image = cv::imread("../test-imgs/img3P3.png");
+    ASSERT_FALSE(image.empty());
+    Mat value, thresholded, unpacked;
+    bgr_to_value(image, value);
+
+    PackedBinaryImage packed, packedMorp;
+    EXPECT_EQ(thresholdPacked(value, packed), threshold(value, thresholded));
+    ASSERT_EQ(unpackBinary(packed, unpacked), 0);
+    EXPECT_EQ(cv::countNonZero(unpacked != thresholded), 0);
+
+    vector<MorphStep> steps;
+    ASSERT_EQ(parseMorphSequence("open:3,close:7x5,dilate:66x1", steps), 0);
+    Mat morp;
+    applyMorphologicalFiltering(thresholded, morp, steps);
+    applyMorphologicalFilteringPacked(packed, packedMorp, steps);
+    ASSERT_EQ(unpackBinary(packedMorp, unpacked), 0);
+    EXPECT_EQ(cv::countNonZero(unpacked != morp), 0);
+
+    // 4-connectivity keeps boundary regions in both implementations
+    Mat expectedRegions, packedRegions;
+    int expectedCount = twoPassSegmentation4conn(morp, expectedRegions, 20);
+    EXPECT_EQ(segmentPacked4conn(packedMorp, packedRegions, 20), expectedCount);
+    EXPECT_TRUE(sameRegionSet(expectedRegions, packedRegions));
+}
+
+// 8-connected run labeling of the packed mask drops the same border and small regions as the two-pass labeler
+TEST(PackedBinaryTest, Segment8connMatchesTwoPass) {
+    for (const string& name : {"img1p3.png", "img2P3.png", "img3P3.png", "img4P3.png", "img5P3.png"}) {
+        Mat image = cv::imread("../test-imgs/" + name);
+        ASSERT_FALSE(image.empty());
+        Mat value, binary;
+        bgr_to_value(image, value);
+        threshold(value, binary);
+        PackedBinaryImage packed;
+        ASSERT_EQ(packBinary(binary, packed), 0);
+
+        Mat expected, actual;
+        int count = twoPassSegmentation8conn(binary, expected, 10);
+        EXPECT_EQ(segmentPacked8conn(packed, actual, 10), count) << name;
+        EXPECT_TRUE(sameRegionSet(expected, actual)) << name;
+    }
+}
+
+// Strip-parallel labeling must find the same regions for any number of strips
+TEST(ParallelLabelingTest, MatchesSerialLabeling) {
+    for (const string& name : {"img1p3.png", "img2P3.png", "img5P3.png"}) {
+        Mat image = cv::imread("../test-imgs/" + name);
+        ASSERT_FALSE(image.empty());
+        Mat value, binary;
+        bgr_to_value(image, value);
+        threshold(value, binary);
+
+        Mat serial4, serial8;
+        int count4 = twoPassSegmentation4conn(binary, serial4, 10);
+        int count8 = twoPassSegmentation8conn(binary, serial8, 10);
+
+        for (int strips : {1, 2, 7, 64}) {
+            Mat parallel4, parallel8;
+            EXPECT_EQ(parallelSegmentation4conn(binary, parallel4, 10, strips), count4) << name;
+            EXPECT_TRUE(sameRegionSet(serial4, parallel4)) << name << " strips " << strips;
+            EXPECT_EQ(parallelSegmentation8conn(binary, parallel8, 10, strips), count8) << name;
+            EXPECT_TRUE(sameRegionSet(serial8, parallel8)) << name << " strips " << strips;
+        }
+    }
+}
+
+// Statistics collected during run-length labeling must match a per-region pass over the pixels
+TEST(RegionStatsTest, MatchesPixelMoments) {
+    Mat image = cv::imread("../test-imgs/img4P3.png");
+    ASSERT_FALSE(image.empty());
+    Mat value, binary;
+    bgr_to_value(image, value);
+    threshold(value, binary);
+
+    for (bool eightConnectivity : {false, true}) {
+        Mat regionMap, reference;
+        vector<RegionStats> stats;
+        int count = eightConnectivity ? runLengthSegmentation8conn(binary, regionMap, stats, 10)
+                                      : runLengthSegmentation4conn(binary, regionMap, stats, 10);
+        int referenceCount = eightConnectivity ? parallelSegmentation8conn(binary, reference, 10, 1)
+                                               : twoPassSegmentation4conn(binary, reference, 10);
+        ASSERT_EQ(count, referenceCount);
+        ASSERT_EQ(static_cast<int>(stats.size()), count);
+        EXPECT_TRUE(sameRegionSet(regionMap, reference));
+
+        for (const RegionStats& region : stats) {
+            Mat mask = (regionMap == region.label);
+            Moments m = moments(mask, true);
+            vector<Point> pixels;
+            findNonZero(mask, pixels);
+
+            EXPECT_EQ(region.area, countNonZero(mask));
+            EXPECT_EQ(region.bbox, boundingRect(pixels));
+            for (auto field : {&Moments::m00, &Moments::m10, &Moments::m01, &Moments::m20, &Moments::m11,
+                               &Moments::m02, &Moments::m30, &Moments::m21, &Moments::m12, &Moments::m03}) {
+                EXPECT_NEAR(region.moments().*field, m.*field, 1e-9 * max(1.0, abs(m.*field)));
+            }
+            double hu[7], expectedHu[7];
+            HuMoments(region.moments(), hu);
+            HuMoments(m, expectedHu);
+            for (int i = 0; i < 7; i++) {
+                EXPECT_NEAR(hu[i], expectedHu[i], 1e-9 + 1e-6 * abs(expectedHu[i]));
+            }
+        }
+    }
+}
+
+TEST(RegionFeatureTest, CroppedGeometryMatchesFullFrame) {
+    Mat image = cv::imread("../test-imgs/img4P3.png");
+    ASSERT_FALSE(image.empty());
+    Mat value, binary, regionMap;
+    bgr_to_value(image, value);
+    threshold(value, binary);
+    vector<RegionStats> stats;
+    ASSERT_GT(runLengthSegmentation8conn(binary, regionMap, stats, 10), 0);
+
+    for (const RegionStats& region : stats) {
+        Mat mask = (regionMap == region.label);
+        vector<vector<Point>> contours;
+        findContours(mask, contours, RETR_EXTERNAL, CHAIN_APPROX_SIMPLE);
+        vector<Point> pixels;
+        findNonZero(mask, pixels);
+        RotatedRect obb = minAreaRect(pixels);
+
+        Moments m = region.moments();
+        RegionGeometry fromStats, fromPixels;
+        ASSERT_EQ(extractRegionGeometry(regionMap, region.label, region.bbox, &m, fromStats), 0);
+        ASSERT_EQ(extractRegionGeometry(regionMap, region.label, region.bbox, nullptr, fromPixels), 0);
+        EXPECT_NEAR(fromPixels.centroid.x, region.centroid().x, 1e-3);
+        EXPECT_NEAR(fromPixels.centroid.y, region.centroid().y, 1e-3);
+        EXPECT_NEAR(fromStats.theta, fromPixels.theta, 1e-6);
+
+        double largestArea = 0;
+        for (const vector<Point>& contour : contours) largestArea = max(largestArea, contourArea(contour));
+        EXPECT_DOUBLE_EQ(fromStats.contourArea, largestArea);
+        EXPECT_NEAR(fromStats.obb.size.area(), obb.size.area(), 1e-3 * obb.size.area() + 1e-3);
+
+        ObjectFeatures features;
+        ASSERT_EQ(computeRegionFeatures(fromStats, features), 0);
+        ASSERT_EQ(features.size(), 10u);
+    }
+}
+
+TEST(RegionFeatureTest, AllRegionsMatchSingleRegionFeatures) {
+    Mat image = cv::imread("../test-imgs/img4P3.png");
+    ASSERT_FALSE(image.empty());
+    Mat value, binary, regionMap;
+    bgr_to_value(image, value);
+    threshold(value, binary);
+    vector<RegionStats> stats;
+    int count = runLengthSegmentation8conn(binary, regionMap, stats, 10);
+    ASSERT_GT(count, 0);
+
+    // With and without labeler statistics, every region matches the one-region path
+    vector<RegionObject> fromStats, fromMap;
+    ASSERT_EQ(computeAllRegionFeatures(regionMap, stats, fromStats), count);
+    ASSERT_EQ(computeAllRegionFeatures(regionMap, {}, fromMap), count);
+    for (int i = 0; i < count; i++) {
+        ASSERT_EQ(fromStats[i].regionID, i + 1);
+        ASSERT_EQ(fromMap[i].regionID, i + 1);
+        EXPECT_EQ(fromMap[i].geometry.bbox, stats[i].bbox);
+
+        RegionGeometry geometry;
+        ObjectFeatures features;
+        ASSERT_EQ(extractRegionGeometry(regionMap, i + 1, stats[i].bbox, nullptr, geometry), 0);
+        computeRegionFeatures(geometry, features);
+        ASSERT_EQ(fromMap[i].features.size(), features.size());
+        for (size_t k = 0; k < features.size(); k++) {
+            EXPECT_FLOAT_EQ(fromMap[i].features[k], features[k]);
+            EXPECT_NEAR(fromStats[i].features[k], features[k], 1e-3 * max(1.0f, abs(features[k])));
+        }
+    }
+}
+
+// Bright, well separated objects on a dark frame, away from the border: windows around them never clip
+static Mat makeObjectFrame() {
+    Mat frame(240, 320, CV_8UC3, Scalar(40, 40, 40));
+    rectangle(frame, Point(40, 40), Point(100, 90), Scalar(210, 210, 210), FILLED);
+    circle(frame, Point(220, 70), 30, Scalar(210, 210, 210), FILLED);
+    ellipse(frame, Point(130, 175), Size(50, 25), 30, 0, 360, Scalar(210, 210, 210), FILLED);
+    return frame;
+}
+
+TEST(RegionStatsTest, WindowedSegmentationMatchesFullFrame) {
+    Mat image = makeObjectFrame();
+    vector<MorphStep> steps = {{MorphOp::ERODE, Size(3, 3)}};
+    Mat value, binary, filtered, regionMap;
+    bgr_to_value(image, value);
+    float t = threshold(value, binary);
+    applyMorphologicalFiltering(binary, filtered, steps);
+    vector<RegionStats> stats;
+    int count = runLengthSegmentation8conn(filtered, regionMap, stats);
+    ASSERT_GT(count, 0);
+
+    vector<Rect> boxes;
+    for (const RegionStats& region : stats) boxes.push_back(region.bbox);
+    Mat windowMap;
+    vector<RegionStats> windowStats;
+    int clipped = -1;
+    int windowCount = segmentWindows8conn(image, boxes, 16, t, steps, windowMap, windowStats, clipped);
+    // Regions that do not reach an inner window edge see the same pixels as in the full frame
+    ASSERT_EQ(clipped, 0);
+    ASSERT_EQ(windowCount, count);
+    EXPECT_EQ(countNonZero(windowMap != regionMap), 0);
+    for (int i = 0; i < count; i++) {
+        EXPECT_EQ(windowStats[i].area, stats[i].area);
+        EXPECT_EQ(windowStats[i].bbox, stats[i].bbox);
+    }
+
+    // No boxes: nothing to process
+    EXPECT_EQ(segmentWindows8conn(image, {}, 16, t, steps, windowMap, windowStats, clipped), 0);
+    EXPECT_EQ(countNonZero(windowMap), 0);
+}
+
+TEST(ChangeDetectorTest, SkipsStaticFrames) {
+    Mat image = cv::imread("../test-imgs/img4P3.png");
+    ASSERT_FALSE(image.empty());
+    ChangeDetector detector(8, 12, 0.005f, 0);
+
+    EXPECT_TRUE(detector.hasChanged(image));   // First frame is always processed
+    EXPECT_FALSE(detector.hasChanged(image));
+    Mat noisy = image + Scalar::all(3);         // Small global change stays below the threshold
+    EXPECT_FALSE(detector.hasChanged(noisy));
+
+    Mat moved = image.clone();
+    rectangle(moved, Rect(image.cols / 4, image.rows / 4, image.cols / 4, image.rows / 4), Scalar::all(0), FILLED);
+    rectangle(moved, Rect(image.cols / 4, image.rows / 4, image.cols / 8, image.rows / 8), Scalar::all(255), FILLED);
+    EXPECT_TRUE(detector.hasChanged(moved));
+    EXPECT_FALSE(detector.hasChanged(moved));  // The changed frame is the new reference
+
+    detector.reset();
+    EXPECT_TRUE(detector.hasChanged(moved));
+    EXPECT_EQ(detector.framesSeen(), 6);
+    EXPECT_EQ(detector.framesSkipped(), 3);
+}
+
+TEST(FrameRingTest, LatestItemWins) {
+    TripleBuffer<int> ring;
+    int item = 0;
+    EXPECT_FALSE(ring.popLatest(item));
+    item = 1;
+    EXPECT_TRUE(ring.push(item));
+    EXPECT_EQ(ring.size(), 1u);
+    ASSERT_TRUE(ring.popLatest(item));
+    EXPECT_EQ(item, 1);
+    EXPECT_FALSE(ring.popLatest(item));
+
+    // Full: a push replaces the unread item and reports the drop, the consumer gets the last one
+    item = 2;
+    EXPECT_TRUE(ring.push(item));
+    for (int i = 3; i <= 6; i++) {
+        item = i;
+        EXPECT_FALSE(ring.push(item));
+    }
+    EXPECT_EQ(ring.size(), 1u);
+    ASSERT_TRUE(ring.popLatest(item));
+    EXPECT_EQ(item, 6);
+    EXPECT_EQ(ring.size(), 0u);
+
+    // Concurrent producer that never waits: the consumer only sees increasing, complete items and
+    // always ends with the last one
+    TripleBuffer<vector<int>> frames;
+    const int count = 200000;
+    atomic<int> dropped{0};
+    thread producer([&]() {
+        for (int i = 1; i <= count; i++) {
+            vector<int> frame(16, i);
+            if (!frames.push(frame)) dropped++;
+        }
+    });
+    vector<int> frame;
+    int last = 0, received = 0;
+    while (last < count) {
+        if (frames.popLatest(frame)) {
+            ASSERT_GT(frame[0], last);
+            ASSERT_EQ(frame[15], frame[0]);
+            last = frame[0];
+            received++;
+        }
+    }
+    producer.join();
+    EXPECT_EQ(received + dropped, count);
+}
+
+TEST(FrameArenaTest, SteadyStateReusesBuffers) {
+    Mat image = cv::imread("../test-imgs/img4P3.png");
+    ASSERT_FALSE(image.empty());
+    Mat value, binary;
+    bgr_to_value(image, value);
+    threshold(value, binary);
+    vector<MorphStep> steps = {{MorphOp::OPEN, Size(5, 5)}, {MorphOp::CLOSE, Size(7, 3)}};
+
+    FrameArena arena;
+    arena.reserve(image.size());
+    Mat filtered, regionMap, dst, expectedFiltered, expectedMap;
+    vector<RegionStats> stats, expectedStats;
+    ObjectFeatures features;
+    applyMorphologicalFiltering(binary, expectedFiltered, steps);
+    int expectedCount = runLengthSegmentation8conn(expectedFiltered, expectedMap, expectedStats);
+
+    const uchar* buffers[3] = {};
+    size_t capacities[3] = {};
+    for (int frame = 0; frame < 3; frame++) {
+        applyMorphologicalFiltering(binary, filtered, steps, arena.morph);
+        int count = runLengthSegmentation8conn(filtered, regionMap, stats, arena.labels);
+        computeRegionFeatures(regionMap, 1, image, dst, features, arena.geometry);
+
+        // Same results as the allocating path
+        EXPECT_EQ(countNonZero(filtered != expectedFiltered), 0);
+        EXPECT_EQ(count, expectedCount);
+        EXPECT_EQ(countNonZero(regionMap != expectedMap), 0);
+
+        // After the first frame nothing is reallocated
+        const uchar* current[3] = {filtered.data, regionMap.data, dst.data};
+        size_t currentCapacities[3] = {arena.labels.runs.capacity(), arena.labels.parent.capacity(),
+                                       arena.geometry.maskStorage.capacity()};
+        if (frame > 0) {
+            for (int i = 0; i < 3; i++) {
+                EXPECT_EQ(current[i], buffers[i]);
+                EXPECT_EQ(currentCapacities[i], capacities[i]);
+            }
+        }
+        copy(current, current + 3, buffers);
+        copy(currentCapacities, currentCapacities + 3, capacities);
+    }
+}
+
+// The packed morphology only swaps buffers with the arena, so once the destination has a buffer
+// (second frame) the set of buffers stays the same
+TEST(FrameArenaTest, PackedSteadyStateReusesBuffers) {
+    Mat image = cv::imread("../test-imgs/img4P3.png");
+    ASSERT_FALSE(image.empty());
+    Mat value;
+    bgr_to_value(image, value);
+    PackedBinaryImage packed, filtered, expected;
+    thresholdPacked(value, packed);
+    vector<MorphStep> steps = {{MorphOp::OPEN, Size(5, 5)}, {MorphOp::DILATE, Size(7, 3)}};
+    applyMorphologicalFilteringPacked(packed, expected, steps);
+
+    FrameArena arena;
+    arena.reserve(image.size());
+    vector<const uint64_t*> buffers;
+    for (int frame = 0; frame < 4; frame++) {
+        applyMorphologicalFilteringPacked(packed, filtered, steps, arena.packedMorph);
+        EXPECT_EQ(filtered.words, expected.words);
+
+        vector<const uint64_t*> current = {filtered.words.data(), arena.packedMorph.result.words.data(),
+                                           arena.packedMorph.above.words.data(),
+                                           arena.packedMorph.current.words.data(),
+                                           arena.packedMorph.padded.data(), arena.packedMorph.shifted.data()};
+        sort(current.begin(), current.end());
+        if (frame > 1) {
+            EXPECT_EQ(current, buffers);
+        }
+        buffers = current;
+    }
+}
+
+TEST(StageMetricsTest, HistogramPercentilesWithinBucketPrecision) {
+    // Every value lands in a bucket whose range contains it
+    for (uint64_t value : {0ull, 15ull, 16ull, 17ull, 1000ull, 123456789ull, 1ull << 40}) {
+        int index = LatencyHistogram::bucketIndex(value);
+        EXPECT_LE(LatencyHistogram::bucketLowerBound(index), value);
+        EXPECT_GT(LatencyHistogram::bucketLowerBound(index + 1), value);
+    }
+
+    LatencyHistogram histogram;
+    EXPECT_EQ(histogram.percentile(0.5), 0);
+    for (int64_t ns = 1; ns <= 100000; ns++) {
+        histogram.record(ns * 1000);  // 1 us .. 100 ms, uniform
+    }
+    EXPECT_EQ(histogram.count(), 100000u);
+    EXPECT_EQ(histogram.max(), 100000000);
+    EXPECT_NEAR(histogram.percentile(0.5), 50e6, 50e6 / 16);
+    EXPECT_NEAR(histogram.percentile(0.99), 99e6, 99e6 / 16);
+    EXPECT_EQ(histogram.percentile(1.0), 100000000);
+
+    StageMetrics metrics;
+    { ScopedStageTimer timer(metrics, Stage::MORPHOLOGY); }
+    EXPECT_EQ(metrics.histogram(Stage::MORPHOLOGY).count(), 1u);
+    vector<string> lines;
+    metrics.summaryLines(lines);
+    ASSERT_EQ(lines.size(), 1u);  // Stages without samples are left out
+    EXPECT_EQ(lines[0].rfind("morphology", 0), 0u);
+    metrics.reset();
+    EXPECT_EQ(metrics.histogram(Stage::MORPHOLOGY).count(), 0u);
+}
+
+TEST(RegionStatsTest, PyramidSegmentationMatchesFullFrame) {
+    Mat image = makeObjectFrame();
+    vector<MorphStep> steps = {{MorphOp::ERODE, Size(3, 3)}};
+    int compared = 0;
+    for (int levels = 1; levels <= 2; levels++) {
+        float t = 128.0f;
+        Mat pyramidMap;
+        vector<RegionStats> pyramidStats;
+        int clipped = -1;
+        int count = pyramidSegmentation8conn(image, levels, 8, t, ThresholdMethod::ISODATA, steps,
+                                             pyramidMap, pyramidStats, clipped);
+        ASSERT_GE(count, 0);
+        if (clipped != 0) continue;  // The caller falls back to a full-frame pass
+
+        // Same threshold at full resolution: regions and their features agree
+        Mat value, binary, filtered, regionMap;
+        bgr_to_value(image, value);
+        cv::threshold(value, binary, floor(t), 255, THRESH_BINARY);
+        applyMorphologicalFiltering(binary, filtered, steps);
+        vector<RegionStats> stats;
+        ASSERT_EQ(runLengthSegmentation8conn(filtered, regionMap, stats), count);
+        ASSERT_GT(count, 0);
+        compared++;
+        for (int i = 0; i < count; i++) {
+            EXPECT_EQ(pyramidStats[i].area, stats[i].area);
+            ObjectFeatures expected, actual;
+            RegionGeometry geometry;
+            ASSERT_EQ(extractRegionGeometry(regionMap, i + 1, stats[i].bbox, nullptr, geometry), 0);
+            computeRegionFeatures(geometry, expected);
+            ASSERT_EQ(extractRegionGeometry(pyramidMap, i + 1, pyramidStats[i].bbox, nullptr, geometry), 0);
+            computeRegionFeatures(geometry, actual);
+            for (size_t k = 0; k < expected.size(); k++) {
+                EXPECT_NEAR(actual[k], expected[k], 1e-4);
+            }
+        }
+    }
+    ASSERT_GT(compared, 0);  // At least one level ran without a fallback
+}
+
+TEST(FeatureStatsTest, WelfordMatchesTwoPassAndReverses) {
+    // Features with a large offset: a float sum / sum of squares loses their variance entirely
+    mt19937 rng(5330);
+    normal_distribution<float> noise(0.0f, 1.0f);
+    TrainingSet data;
+    for (int i = 0; i < 2000; i++) {
+        ObjectFeatures features;
+        for (int k = 0; k < 10; k++) features[k] = 10000.0f * (k + 1) + (k + 1) * 0.1f * noise(rng);
+        data.push_back("sample", features);
+    }
+    auto twoPass = [](const vector<ObjectFeatures>& samples, size_t d) {
+        double mean = 0, m2 = 0;
+        for (const ObjectFeatures& sample : samples) mean += sample[d];
+        mean /= samples.size();
+        for (const ObjectFeatures& sample : samples) m2 += (sample[d] - mean) * (sample[d] - mean);
+        return sqrt(m2 / samples.size());
+    };
+    ObjectFeatures stdevs = computeFeatureStdDevs(data);
+    for (size_t d = 0; d < FEATURE_DIMS; d++) {
+        double expected = twoPass(data.features(), d);
+        EXPECT_NEAR(stdevs[d], expected, 1e-4 * expected);
+    }
+
+    // Removing the second half leaves the statistics of the first half
+    FeatureStats stats = data.stats();
+    vector<ObjectFeatures> firstHalf(data.features().begin(), data.features().begin() + 1000);
+    for (size_t i = 1000; i < data.size(); i++) stats.remove(data.features()[i]);
+    EXPECT_EQ(stats.count, 1000);
+    ObjectFeatures remaining = stats.stdDevs();
+    for (size_t d = 0; d < FEATURE_DIMS; d++) {
+        double expected = twoPass(firstHalf, d);
+        EXPECT_NEAR(remaining[d], expected, 1e-4 * expected);
+    }
+    for (const ObjectFeatures& sample : firstHalf) stats.remove(sample);
+    EXPECT_EQ(stats.count, 0);
+    EXPECT_EQ(stats.stdDevs(), ObjectFeatures());
+}
+
+TEST(FeatureStatsTest, AssignStoredStats) {
+    vector<string> labels(4, "sample");
+    vector<ObjectFeatures> features(4);
+    FeatureStats stored;
+    for (int i = 0; i < 4; i++) {
+        features[i][0] = static_cast<float>(i);
+        stored.add(features[i]);
+    }
+    stored.m2[0] = 20.0;  // Not the sums of the samples, so it shows which statistics are used
+    TrainingSet data;
+    data.assign(labels, features, stored);
+    EXPECT_EQ(data.size(), 4u);
+    EXPECT_EQ(data.features()[3], features[3]);
+    EXPECT_NEAR(computeFeatureStdDevs(data)[0], sqrt(5.0f), 1e-6);
+
+    FeatureStats partial = stored;
+    partial.count = 3;  // Does not cover every sample
+    EXPECT_THROW(data.assign(labels, features, partial), cv::Exception);
+}
+
+// Label of each synthetic cluster
+static const vector<string> CLUSTER_NAMES = {"spatula", "hair tie", "glass", "tea bag", "socks"};
+
+// Sample of cluster c: feature k is c * (k + 1) * spacing plus normal noise of standard deviation spread
+static ObjectFeatures clusterSample(int cluster, float spacing, float spread, mt19937& rng) {
+    normal_distribution<float> noise(0.0f, 1.0f);
+    ObjectFeatures features;
+    for (int k = 0; k < 10; k++) features[k] = static_cast<float>(cluster) * (k + 1) * spacing + spread * noise(rng);
+    return features;
+}
+
+// Synthetic training set of 5 clusters in 10 dimensions, entry i in cluster i % 5
+static TrainingSet makeClusteredSet(int size, uint32_t seed, float spacing = 1.0f) {
+    mt19937 rng(seed);
+    TrainingSet db;
+    db.reserve(size);
+    for (int i = 0; i < size; i++) {
+        db.push_back(CLUSTER_NAMES[i % 5], clusterSample(i % 5, spacing, 1.0f, rng));
+    }
+    return db;
+}
+
+// Queries around the same clusters; query q has noise 1 + q % spreadLevels, so some land far from all
+static vector<ObjectFeatures> makeClusteredQueries(int count, uint32_t seed, float spacing = 1.0f,
+                                                   int spreadLevels = 1) {
+    mt19937 rng(seed);
+    vector<ObjectFeatures> queries;
+    for (int q = 0; q < count; q++) {
+        queries.push_back(clusterSample(q % 5, spacing, 1.0f + q % spreadLevels, rng));
+    }
+    return queries;
+}
+
+TEST(NNIndexTest, MatchesClassifyByNN) {
+    // 5 labels in 10 dimensions, more entries than one SIMD block and not a multiple of it
+    TrainingSet db = makeClusteredSet(203, 5330);
+    NNIndex index;
+    EXPECT_EQ(index.classify(db.features()[0]), "Unknown");  // Empty index
+    index.build(db);
+    EXPECT_EQ(index.size(), db.size());
+    EXPECT_EQ(index.dimensions(), 10u);
+
+    vector<ObjectFeatures> queries = makeClusteredQueries(300, 5331, 1.0f, 4);  // Some beyond MAX_DISTANCE
+    for (const ObjectFeatures& features : queries) {
+        EXPECT_EQ(index.classify(features), classifyByNN(db, features));
+    }
+    EXPECT_EQ(index.classifyBatch(queries), classifyBatchByNN(db, queries));
+
+    float distance = -1;
+    EXPECT_EQ(index.labelName(index.nearest(db.features()[7], &distance)), db.labels()[7]);
+    EXPECT_NEAR(distance, 0.0f, 1e-3);
+    static_assert(NNIndex::dimensions() == ObjectFeatures::size(), "Dimensions are checked at compile time");
+}
+
+TEST(KDTreeTest, MatchesLinearSearch) {
+    TrainingSet db = makeClusteredSet(2000, 5330);
+    db.push_back("duplicate", db.features()[42]);  // Exact tie: the first entry wins, as in a linear scan
+
+    KDTreeIndex tree;
+    tree.build(db);
+    EXPECT_EQ(tree.size(), db.size());
+    EXPECT_GT(tree.depth(), 1);
+    NNIndex linear;
+    linear.build(db);
+    for (const ObjectFeatures& features : makeClusteredQueries(500, 5331, 1.0f, 4)) {
+        EXPECT_EQ(tree.classify(features), classifyByNN(db, features));
+        EXPECT_EQ(tree.classify(features), linear.classify(features));
+    }
+    EXPECT_EQ(tree.classify(db.features()[42]), db.labels()[42]);
+}
+
+TEST(NNIndexTest, BatchedKnnVotes) {
+    TrainingSet db = makeClusteredSet(1001, 5330);
+    NNIndex index;
+    index.build(db);
+    vector<ObjectFeatures> batch = makeClusteredQueries(100, 5331, 1.0f, 3);
+    Mat queries(static_cast<int>(batch.size()), 10, CV_32FC1);
+    for (int q = 0; q < queries.rows; q++) {
+        copy(batch[q].begin(), batch[q].end(), queries.ptr<float>(q));
+    }
+    // The batch matrix is a header over the vectors themselves
+    Mat view = featureMatrix(batch);
+    ASSERT_EQ(view.size(), queries.size());
+    EXPECT_EQ(view.ptr<float>(3), batch[3].data());
+    EXPECT_TRUE(view.isContinuous());  // No padding between the vectors
+    EXPECT_EQ(norm(view, queries, NORM_INF), 0.0);
+
+    // k = 1 is plain nearest neighbor
+    vector<KNNResult> results;
+    ASSERT_EQ(index.knnBatch(queries, 1, results), 0);
+    ASSERT_EQ(results.size(), batch.size());
+    for (size_t q = 0; q < batch.size(); q++) {
+        EXPECT_EQ(index.labelName(results[q].label), classifyByNN(db, batch[q]));
+    }
+
+    // k = 7: the same neighbors, in the same order, as a brute force scan with direct distances
+    ASSERT_EQ(index.knnBatch(queries, 7, results), 0);
+    ObjectFeatures scale = featureScale(db);
+    for (size_t q = 0; q < batch.size(); q++) {
+        vector<pair<float, int>> truth;
+        for (size_t i = 0; i < db.size(); i++) {
+            float sum = 0.0f;
+            for (size_t d = 0; d < FEATURE_DIMS; d++) {
+                float diff = batch[q][d] * scale[d] - db.features()[i][d] * scale[d];
+                sum += diff * diff;
+            }
+            truth.emplace_back(sum, static_cast<int>(i));
+        }
+        partial_sort(truth.begin(), truth.begin() + 7, truth.end());
+        const KNNResult& result = results[q];
+        ASSERT_EQ(result.neighbors.size(), 7u);
+        for (size_t j = 0; j < result.neighbors.size(); j++) {
+            EXPECT_EQ(result.neighbors[j].entry, truth[j].second);
+            EXPECT_NEAR(result.neighbors[j].distance, sqrt(truth[j].first), 1e-5);
+        }
+        EXPECT_GT(result.confidence, 0.0f);
+        EXPECT_LE(result.confidence, 1.0f);
+    }
+    EXPECT_EQ(index.classifyBatch(batch, 7)[0], index.labelName(results[0].label));
+    EXPECT_EQ(index.knnBatch(Mat(3, 4, CV_32FC1), 1, results), -1);  // Wrong dimensions
+
+    // Fewer entries than k: the confidence is the share of the neighbors that exist
+    TrainingSet small;
+    for (int i = 0; i < 3; i++) small.push_back("glass", db.features()[2]);
+    NNIndex smallIndex;
+    smallIndex.build(small);
+    ASSERT_EQ(smallIndex.knnBatch(vector<ObjectFeatures>{small.features()[0]}, 7, results), 0);
+    ASSERT_EQ(results[0].neighbors.size(), 3u);
+    EXPECT_EQ(smallIndex.labelName(results[0].label), "glass");
+    EXPECT_EQ(results[0].confidence, 1.0f);
+}
+
+TEST(HNSWTest, RecallAndSaveLoad) {
+    TrainingSet db = makeClusteredSet(5000, 5330, 0.3f);
+    vector<ObjectFeatures> queries = makeClusteredQueries(200, 5331, 0.3f);
+    NNIndex exact;
+    exact.build(db);
+    vector<KNNResult> truth;
+    ASSERT_EQ(exact.knnBatch(queries, 1, truth), 0);
+
+    HNSWIndex index;
+    EXPECT_EQ(index.classify(queries[0]), "Unknown");  // Empty index
+    index.build(db);
+    index.setEfSearch(64);
+    int found = 0;
+    for (size_t q = 0; q < queries.size(); q++) {
+        found += index.nearestEntry(queries[q]) == truth[q].neighbors[0].entry;
+    }
+    EXPECT_GE(found, 190);  // Recall >= 0.95
+
+    // A saved graph answers exactly like the one that was built
+    string path = "hnsw_test_index.bin";
+    ASSERT_EQ(index.save(path), 0);
+    uint64_t fingerprint = HNSWIndex::fingerprint(db);
+    HNSWIndex loaded;
+    ASSERT_EQ(loaded.load(path, fingerprint), 0);
+    loaded.setEfSearch(64);
+    EXPECT_EQ(loaded.size(), index.size());
+    for (const ObjectFeatures& query : queries) {
+        EXPECT_EQ(loaded.nearestEntry(query), index.nearestEntry(query));
+        EXPECT_EQ(loaded.classify(query), index.classify(query));
+    }
+
+    // Same size, different training data: the graph is rejected
+    TrainingSet original = makeClusteredSet(5000, 5330, 0.3f), changed;
+    for (size_t i = 0; i < original.size(); i++) {
+        changed.push_back(i == 17 ? "mug" : original.labels()[i], original.features()[i]);
+    }
+    EXPECT_NE(HNSWIndex::fingerprint(changed), fingerprint);
+    EXPECT_EQ(loaded.load(path, HNSWIndex::fingerprint(changed)), -1);
+    EXPECT_EQ(loaded.size(), index.size());
+    remove(path.c_str());
+    EXPECT_EQ(loaded.load(path, fingerprint), -1);  // Missing file keeps the loaded index
+    EXPECT_EQ(loaded.size(), index.size());
+}
+
+TEST(HNSWTest, RejectsCorruptFiles) {
+    TrainingSet db = makeClusteredSet(300, 5330, 0.3f);
+    uint64_t fingerprint = HNSWIndex::fingerprint(db);
+    HNSWIndex index;
+    index.build(db, 4, 20);
+    string path = "hnsw_corrupt_index.bin";
+    ASSERT_EQ(index.save(path), 0);
+    ifstream in(path, ios::binary);
+    string bytes((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+    in.close();
+
+    // Header: magic, version, fingerprint, count, dims, M, efConstruction, maxLevel, entry point
+    auto loadBytes = [&](const string& data) {
+        ofstream out(path, ios::binary);
+        out.write(data.data(), data.size());
+        out.close();
+        HNSWIndex loaded;
+        return loaded.load(path, fingerprint);
+    };
+    auto patched = [&](size_t offset, int32_t value) {
+        string modified = bytes;
+        memcpy(&modified[offset], &value, sizeof(value));
+        return modified;
+    };
+    const size_t fingerprintOffset = 8, countOffset = 16, mOffset = 32, maxLevelOffset = 40;
+    EXPECT_EQ(loadBytes(bytes), 0);                               // Unchanged
+    EXPECT_EQ(loadBytes(bytes.substr(0, bytes.size() - 1)), -1);  // Truncated
+    EXPECT_EQ(loadBytes(bytes.substr(0, 20)), -1);                // Truncated in the header
+    EXPECT_EQ(loadBytes(patched(countOffset, 1 << 20)), -1);      // Count beyond the file
+    EXPECT_EQ(loadBytes(patched(mOffset, 3)), -1);                // Link array sizes disagree
+    EXPECT_EQ(loadBytes(patched(maxLevelOffset, 40)), -1);        // Top layer without nodes
+    EXPECT_EQ(loadBytes(patched(maxLevelOffset + 4, 300)), -1);   // Entry point out of range
+    EXPECT_EQ(loadBytes(patched(fingerprintOffset, 0)), -1);      // Fingerprint of other data
+
+    // Arrays after the header: scale, points, entry labels, label names, levels, bottom layer links
+    const size_t dims = FEATURE_DIMS;
+    size_t labelsStart = maxLevelOffset + 8 + (8 + dims * 4) + (8 + db.size() * dims * 4) + 8;
+    size_t levelsStart = labelsStart + db.size() * 4 + 8 + 8;
+    for (const string& name : CLUSTER_NAMES) levelsStart += 4 + name.size();
+    size_t bottomStart = levelsStart + db.size() * 4 + 8;
+    uint64_t bottomSize = 0;
+    memcpy(&bottomSize, &bytes[bottomStart - 8], sizeof(bottomSize));
+    ASSERT_EQ(bottomSize, db.size() * (1 + 2 * 4));  // The layout above is the one save() wrote
+    EXPECT_EQ(loadBytes(patched(labelsStart, 5)), -1);            // Label ID without a name
+    EXPECT_EQ(loadBytes(patched(levelsStart, 50)), -1);           // Node above the top layer
+    EXPECT_EQ(loadBytes(patched(bottomStart, 9)), -1);            // More links than 2 * M
+    EXPECT_EQ(loadBytes(patched(bottomStart + 4, 300)), -1);      // Neighbor past the last node
+    EXPECT_EQ(loadBytes(patched(bottomStart + 4, -1)), -1);
+    string hugeArray = bytes;
+    uint64_t hugeSize = 1ull << 31;  // Rejected before anything is allocated
+    memcpy(&hugeArray[levelsStart - 8], &hugeSize, sizeof(hugeSize));
+    EXPECT_EQ(loadBytes(hugeArray), -1);
+    remove(path.c_str());
+}
+
+TEST(QuantizedIndexTest, RescoringMatchesExactSearch) {
+    TrainingSet clustered = makeClusteredSet(3000, 5330, 0.3f);
+    TrainingSet db;
+    for (size_t i = 0; i < clustered.size(); i++) {
+        ObjectFeatures features = clustered.features()[i];
+        if (i == 11) features[0] = 500.0f;  // An outlier stretches the int8 range of feature 0
+        db.push_back(clustered.labels()[i], features);
+    }
+    vector<ObjectFeatures> queries = makeClusteredQueries(300, 5331, 0.3f, 3);
+    NNIndex exact;
+    exact.build(db);
+    vector<KNNResult> truth;
+    ASSERT_EQ(exact.knnBatch(queries, 1, truth), 0);
+
+    for (QuantizedIndex::Precision precision : {QuantizedIndex::Precision::INT8, QuantizedIndex::Precision::FP16}) {
+        QuantizedIndex index;
+        EXPECT_EQ(index.classify(queries[0]), "Unknown");  // Empty index
+        {
+            TrainingSet copy = db;  // Freed before the queries: the index must not refer to it
+            index.build(copy, precision);
+        }
+        EXPECT_EQ(index.size(), db.size());
+        // The scanned codes: a quarter (int8) or half (float16) of the float index
+        EXPECT_LE(index.memoryBytes() * (precision == QuantizedIndex::Precision::INT8 ? 4 : 2), exact.memoryBytes());
+        // Cold float16 residuals and label IDs, plus the label names
+        size_t coldEntryBytes = 2 * FEATURE_DIMS + sizeof(int);
+        EXPECT_GE(index.coldBytes(), db.size() * coldEntryBytes);
+        EXPECT_LT(index.coldBytes(), db.size() * coldEntryBytes + 4096);
+
+        int found = 0, sameLabel = 0;
+        vector<string> labels = index.classifyBatch(queries);
+        for (size_t q = 0; q < queries.size(); q++) {
+            found += index.nearestEntry(queries[q]) == truth[q].neighbors[0].entry;
+            sameLabel += labels[q] == exact.classify(queries[q]);
+        }
+        EXPECT_GE(found, 294);  // 98% recall with the default rescoring
+        EXPECT_GE(sameLabel, 297);
+
+        float distance = -1;
+        EXPECT_EQ(index.labelName(index.nearest(db.features()[7], &distance)), db.labels()[7]);
+        EXPECT_NEAR(distance, 0.0f, 1e-3);
+        index.setRescore(0);  // Clamped to 1: the compressed scan alone
+        EXPECT_EQ(index.rescore(), 1);
+        EXPECT_GE(index.nearestEntry(queries[0]), 0);
+    }
+}
+
+// Copy of a saved tree model with one field of its first leaf replaced. Node records start at
+// recordsStart and hold threshold, feature, next and leaf label, 4 bytes each (label -1 for a split)
+template <typename T>
+static string patchFirstLeaf(const string& path, size_t recordsStart, size_t field, T value) {
+    ifstream in(path, ios::binary);
+    string bytes((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+    for (size_t record = recordsStart; record + 16 <= bytes.size(); record += 16) {
+        int32_t label = 0;
+        memcpy(&label, &bytes[record + 12], sizeof(label));
+        if (label >= 0) {
+            memcpy(&bytes[record + 4 * field], &value, sizeof(value));
+            break;
+        }
+    }
+    string patched = path + ".patched";
+    ofstream(patched, ios::binary) << bytes;
+    return patched;
+}
+
+TEST(DecisionTreeTest, TrainPredictSaveLoad) {
+    // Label i is the only one with a large feature i, so a deep enough tree separates all of them
+    mt19937 rng(5330);
+    normal_distribution<float> noise(0.0f, 0.3f);
+    TrainingSet db;
+    for (int i = 0; i < 250; i++) {
+        ObjectFeatures features;
+        for (int k = 0; k < 10; k++) features[k] = noise(rng) + (k == i % 5 ? 3.0f : 0.0f);
+        db.push_back(CLUSTER_NAMES[i % 5], features);
+    }
+    DecisionTree tree;
+    EXPECT_EQ(tree.classify(db.features()[0]), "Unknown");  // Untrained
+    EXPECT_EQ(tree.train({}), -1);
+    ASSERT_EQ(tree.train(db, 3), 0);
+    EXPECT_LE(tree.depth(), 3);
+    ASSERT_EQ(tree.train(db, 8), 0);
+    for (size_t i = 0; i < db.size(); i++) {
+        EXPECT_EQ(tree.classify(db.features()[i]), db.labels()[i]);
+    }
+    EXPECT_EQ(tree.classifyBatch(db.features()), db.labels());
+
+    string path = "decision_tree_test_model.bin";
+    ASSERT_EQ(tree.save(path), 0);
+    DecisionTree loaded;
+    ASSERT_EQ(loaded.load(path), 0);
+    EXPECT_EQ(loaded.nodeCount(), tree.nodeCount());
+    for (size_t i = 0; i < db.size(); i++) {
+        EXPECT_EQ(loaded.classify(db.features()[i]), db.labels()[i]);
+    }
+
+    // A leaf that steps on (finite threshold, or next past itself) could walk off the node array
+    const size_t records = 4 + 4 * sizeof(uint32_t);
+    string patched = patchFirstLeaf(path, records, 0, 1.0f);
+    EXPECT_EQ(loaded.load(patched), -1);
+    patched = patchFirstLeaf(path, records, 2, static_cast<int32_t>(tree.nodeCount() - 1));
+    EXPECT_EQ(loaded.load(patched), -1);
+    EXPECT_EQ(loaded.nodeCount(), tree.nodeCount());  // The valid tree is kept
+    remove(patched.c_str());
+    remove(path.c_str());
+}
+
+TEST(RandomForestTest, BeatsSingleTreeAndRoundTrips) {
+    // Overlapping clusters: label i raises features i and i + 5, the noise is half the separation
+    mt19937 rng(5330);
+    normal_distribution<float> noise(0.0f, 1.0f);
+    TrainingSet train, test;
+    for (int i = 0; i < 1000; i++) {
+        ObjectFeatures features;
+        for (int k = 0; k < 10; k++) features[k] = noise(rng) + (k % 5 == i % 5 ? 2.0f : 0.0f);
+        (i % 2 ? test : train).push_back(CLUSTER_NAMES[i % 5], features);
+    }
+    RandomForest forest;
+    EXPECT_EQ(forest.classify(train.features()[0]), "Unknown");  // Untrained
+    EXPECT_EQ(forest.train({}), -1);
+    ASSERT_EQ(forest.train(train, 32, 8), 0);
+    EXPECT_EQ(forest.treeCount(), 32u);
+    DecisionTree tree;
+    ASSERT_EQ(tree.train(train, 3), 0);
+
+    int forestCorrect = 0, treeCorrect = 0;
+    for (size_t i = 0; i < test.size(); i++) {
+        forestCorrect += forest.classify(test.features()[i]) == test.labels()[i];
+        treeCorrect += tree.classify(test.features()[i]) == test.labels()[i];
+    }
+    EXPECT_GT(forestCorrect, treeCorrect);
+    EXPECT_GE(forestCorrect, static_cast<int>(test.size() * 0.8));
+
+    // Tree-by-tree batch, the single query path and a retrained forest (same seed) agree
+    vector<string> batchLabels = forest.classifyBatch(test.features());
+    RandomForest retrained;
+    ASSERT_EQ(retrained.train(train, 32, 8), 0);
+    for (size_t i = 0; i < test.size(); i++) {
+        float confidence = 0;
+        int id = forest.predict(test.features()[i], &confidence);
+        EXPECT_EQ(batchLabels[i], forest.labelName(id));
+        EXPECT_GT(confidence, 0.0f);
+        EXPECT_LE(confidence, 1.0f);
+        EXPECT_EQ(retrained.classify(test.features()[i]), batchLabels[i]);
+    }
+
+    string path = "random_forest_test_model.bin";
+    ASSERT_EQ(forest.save(path), 0);
+    RandomForest loaded;
+    ASSERT_EQ(loaded.load(path), 0);
+    EXPECT_EQ(loaded.nodeCount(), forest.nodeCount());
+    EXPECT_EQ(loaded.classifyBatch(test.features()), batchLabels);
+
+    // A leaf with a finite threshold would step to the next node, past the array for the last one
+    string patched = patchFirstLeaf(path, 4 + 4 * sizeof(uint32_t) + forest.treeCount() * 2 * sizeof(int32_t), 0, 1.0f);
+    EXPECT_EQ(loaded.load(patched), -1);
+    EXPECT_EQ(loaded.classifyBatch(test.features()), batchLabels);
+    remove(patched.c_str());
+    remove(path.c_str());
+}